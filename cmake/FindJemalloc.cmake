@@ -0,0 +1,18 @@
+# SPDX-FileCopyrightText: 2026 heaptrack contributors
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# - Try to find the jemalloc allocator
+# This will define
+# JEMALLOC_FOUND
+# JEMALLOC_INCLUDE_DIR
+# JEMALLOC_LIBRARY
+#
+
+find_path(JEMALLOC_INCLUDE_DIR NAMES jemalloc/jemalloc.h)
+find_library(JEMALLOC_LIBRARY NAMES jemalloc)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(Jemalloc DEFAULT_MSG
+    JEMALLOC_LIBRARY JEMALLOC_INCLUDE_DIR)
+
+mark_as_advanced(JEMALLOC_INCLUDE_DIR JEMALLOC_LIBRARY)
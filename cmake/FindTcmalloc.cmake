@@ -0,0 +1,18 @@
+# SPDX-FileCopyrightText: 2026 heaptrack contributors
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# - Try to find the tcmalloc allocator of gperftools
+# This will define
+# TCMALLOC_FOUND
+# TCMALLOC_INCLUDE_DIR
+# TCMALLOC_LIBRARY
+#
+
+find_path(TCMALLOC_INCLUDE_DIR NAMES gperftools/tcmalloc.h)
+find_library(TCMALLOC_LIBRARY NAMES tcmalloc tcmalloc_minimal)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(Tcmalloc DEFAULT_MSG
+    TCMALLOC_LIBRARY TCMALLOC_INCLUDE_DIR)
+
+mark_as_advanced(TCMALLOC_INCLUDE_DIR TCMALLOC_LIBRARY)
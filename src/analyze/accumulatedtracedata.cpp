@@ -9,6 +9,8 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstring>
 #include <iostream>
 #include <memory>
 
@@ -148,16 +150,23 @@ bool AccumulatedTraceData::read(const string& inputFile, bool isReparsing)
 
 bool AccumulatedTraceData::read(const string& inputFile, const ParsePass pass, bool isReparsing)
 {
-    const bool isGzCompressed = boost::algorithm::ends_with(inputFile, ".gz");
-    const bool isZstdCompressed = boost::algorithm::ends_with(inputFile, ".zst");
-    const bool isCompressed = isGzCompressed || isZstdCompressed;
-    ifstream file(inputFile, isCompressed ? ios_base::in | ios_base::binary : ios_base::in);
+    ifstream file(inputFile, ios_base::in | ios_base::binary);
 
     if (!file.is_open()) {
         cerr << "Failed to open heaptrack log file: " << inputFile << endl;
         return false;
     }
 
+    // also detect the compression by its magic number, the file may have been compressed in-process
+    // by heaptrack or renamed later on
+    char magic[4] = {};
+    file.read(magic, sizeof(magic));
+    file.clear();
+    file.seekg(0);
+    const bool isGzCompressed = boost::algorithm::ends_with(inputFile, ".gz") || memcmp(magic, "\x1f\x8b", 2) == 0;
+    const bool isZstdCompressed =
+        boost::algorithm::ends_with(inputFile, ".zst") || memcmp(magic, "\x28\xb5\x2f\xfd", 4) == 0;
+
     boost::iostreams::filtering_istream in;
     in.push(byte_counter()); // caution, ::read dependant on filter order
     if (isGzCompressed) {
@@ -187,9 +196,21 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
         // 64 bit
         "operator new(unsigned long)",
         "operator new[](unsigned long)",
+        "operator new(unsigned long, std::nothrow_t const&)",
+        "operator new[](unsigned long, std::nothrow_t const&)",
+        "operator new(unsigned long, std::align_val_t)",
+        "operator new[](unsigned long, std::align_val_t)",
+        "operator new(unsigned long, std::align_val_t, std::nothrow_t const&)",
+        "operator new[](unsigned long, std::align_val_t, std::nothrow_t const&)",
         // 32 bit
         "operator new(unsigned int)",
         "operator new[](unsigned int)",
+        "operator new(unsigned int, std::nothrow_t const&)",
+        "operator new[](unsigned int, std::nothrow_t const&)",
+        "operator new(unsigned int, std::align_val_t)",
+        "operator new[](unsigned int, std::align_val_t)",
+        "operator new(unsigned int, std::align_val_t, std::nothrow_t const&)",
+        "operator new[](unsigned int, std::align_val_t, std::nothrow_t const&)",
     };
     vector<StringIndex> opNewStrIndices;
     opNewStrIndices.reserve(opNewStrings.size());
@@ -214,6 +235,7 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
                        });
     }
     peakRSS = 0;
+    peakHeaptrackOverhead = 0;
     for (auto& allocation : allocations) {
         allocation.clearCost();
     }
@@ -230,6 +252,44 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
     // allocations, i.e. when a deallocation follows with the same data
     uint64_t lastAllocationPtr = 0;
 
+    // when the data got aggregated in-process, the 'N' lines contain the cumulative cost
+    // per trace, so we have to remember the last one to apply the difference
+    vector<AllocationData> lastSnapshot;
+    bool snapshotChanged = false;
+
+    // when recorded with precise time stamps, the time of the last 'C' line and of the last allocation in microseconds
+    int64_t preciseTime = 0;
+    int64_t lastAllocationTime = 0;
+
+    // the pages used by heaptrack itself, as reported by the last 'O' line, which is only written when it changes
+    int64_t heaptrackOverhead = 0;
+    hasPreciseTimeStamps = false;
+    hasUsableSizes = false;
+    temporaryLifetimes.clear();
+    auto addTemporaryLifetime = [&](int64_t lifetime, int64_t weight) {
+        size_t bucket = 0;
+        while (lifetime >> bucket) {
+            ++bucket;
+        }
+        if (bucket >= temporaryLifetimes.size()) {
+            temporaryLifetimes.resize(bucket + 1);
+        }
+        temporaryLifetimes[bucket] += weight;
+    };
+
+    auto updatePeak = [&](int64_t time) {
+        if (totalCost.leaked > totalCost.peak) {
+            totalCost.peak = totalCost.leaked;
+            peakTime = time;
+
+            if (pass == SecondPass && totalCost.peak == lastPeakCost && peakTime == lastPeakTime) {
+                for (auto& allocation : allocations) {
+                    allocation.peak = allocation.leaked;
+                }
+            }
+        }
+    };
+
     const auto uncompressedCount = in.component<byte_counter>(0);
     const auto compressedCount = in.component<byte_counter>(in.size() - 2);
 
@@ -304,7 +364,8 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
                 index.index = instructionPointers.size();
                 opNewIpIndices.push_back(index);
             }
-        } else if (reader.mode() == '+') {
+        } else if (reader.mode() == '+' || reader.mode() == 'T') {
+            // 'T' is a temporary allocation, i.e. a '+' that is directly followed by its '-'
             if (!inFilteredTime) {
                 continue;
             }
@@ -328,8 +389,10 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
                     cerr << "failed to parse line: " << reader.line() << ' ' << __LINE__ << endl;
                     continue;
                 }
+                info.usableSize = info.size;
                 info.allocationIndex = mapToAllocationIndex(traceIndex);
-                if (allocationInfoSet.add(info.size, traceIndex, &allocationIndex)) {
+                applySampleWeight(&info);
+                if (allocationInfoSet.add(info.size, info.usableSize, traceIndex, &allocationIndex)) {
                     allocationInfos.push_back(info);
                 }
                 pointers.addPointer(ptr, allocationIndex);
@@ -338,22 +401,31 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
 
             if (pass != FirstPass) {
                 auto& allocation = allocations[info.allocationIndex.index];
-                allocation.leaked += info.size;
-                ++allocation.allocations;
+                allocation.leaked += info.weightedSize;
+                allocation.allocations += info.weight;
+                allocation.slack += info.weightedSlack;
 
                 handleAllocation(info, allocationIndex);
             }
 
-            ++totalCost.allocations;
-            totalCost.leaked += info.size;
-            if (totalCost.leaked > totalCost.peak) {
-                totalCost.peak = totalCost.leaked;
-                peakTime = timeStamp;
-
-                if (pass == SecondPass && totalCost.peak == lastPeakCost && peakTime == lastPeakTime) {
-                    for (auto& allocation : allocations) {
-                        allocation.peak = allocation.leaked;
-                    }
+            totalCost.allocations += info.weight;
+            totalCost.leaked += info.weightedSize;
+            totalCost.slack += info.weightedSlack;
+            updatePeak(timeStamp);
+            lastAllocationTime = preciseTime;
+
+            if (reader.mode() == 'T') {
+                lastAllocationPtr = 0;
+                totalCost.leaked -= info.weightedSize;
+                totalCost.temporary += info.weight;
+                if (hasPreciseTimeStamps) {
+                    // only coalesced when no time passed in between
+                    addTemporaryLifetime(0, info.weight);
+                }
+                if (pass != FirstPass) {
+                    auto& allocation = allocations[info.allocationIndex.index];
+                    allocation.leaked -= info.weightedSize;
+                    allocation.temporary += info.weight;
                 }
             }
         } else if (reader.mode() == '-') {
@@ -385,18 +457,71 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
             lastAllocationPtr = 0;
 
             const auto& info = allocationInfos[allocationInfoIndex.index];
-            totalCost.leaked -= info.size;
+            totalCost.leaked -= info.weightedSize;
             if (temporary) {
-                ++totalCost.temporary;
+                totalCost.temporary += info.weight;
+                if (hasPreciseTimeStamps) {
+                    addTemporaryLifetime(preciseTime - lastAllocationTime, info.weight);
+                }
             }
 
             if (pass != FirstPass) {
                 auto& allocation = allocations[info.allocationIndex.index];
-                allocation.leaked -= info.size;
+                allocation.leaked -= info.weightedSize;
                 if (temporary) {
-                    ++allocation.temporary;
+                    allocation.temporary += info.weight;
                 }
             }
+        } else if (reader.mode() == 'N') {
+            TraceIndex traceIndex;
+            AllocationData cost;
+            if (!(reader >> traceIndex) || !(reader >> cost.allocations) || !(reader >> cost.temporary)
+                || !(reader >> cost.leaked)) {
+                cerr << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            if (traceIndex.index >= lastSnapshot.size()) {
+                lastSnapshot.resize(traceIndex.index + 1);
+            }
+            auto& last = lastSnapshot[traceIndex.index];
+            const auto allocationsDiff = cost.allocations - last.allocations;
+            const auto temporaryDiff = cost.temporary - last.temporary;
+            const auto leakedDiff = cost.leaked - last.leaked;
+            last = cost;
+            if (!inFilteredTime) {
+                continue;
+            }
+
+            const auto allocationIndex = mapToAllocationIndex(traceIndex);
+            if (pass != FirstPass) {
+                auto& allocation = allocations[allocationIndex.index];
+                allocation.allocations += allocationsDiff;
+                allocation.temporary += temporaryDiff;
+                allocation.leaked += leakedDiff;
+            }
+            totalCost.allocations += allocationsDiff;
+            totalCost.temporary += temporaryDiff;
+            totalCost.leaked += leakedDiff;
+            // the peak can only be found once the whole snapshot got applied
+            snapshotChanged = true;
+        } else if (reader.mode() == 'n') {
+            // an allocation of an earlier segment of a rotated output got freed, which the 'N' lines
+            // of that segment counted as leaked
+            TraceIndex traceIndex;
+            int64_t bytes = 0;
+            if (!(reader >> traceIndex) || !(reader >> bytes)) {
+                cerr << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            if (!inFilteredTime) {
+                continue;
+            }
+
+            if (pass != FirstPass) {
+                allocations[mapToAllocationIndex(traceIndex).index].leaked -= bytes;
+            }
+            totalCost.leaked -= bytes;
+            snapshotChanged = true;
         } else if (reader.mode() == 'a') {
             if (pass != FirstPass || isReparsing) {
                 continue;
@@ -407,7 +532,11 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
                 cerr << "failed to parse line: " << reader.line() << endl;
                 continue;
             }
+            // only written when it differs from the requested size, see HEAPTRACK_USABLE_SIZE
+            info.usableSize = info.size;
+            reader >> info.usableSize;
             info.allocationIndex = mapToAllocationIndex(traceIndex);
+            applySampleWeight(&info);
             allocationInfos.push_back(info);
 
         } else if (reader.mode() == '#') {
@@ -419,20 +548,39 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
                 cerr << "Failed to read time stamp: " << reader.line() << endl;
                 continue;
             }
+            if (snapshotChanged) {
+                updatePeak(newStamp);
+                snapshotChanged = false;
+            }
             inFilteredTime = newStamp >= filterParameters.minTime && newStamp <= filterParameters.maxTime;
             if (inFilteredTime) {
                 handleTimeStamp(timeStamp, newStamp, false, pass);
             }
             timeStamp = newStamp;
+        } else if (reader.mode() == 'C') {
+            int64_t delta = 0;
+            if (!(reader >> delta)) {
+                cerr << "Failed to read precise time stamp: " << reader.line() << endl;
+                continue;
+            }
+            preciseTime += delta;
+            hasPreciseTimeStamps = true;
         } else if (reader.mode() == 'R') { // RSS timestamp
             if (!inFilteredTime) {
                 continue;
             }
             int64_t rss = 0;
             reader >> rss;
+            rss = std::max(rss - heaptrackOverhead, int64_t(0));
+            peakHeaptrackOverhead = std::max(peakHeaptrackOverhead, heaptrackOverhead);
             if (rss > peakRSS) {
                 peakRSS = rss;
             }
+        } else if (reader.mode() == 'O') { // heaptrack overhead
+            if (!(reader >> heaptrackOverhead)) {
+                cerr << "Failed to read heaptrack overhead: " << reader.line() << endl;
+                continue;
+            }
         } else if (reader.mode() == 'X') {
             if (debuggeeEncountered) {
                 cerr << "Duplicated debuggee entry - corrupt data file?" << endl;
@@ -471,6 +619,10 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
         } else if (reader.mode() == 'I') { // system information
             reader >> systemInfo.pageSize;
             reader >> systemInfo.pages;
+        } else if (reader.mode() == 'P') { // sampling parameters
+            reader >> sampleInterval;
+        } else if (reader.mode() == 'U') { // usable sizes got recorded
+            hasUsableSizes = true;
         } else if (reader.mode() == 'S') { // embedded suppression
             if (pass != FirstPass || filterParameters.disableEmbeddedSuppressions) {
                 continue;
@@ -488,6 +640,10 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
         }
     }
 
+    if (snapshotChanged) {
+        updatePeak(timeStamp);
+    }
+
     if (pass == FirstPass && !isReparsing) {
         totalTime = timeStamp + 1;
         filterParameters.maxTime = totalTime;
@@ -498,6 +654,24 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
     return true;
 }
 
+void AccumulatedTraceData::applySampleWeight(AllocationInfo* info) const
+{
+    const auto slack = info->usableSize > info->size ? static_cast<int64_t>(info->usableSize - info->size) : 0;
+    if (!sampleInterval || !info->size) {
+        info->weight = 1;
+        info->weightedSize = static_cast<int64_t>(info->size);
+        info->weightedSlack = slack;
+        return;
+    }
+
+    // an allocation of the given size gets sampled with probability 1 - exp(-size / interval)
+    const auto size = static_cast<double>(info->size);
+    const auto weight = 1. / -expm1(-size / static_cast<double>(sampleInterval));
+    info->weight = max(int64_t(1), static_cast<int64_t>(llround(weight)));
+    info->weightedSize = static_cast<int64_t>(llround(size * weight));
+    info->weightedSlack = slack * info->weight;
+}
+
 namespace { // helpers for diffing
 
 template <typename IndexT, typename SortF>
@@ -642,6 +816,7 @@ void AccumulatedTraceData::diff(const AccumulatedTraceData& base)
     totalCost -= base.totalCost;
     totalTime -= base.totalTime;
     peakRSS -= base.peakRSS;
+    peakHeaptrackOverhead -= base.peakHeaptrackOverhead;
     systemInfo.pages -= base.systemInfo.pages;
     systemInfo.pageSize -= base.systemInfo.pageSize;
 
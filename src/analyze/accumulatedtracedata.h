@@ -72,11 +72,18 @@ struct Allocation : public AllocationData
 struct AllocationInfo
 {
     uint64_t size = 0;
+    // the size that is usable according to the allocator, when recorded with HEAPTRACK_USABLE_SIZE
+    uint64_t usableSize = 0;
     // index into AccumulatedTraceData::allocations
     AllocationIndex allocationIndex;
+    // when the data was sampled, a single recorded allocation stands for
+    // this many allocations with a total of weightedSize bytes
+    int64_t weight = 1;
+    int64_t weightedSize = 0;
+    int64_t weightedSlack = 0;
     bool operator==(const AllocationInfo& rhs) const
     {
-        return rhs.allocationIndex == allocationIndex && rhs.size == size;
+        return rhs.allocationIndex == allocationIndex && rhs.size == size && rhs.usableSize == usableSize;
     }
 };
 
@@ -119,7 +126,10 @@ struct AccumulatedTraceData
     AllocationData totalCost;
     int64_t totalTime = 0;
     int64_t peakTime = 0;
+    /// in pages, excluding the overhead of heaptrack itself when the data contains it
     int64_t peakRSS = 0;
+    /// the peak number of pages used by heaptrack's own data structures, zero when unknown
+    int64_t peakHeaptrackOverhead = 0;
 
     struct SystemInfo
     {
@@ -128,6 +138,20 @@ struct AccumulatedTraceData
     };
     SystemInfo systemInfo;
 
+    /// mean distance between sampled allocations in bytes, zero when every allocation was recorded
+    uint64_t sampleInterval = 0;
+
+    /// true when the data was recorded with HEAPTRACK_PRECISE_TIMESTAMPS
+    bool hasPreciseTimeStamps = false;
+    /// true when the data was recorded with HEAPTRACK_USABLE_SIZE, i.e. the slack is known
+    bool hasUsableSizes = false;
+    /// the number of temporary allocations by their lifetime, which is below 2^i microseconds
+    /// for the i-th entry. only available with precise time stamps.
+    std::vector<int64_t> temporaryLifetimes;
+
+    /// apply the sampling weight to @p info, based on its size
+    void applySampleWeight(AllocationInfo* info) const;
+
     // our indices are sequentially increasing thus a new allocation can only ever
     // occur with an index larger than any other we encountered so far
     // this can be used to our advantage in speeding up the mapToAllocationIndex calls.
@@ -19,6 +19,8 @@ struct AllocationData
     int64_t leaked = 0;
     // largest amount of bytes allocated
     int64_t peak = 0;
+    // amount of bytes the allocator reserved beyond the requested sizes, summed over all allocations
+    int64_t slack = 0;
 
     void clearCost()
     {
@@ -29,7 +31,7 @@ struct AllocationData
 inline bool operator==(const AllocationData& lhs, const AllocationData& rhs)
 {
     return lhs.allocations == rhs.allocations && lhs.temporary == rhs.temporary && lhs.leaked == rhs.leaked
-        && lhs.peak == rhs.peak;
+        && lhs.peak == rhs.peak && lhs.slack == rhs.slack;
 }
 
 inline bool operator!=(const AllocationData& lhs, const AllocationData& rhs)
@@ -43,6 +45,7 @@ inline AllocationData& operator+=(AllocationData& lhs, const AllocationData& rhs
     lhs.temporary += rhs.temporary;
     lhs.peak += rhs.peak;
     lhs.leaked += rhs.leaked;
+    lhs.slack += rhs.slack;
     return lhs;
 }
 
@@ -52,6 +55,7 @@ inline AllocationData& operator-=(AllocationData& lhs, const AllocationData& rhs
     lhs.temporary -= rhs.temporary;
     lhs.peak -= rhs.peak;
     lhs.leaked -= rhs.leaked;
+    lhs.slack -= rhs.slack;
     return lhs;
 }
 
@@ -427,10 +427,18 @@ MainWindow::MainWindow(QWidget* parent)
             stream << "<qt><dl>"
                    << i18n("<dt><b>peak heap memory consumption</b>:</dt><dd>%1 "
                            "after %2</dd>",
-                           Util::formatBytes(data.cost.peak), Util::formatTime(data.peakTime))
-                   << i18n("<dt><b>peak RSS</b> (including heaptrack "
-                           "overhead):</dt><dd>%1</dd>",
-                           Util::formatBytes(data.peakRSS));
+                           Util::formatBytes(data.cost.peak), Util::formatTime(data.peakTime));
+            if (data.peakHeaptrackOverhead) {
+                stream << i18n("<dt><b>peak RSS</b> (excluding heaptrack "
+                               "overhead):</dt><dd>%1</dd>",
+                               Util::formatBytes(data.peakRSS))
+                       << i18n("<dt><b>peak heaptrack overhead</b>:</dt><dd>%1</dd>",
+                               Util::formatBytes(data.peakHeaptrackOverhead));
+            } else {
+                stream << i18n("<dt><b>peak RSS</b> (including heaptrack "
+                               "overhead):</dt><dd>%1</dd>",
+                               Util::formatBytes(data.peakRSS));
+            }
             if (isFiltered) {
                 stream << i18n("<dt><b>memory consumption delta</b>:</dt><dd>%1</dd>",
                                Util::formatBytes(data.cost.leaked));
@@ -443,6 +451,10 @@ MainWindow::MainWindow(QWidget* parent)
                                    Util::formatBytes(data.cost.leaked));
                 }
             }
+            if (data.cost.slack) {
+                stream << i18n("<dt><b>total allocator slack</b>:</dt><dd>%1</dd>",
+                               Util::formatBytes(data.cost.slack));
+            }
             stream << "</dl></qt>";
         }
 
@@ -228,9 +228,9 @@ struct ParserData final : public AccumulatedTraceData
         maxConsumedSinceLastTimeStamp = max(maxConsumedSinceLastTimeStamp, totalCost.leaked);
 
         if (index.index == allocationInfoCounter.size()) {
-            allocationInfoCounter.push_back({info, 1});
+            allocationInfoCounter.push_back({info, info.weight});
         } else {
-            ++allocationInfoCounter[index.index].allocations;
+            allocationInfoCounter[index.index].allocations += info.weight;
         }
     }
 
@@ -704,6 +704,7 @@ void Parser::parseImpl(const QString& path, const QString& diffBase, const Filte
 
         emit summaryAvailable({QString::fromStdString(data->debuggee), data->totalCost, data->totalTime,
                                data->filterParameters, data->peakTime, data->peakRSS * data->systemInfo.pageSize,
+                               data->peakHeaptrackOverhead * data->systemInfo.pageSize,
                                data->systemInfo.pages * data->systemInfo.pageSize, data->fromAttached,
                                data->totalLeakedSuppressed, toQt(data->suppressions)});
 
@@ -19,8 +19,9 @@ struct SummaryData
 {
     SummaryData() = default;
     SummaryData(const QString& debuggee, const AllocationData& cost, int64_t totalTime,
-                const FilterParameters& filterParameters, int64_t peakTime, int64_t peakRSS, int64_t totalSystemMemory,
-                bool fromAttached, int64_t totalLeakedSuppressed, QVector<Suppression> suppressions)
+                const FilterParameters& filterParameters, int64_t peakTime, int64_t peakRSS,
+                int64_t peakHeaptrackOverhead, int64_t totalSystemMemory, bool fromAttached,
+                int64_t totalLeakedSuppressed, QVector<Suppression> suppressions)
         : debuggee(debuggee)
         , cost(cost)
         , totalLeakedSuppressed(totalLeakedSuppressed)
@@ -28,6 +29,7 @@ struct SummaryData
         , filterParameters(filterParameters)
         , peakTime(peakTime)
         , peakRSS(peakRSS)
+        , peakHeaptrackOverhead(peakHeaptrackOverhead)
         , totalSystemMemory(totalSystemMemory)
         , fromAttached(fromAttached)
         , suppressions(std::move(suppressions))
@@ -40,6 +42,7 @@ struct SummaryData
     FilterParameters filterParameters;
     int64_t peakTime = 0;
     int64_t peakRSS = 0;
+    int64_t peakHeaptrackOverhead = 0;
     int64_t totalSystemMemory = 0;
     bool fromAttached = false;
     QVector<Suppression> suppressions;
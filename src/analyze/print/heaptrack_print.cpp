@@ -98,7 +98,8 @@ enum CostType
     Allocations,
     Temporary,
     Leaked,
-    Peak
+    Peak,
+    Slack
 };
 
 std::istream& operator>>(std::istream& in, CostType& type)
@@ -113,6 +114,8 @@ std::istream& operator>>(std::istream& in, CostType& type)
         type = Leaked;
     else if (token == "peak")
         type = Peak;
+    else if (token == "slack")
+        type = Slack;
     else
         in.setstate(std::ios_base::failbit);
     return in;
@@ -168,6 +171,7 @@ struct Printer final : public AccumulatedTraceData
                 merged.leaked += allocation.leaked;
                 merged.peak += allocation.peak;
                 merged.temporary += allocation.temporary;
+                merged.slack += allocation.slack;
             }
         }
         return ret;
@@ -512,7 +516,7 @@ struct Printer final : public AccumulatedTraceData
     void handleAllocation(const AllocationInfo& info, const AllocationInfoIndex /*index*/) override
     {
         if (printHistogram) {
-            ++sizeHistogram[info.size];
+            sizeHistogram[info.size] += info.weight;
         }
 
         if (totalCost.leaked > 0 && static_cast<size_t>(totalCost.leaked) > lastMassifPeak && massifOut.is_open()) {
@@ -611,6 +615,9 @@ int main(int argc, char** argv)
             "Print backtraces to top allocators, sorted by number of temporary allocations.")
         ("print-leaks,l", po::value<bool>()->default_value(false)->implicit_value(true),
             "Print backtraces to leaked memory allocations.")
+        ("print-slack,S", po::value<bool>()->default_value(true)->implicit_value(true),
+            "Print backtraces to top allocators, sorted by the bytes the allocator reserved beyond the requested "
+            "sizes. Only available when the data was recorded with heaptrack --usable-size.")
         ("peak-limit,n", po::value<size_t>()->default_value(10)->implicit_value(10),
             "Limit the number of reported peaks.")
         ("sub-peak-limit,s", po::value<size_t>()->default_value(5)->implicit_value(5),
@@ -622,7 +629,8 @@ int main(int argc, char** argv)
             "  - allocations: number of allocations\n"
             "  - temporary: number of temporary allocations\n"
             "  - leaked: bytes not deallocated at the end\n"
-            "  - peak: bytes consumed at highest total memory consumption")
+            "  - peak: bytes consumed at highest total memory consumption\n"
+            "  - slack: bytes reserved by the allocator beyond the requested sizes")
         ("print-flamegraph,F", po::value<string>()->default_value(string()),
             "Path to output file where a flame-graph compatible stack file will be written to.\n"
             "To visualize the resulting file, use flamegraph.pl from "
@@ -717,6 +725,7 @@ int main(int argc, char** argv)
     const bool printPeaks = vm["print-peaks"].as<bool>();
     const bool printAllocs = vm["print-allocators"].as<bool>();
     const bool printTemporary = vm["print-temporary"].as<bool>();
+    const bool printSlack = vm["print-slack"].as<bool>();
     const auto printSuppressions = vm["print-suppressions"].as<bool>();
     const auto suppressionsFile = vm["suppressions"].as<string>();
 
@@ -806,15 +815,50 @@ int main(int argc, char** argv)
         cout << endl;
     }
 
+    if (printSlack && data.hasUsableSizes) {
+        // sort by the memory wasted to the rounding of the allocator
+        cout << "MOST ALLOCATOR SLACK\n";
+        data.printAllocations(
+            &AllocationData::slack,
+            [](const AllocationData& data) {
+                cout << formatBytes(data.slack) << " reserved beyond the requested sizes over " << data.allocations
+                     << " calls from\n";
+            },
+            [](const AllocationData& data) {
+                cout << formatBytes(data.slack) << " reserved beyond the requested sizes over " << data.allocations
+                     << " calls from:\n";
+            });
+        cout << endl;
+    }
+
     const double totalTimeS = data.totalTime ? (1000. / data.totalTime) : 1.;
     cout << "total runtime: " << fixed << (data.totalTime / 1000.) << "s.\n"
          << "calls to allocation functions: " << data.totalCost.allocations << " ("
          << int64_t(data.totalCost.allocations * totalTimeS) << "/s)\n"
          << "temporary memory allocations: " << data.totalCost.temporary << " ("
          << int64_t(data.totalCost.temporary * totalTimeS) << "/s)\n"
-         << "peak heap memory consumption: " << formatBytes(data.totalCost.peak) << '\n'
-         << "peak RSS (including heaptrack overhead): " << formatBytes(data.peakRSS * data.systemInfo.pageSize) << '\n'
-         << "total memory leaked: " << formatBytes(data.totalCost.leaked) << '\n';
+         << "peak heap memory consumption: " << formatBytes(data.totalCost.peak) << '\n';
+    if (data.peakHeaptrackOverhead) {
+        cout << "peak RSS (excluding heaptrack overhead): " << formatBytes(data.peakRSS * data.systemInfo.pageSize)
+             << '\n'
+             << "peak heaptrack overhead: " << formatBytes(data.peakHeaptrackOverhead * data.systemInfo.pageSize)
+             << '\n';
+    } else {
+        cout << "peak RSS (including heaptrack overhead): " << formatBytes(data.peakRSS * data.systemInfo.pageSize)
+             << '\n';
+    }
+    cout << "total memory leaked: " << formatBytes(data.totalCost.leaked) << '\n';
+    if (data.hasUsableSizes) {
+        cout << "total allocator slack: " << formatBytes(data.totalCost.slack) << '\n';
+    }
+    if (data.hasPreciseTimeStamps && data.totalCost.temporary) {
+        cout << "lifetime of temporary allocations:\n";
+        for (size_t i = 0; i < data.temporaryLifetimes.size(); ++i) {
+            if (data.temporaryLifetimes[i]) {
+                cout << "  < " << setw(10) << (uint64_t(1) << i) << "us: " << data.temporaryLifetimes[i] << '\n';
+            }
+        }
+    }
     if (data.totalLeakedSuppressed) {
         cout << "suppressed leaks: " << formatBytes(data.totalLeakedSuppressed) << '\n';
 
@@ -868,6 +912,9 @@ int main(int argc, char** argv)
                 case Leaked:
                     flamegraph << allocation.leaked;
                     break;
+                case Slack:
+                    flamegraph << allocation.slack;
+                    break;
                 }
                 flamegraph << '\n';
             }
@@ -11,9 +11,11 @@
  */
 
 #include <algorithm>
+#include <cctype>
 #include <cinttypes>
 #include <filesystem>
 #include <iostream>
+#include <limits>
 #include <sstream>
 #ifdef __linux__
 #include <stdio_ext.h>
@@ -29,6 +31,9 @@
 #include "util/linereader.h"
 #include "util/linewriter.h"
 #include "util/pointermap.h"
+#if ZSTD_FOUND
+#include "util/zstdstream.h"
+#endif
 
 #include <boost/program_options.hpp>
 
@@ -168,6 +173,27 @@ struct ModuleFragment
     size_t moduleIndex;
 };
 
+/// identifies the file of a module at the time of recording
+struct ModuleIdentity
+{
+    string buildId;
+    uint64_t fileSize = 0;
+    uint64_t fileModificationTime = 0;
+
+    /**
+     * @return true when @p fileName still looks like the file that got recorded, or nothing is known about it
+     */
+    bool matches(const string& fileName) const
+    {
+        if (!fileSize && !fileModificationTime) {
+            return true;
+        }
+        struct stat fileInfo;
+        return stat(fileName.c_str(), &fileInfo) == 0 && static_cast<uint64_t>(fileInfo.st_size) == fileSize
+            && static_cast<uint64_t>(fileInfo.st_mtime) == fileModificationTime;
+    }
+};
+
 struct Module
 {
     Module(string fileName, uintptr_t addressStart, Dwfl_Module* module, SymbolCache* symbolCache)
@@ -360,11 +386,7 @@ struct AccumulatedTraceData
             }
 #endif
 
-            // reset dwfl state
-            m_modules.clear();
-
-            dwfl_report_begin(m_dwfl);
-            dwfl_report_end(m_dwfl, nullptr, nullptr);
+            pruneModules();
 
             m_modulesDirty = false;
         }
@@ -420,10 +442,27 @@ struct AccumulatedTraceData
         m_modulesDirty = true;
     }
 
+    void setModuleIdentity(const uintptr_t addressStart, ModuleIdentity identity)
+    {
+        m_moduleIdentities[addressStart] = std::move(identity);
+    }
+
+    void removeModule(const uintptr_t addressStart)
+    {
+        m_moduleIdentities.erase(addressStart);
+        m_moduleFragments.erase(remove_if(m_moduleFragments.begin(), m_moduleFragments.end(),
+                                          [addressStart](const ModuleFragment& fragment) {
+                                              return fragment.addressStart == addressStart;
+                                          }),
+                                m_moduleFragments.end());
+        m_modulesDirty = true;
+    }
+
     void clearModules()
     {
-        // TODO: optimize this, reuse modules that are still valid
+        // modules that get added again keep their state, see pruneModules
         m_moduleFragments.clear();
+        m_moduleIdentities.clear();
         m_modulesDirty = true;
     }
 
@@ -457,6 +496,56 @@ struct AccumulatedTraceData
     LineWriter out;
 
 private:
+    /**
+     * Drop the state of the modules that are not loaded anymore. The DWARF and symbol
+     * data of all other modules is kept, such that dlopen and dlclose calls don't force
+     * us to resolve everything again.
+     *
+     * Requires the module fragments to be sorted.
+     */
+    void pruneModules()
+    {
+        bool pruned = false;
+        for (auto it = m_modules.begin(); it != m_modules.end();) {
+            const auto& module = it->second;
+            auto fragment = lower_bound(m_moduleFragments.begin(), m_moduleFragments.end(), module.addressStart,
+                                        [](const ModuleFragment& fragment, const uintptr_t addressStart) -> bool {
+                                            return fragment.addressStart < addressStart;
+                                        });
+            bool loaded = false;
+            for (; fragment != m_moduleFragments.end() && fragment->addressStart == module.addressStart; ++fragment) {
+                if (fragment->fileName == module.fileName) {
+                    loaded = true;
+                    break;
+                }
+            }
+            if (loaded) {
+                ++it;
+            } else {
+                it = m_modules.erase(it);
+                pruned = true;
+            }
+        }
+
+        if (!pruned) {
+            return;
+        }
+
+        // dwfl keeps the modules that get reported again with the same name and address range
+        dwfl_report_begin(m_dwfl);
+        for (const auto& entry : m_modules) {
+            if (!entry.second.module) {
+                continue;
+            }
+            Dwarf_Addr start = 0;
+            Dwarf_Addr end = 0;
+            const auto* name =
+                dwfl_module_info(entry.second.module, nullptr, &start, &end, nullptr, nullptr, nullptr, nullptr);
+            dwfl_report_module(m_dwfl, name, start, end);
+        }
+        dwfl_report_end(m_dwfl, nullptr, nullptr);
+    }
+
     Module* reportModule(const ModuleFragment& module)
     {
         if (startsWith(module.fileName, "linux-vdso.so")) {
@@ -468,6 +557,9 @@ private:
             return &ret;
 
         auto dwflModule = dwfl_addrmodule(m_dwfl, module.addressStart);
+        if (!dwflModule) {
+            dwflModule = reportModuleByBuildId(module);
+        }
         if (!dwflModule) {
             dwfl_report_begin_add(m_dwfl);
             dwflModule = dwfl_report_elf(m_dwfl, module.fileName.c_str(), module.fileName.c_str(), -1,
@@ -485,6 +577,55 @@ private:
         return &ret;
     }
 
+    /**
+     * When the file of @p module changed since it got recorded, report it by its build-id instead.
+     * The ELF file is then looked up in the .build-id directories of the debug paths, which allows
+     * to interpret the data with an archive of the binaries, e.g. on another machine.
+     */
+    Dwfl_Module* reportModuleByBuildId(const ModuleFragment& module)
+    {
+        auto identity = m_moduleIdentities.find(module.addressStart);
+        if (identity == m_moduleIdentities.end() || identity->second.matches(module.fileName)) {
+            return nullptr;
+        }
+
+        const auto& buildId = identity->second.buildId;
+        const auto isHex = [](char c) { return isxdigit(static_cast<unsigned char>(c)) != 0; };
+        if (buildId.empty()) {
+            error_out << "File changed since recording and has no build-id, symbols may be wrong: " << module.fileName
+                      << endl;
+            return nullptr;
+        } else if (buildId.size() % 2 || !all_of(buildId.begin(), buildId.end(), isHex)) {
+            error_out << "File changed since recording and has a malformed build-id " << buildId
+                      << ", symbols may be wrong: " << module.fileName << endl;
+            return nullptr;
+        }
+        vector<unsigned char> bits(buildId.size() / 2);
+        for (size_t i = 0; i < bits.size(); ++i) {
+            bits[i] = static_cast<unsigned char>(stoul(buildId.substr(2 * i, 2), nullptr, 16));
+        }
+
+        // the address range covered by all fragments of the module, starting at the page of the first one
+        auto start = numeric_limits<uintptr_t>::max();
+        uintptr_t end = 0;
+        for (const auto& fragment : m_moduleFragments) {
+            if (fragment.addressStart == module.addressStart) {
+                start = min(start, fragment.fragmentStart);
+                end = max(end, fragment.fragmentEnd);
+            }
+        }
+        start &= ~uintptr_t(0xfff);
+
+        dwfl_report_begin_add(m_dwfl);
+        auto* dwflModule = dwfl_report_module(m_dwfl, module.fileName.c_str(), start, end);
+        if (dwflModule && dwfl_module_report_build_id(dwflModule, bits.data(), bits.size(), 0) != 0) {
+            error_out << "Failed to report build-id for " << module.fileName << ": " << dwfl_errmsg(dwfl_errno())
+                      << endl;
+        }
+        dwfl_report_end(m_dwfl, nullptr, nullptr);
+        return dwflModule;
+    }
+
     void initializePaths()
     {
         std::string path;
@@ -515,6 +656,7 @@ private:
     tsl::robin_map<string, size_t> m_internedData;
     tsl::robin_map<uintptr_t, size_t> m_encounteredIps;
     tsl::robin_map<string, Module> m_modules;
+    tsl::robin_map<uintptr_t, ModuleIdentity> m_moduleIdentities;
     tsl::robin_map<string, string> m_resolvedFiles;
 };
 
@@ -625,6 +767,16 @@ int main(int argc, char** argv)
 
     AccumulatedTraceData data(sysroot, debugPaths, extraPaths);
 
+    // the raw data may have been compressed in-process already, see HEAPTRACK_ZSTD_LEVEL
+    istream* input = &cin;
+#if ZSTD_FOUND
+    ZstdInputBuffer zstdBuffer(cin.rdbuf());
+    istream zstdInput(&zstdBuffer);
+    if (cin.peek() == ZstdInputBuffer::MAGIC_FIRST_BYTE) {
+        input = &zstdInput;
+    }
+#endif
+
     LineReader reader;
 
     string exe;
@@ -633,16 +785,60 @@ int main(int argc, char** argv)
     uint64_t lastPtr = 0;
     AllocationInfoSet allocationInfos;
 
-    while (reader.getLine(cin)) {
+    unsigned int fileVersion = 0;
+
+    // the segments of a rotated output can be concatenated, each starts with its own header and
+    // numbers its backtraces from scratch, so we continue the numbering of the previous segments
+    bool hasVersion = false;
+    bool isLaterSegment = false;
+    uint64_t numTraces = 0;
+    uint64_t traceOffset = 0;
+    auto offsetTrace = [&traceOffset](uint64_t traceIndex) { return traceIndex ? traceIndex + traceOffset : 0; };
+    // the trace offset of each segment, to resolve the deallocations of earlier segments when aggregating
+    std::vector<uint64_t> segmentTraceOffsets;
+
+    // the usable size is only written when it differs from the requested size, see HEAPTRACK_USABLE_SIZE
+    auto writeAllocationInfo = [&data](uint64_t size, uint64_t usableSize, TraceIndex traceId) {
+        if (usableSize > size) {
+            data.out.writeHexLine('a', size, traceId.index, usableSize);
+        } else {
+            data.out.writeHexLine('a', size, traceId.index);
+        }
+    };
+
+    while (reader.getLine(*input)) {
         if (reader.mode() == 'v') {
             unsigned int heaptrackVersion = 0;
             reader >> heaptrackVersion;
-            unsigned int fileVersion = 0;
             reader >> fileVersion;
             if (fileVersion >= 3) {
                 reader.setExpectedSizedStrings(true);
             }
+            if (fileVersion >= 4) {
+                reader.setBinaryRecords(true);
+            }
+            if (hasVersion) {
+                // the segment writes all of its modules again
+                isLaterSegment = true;
+                traceOffset = numTraces;
+                segmentTraceOffsets.push_back(traceOffset);
+                reader.resetBinaryRecords();
+                data.clearModules();
+                continue;
+            }
+            hasVersion = true;
+            segmentTraceOffsets.push_back(0);
             data.out.write("%s\n", reader.line().c_str());
+        } else if (reader.mode() == 'U') {
+            // the allocations carry their usable size, which changes the binary records
+            reader.setUsableSizes(true);
+            if (!isLaterSegment) {
+                // tells the analyzers that the slack is known, even when it is zero
+                data.out.write("%s\n", reader.line().c_str());
+            }
+        } else if (isLaterSegment && reader.mode() && strchr("xXIASP", reader.mode())) {
+            // the header lines of later segments repeat those of the first one
+            continue;
         } else if (reader.mode() == 'x') {
             if (!exe.empty()) {
                 error_out << "received duplicate exe event - child process tracking is not yet supported" << endl;
@@ -653,7 +849,13 @@ int main(int argc, char** argv)
             string fileName;
             reader >> fileName;
             if (fileName == "-") {
-                data.clearModules();
+                uintptr_t addressStart = 0;
+                if (reader >> addressStart) {
+                    data.removeModule(addressStart);
+                } else {
+                    // written by older versions of heaptrack, which write all modules again afterwards
+                    data.clearModules();
+                }
             } else {
                 if (fileName == "x") {
                     fileName = exe;
@@ -665,6 +867,18 @@ int main(int argc, char** argv)
                     error_out << "failed to parse line: " << reader.line() << endl;
                     return 1;
                 }
+                if (fileVersion >= 5) {
+                    ModuleIdentity identity;
+                    if (!(reader >> identity.buildId) || !(reader >> identity.fileSize)
+                        || !(reader >> identity.fileModificationTime)) {
+                        error_out << "failed to parse line: " << reader.line() << endl;
+                        return 1;
+                    }
+                    if (identity.buildId == "-") {
+                        identity.buildId.clear();
+                    }
+                    data.setModuleIdentity(addressStart, std::move(identity));
+                }
                 uintptr_t vAddr = 0;
                 uintptr_t memSize = 0;
                 const auto& resolvedFileName = data.resolveFile(fileName);
@@ -683,7 +897,8 @@ int main(int argc, char** argv)
             // ensure ip is encountered
             const auto ipId = data.addIp(instructionPointer);
             // trace point, map current output index to parent index
-            data.out.writeHexLine('t', ipId, parentIndex);
+            data.out.writeHexLine('t', ipId, offsetTrace(parentIndex));
+            ++numTraces;
         } else if (reader.mode() == '+') {
             ++c_stats.allocations;
             ++c_stats.leakedAllocations;
@@ -694,10 +909,13 @@ int main(int argc, char** argv)
                 error_out << "failed to parse line: " << reader.line() << endl;
                 continue;
             }
+            uint64_t usableSize = size;
+            reader >> usableSize;
+            traceId.index = offsetTrace(traceId.index);
 
             AllocationInfoIndex index;
-            if (allocationInfos.add(size, traceId, &index)) {
-                data.out.writeHexLine('a', size, traceId.index);
+            if (allocationInfos.add(size, usableSize, traceId, &index)) {
+                writeAllocationInfo(size, usableSize, traceId);
             }
             ptrToIndex.addPointer(ptr, index);
             lastPtr = ptr;
@@ -719,6 +937,58 @@ int main(int argc, char** argv)
                 ++c_stats.temporaryAllocations;
             }
             --c_stats.leakedAllocations;
+        } else if (reader.mode() == 'T') {
+            // an allocation that got deallocated directly afterwards, we never see its pointer
+            ++c_stats.allocations;
+            ++c_stats.temporaryAllocations;
+            uint64_t size = 0;
+            TraceIndex traceId;
+            if (!(reader >> size) || !(reader >> traceId.index)) {
+                error_out << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            uint64_t usableSize = size;
+            reader >> usableSize;
+            traceId.index = offsetTrace(traceId.index);
+
+            AllocationInfoIndex index;
+            if (allocationInfos.add(size, usableSize, traceId, &index)) {
+                writeAllocationInfo(size, usableSize, traceId);
+            }
+            lastPtr = 0;
+            data.out.writeHexLine('T', index.index);
+        } else if (reader.mode() == 'C') {
+            // decode binary records, the analyzers only read text
+            uint64_t delta = 0;
+            if (!(reader >> delta)) {
+                error_out << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            data.out.writeHexLine('C', delta);
+        } else if (reader.mode() == 'N' && isLaterSegment) {
+            uint64_t traceIndex = 0;
+            uint64_t allocations = 0;
+            uint64_t temporary = 0;
+            uint64_t leaked = 0;
+            if (!(reader >> traceIndex) || !(reader >> allocations) || !(reader >> temporary) || !(reader >> leaked)) {
+                error_out << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            data.out.writeHexLine('N', offsetTrace(traceIndex), allocations, temporary, leaked);
+        } else if (reader.mode() == 'n') {
+            uint64_t segmentsAgo = 0;
+            uint64_t traceIndex = 0;
+            uint64_t bytes = 0;
+            if (!(reader >> segmentsAgo) || !(reader >> traceIndex) || !(reader >> bytes)) {
+                error_out << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            if (!segmentsAgo || segmentsAgo >= segmentTraceOffsets.size()) {
+                // the allocation was recorded in a segment we didn't read, so it isn't counted as leaked
+                continue;
+            }
+            const auto offset = segmentTraceOffsets[segmentTraceOffsets.size() - 1 - segmentsAgo];
+            data.out.writeHexLine('n', traceIndex ? traceIndex + offset : 0, bytes);
         } else {
             data.out.write("%s\n", reader.line().c_str());
         }
@@ -0,0 +1,168 @@
+/*
+    SPDX-FileCopyrightText: 2026 heaptrack contributors
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef ALLOCATIONAGGREGATOR_H
+#define ALLOCATIONAGGREGATOR_H
+
+/**
+ * @file allocationaggregator.h
+ * @brief Per-callsite allocation costs, to write snapshots instead of every event.
+ */
+
+#include <cstdint>
+#include <vector>
+
+#include <tsl/robin_map.h>
+
+#include "util/internalarena.h"
+
+/**
+ * Accumulates the allocation costs of every trace index. The live pointers are
+ * mapped to the trace index and size of their allocation, such that deallocations
+ * can be attributed too.
+ *
+ * The costs are cumulative, a snapshot only needs to contain the traces that
+ * changed since the previous one. Thus the size of the output depends on the
+ * number of call sites, but not on the number of allocations.
+ *
+ * When the output gets rotated, the costs start from scratch but the live pointers
+ * are kept. Deallocating them reduces the leaked bytes of the earlier segment they
+ * got allocated in, which are reported separately, see takeEarlierDeallocations.
+ */
+class AllocationAggregator
+{
+public:
+    struct Cost
+    {
+        uint64_t allocations = 0;
+        uint64_t temporary = 0;
+        uint64_t leaked = 0;
+    };
+
+    void allocate(uint64_t size, uint32_t traceIndex, uintptr_t ptr)
+    {
+        auto& cost = costFor(traceIndex);
+        ++cost.allocations;
+        cost.leaked += size;
+        m_pointers[ptr] = {size, traceIndex, m_segment};
+        m_lastPointer = ptr;
+    }
+
+    void deallocate(uintptr_t ptr)
+    {
+        auto it = m_pointers.find(ptr);
+        if (it == m_pointers.end()) {
+            // allocated before we started to record
+            return;
+        } else if (it->second.segment != m_segment) {
+            // the trace index refers to the backtraces of the earlier segment
+            const auto segmentsAgo = m_segment - it->second.segment;
+            m_earlierDeallocations[(uint64_t(segmentsAgo) << 32) | it->second.traceIndex] += it->second.size;
+            m_pointers.erase(it);
+            return;
+        }
+        auto& cost = costFor(it->second.traceIndex);
+        cost.leaked -= it->second.size;
+        // like heaptrack_interpret, consider allocations temporary when they get freed directly
+        if (m_lastPointer == ptr) {
+            ++cost.temporary;
+        }
+        m_lastPointer = 0;
+        m_pointers.erase(it);
+    }
+
+    /**
+     * Call @p callback with the trace index and the cost of every trace that changed
+     * since the last call.
+     */
+    template <typename Callback>
+    void takeChanges(Callback callback)
+    {
+        for (auto traceIndex : m_changed) {
+            auto& cost = m_costs[traceIndex];
+            cost.changed = false;
+            callback(traceIndex, static_cast<const Cost&>(cost));
+        }
+        m_changed.clear();
+    }
+
+    /**
+     * Call @p callback with the number of segments ago, the trace index in that segment
+     * and the bytes of its allocations that got deallocated since the last call.
+     */
+    template <typename Callback>
+    void takeEarlierDeallocations(Callback callback)
+    {
+        for (const auto& deallocations : m_earlierDeallocations) {
+            callback(static_cast<uint32_t>(deallocations.first >> 32), static_cast<uint32_t>(deallocations.first),
+                     deallocations.second);
+        }
+        m_earlierDeallocations.clear();
+    }
+
+    /**
+     * Start from scratch for a new output segment, but keep the live pointers of the earlier ones.
+     */
+    void startSegment()
+    {
+        m_costs.clear();
+        m_changed.clear();
+        m_earlierDeallocations.clear();
+        m_lastPointer = 0;
+        ++m_segment;
+    }
+
+    void clear()
+    {
+        m_costs.clear();
+        m_changed.clear();
+        m_pointers.clear();
+        m_earlierDeallocations.clear();
+        m_lastPointer = 0;
+        m_segment = 0;
+    }
+
+private:
+    struct TraceCost : Cost
+    {
+        bool changed = false;
+    };
+
+    struct Allocation
+    {
+        uint64_t size;
+        uint32_t traceIndex;
+        // the output segment the allocation got recorded in
+        uint32_t segment;
+    };
+
+    TraceCost& costFor(uint32_t traceIndex)
+    {
+        if (traceIndex >= m_costs.size()) {
+            m_costs.resize(traceIndex + 1);
+        }
+        auto& cost = m_costs[traceIndex];
+        if (!cost.changed) {
+            cost.changed = true;
+            m_changed.push_back(traceIndex);
+        }
+        return cost;
+    }
+
+    std::vector<TraceCost, InternalAllocator<TraceCost>> m_costs;
+    std::vector<uint32_t, InternalAllocator<uint32_t>> m_changed;
+    tsl::robin_map<uintptr_t, Allocation, std::hash<uintptr_t>, std::equal_to<uintptr_t>,
+                   InternalAllocator<std::pair<uintptr_t, Allocation>>>
+        m_pointers;
+    // the deallocated bytes by the number of segments ago in the upper and the trace index in the lower half
+    tsl::robin_map<uint64_t, uint64_t, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                   InternalAllocator<std::pair<uint64_t, uint64_t>>>
+        m_earlierDeallocations;
+    uintptr_t m_lastPointer = 0;
+    uint32_t m_segment = 0;
+};
+
+#endif // ALLOCATIONAGGREGATOR_H
@@ -0,0 +1,68 @@
+/*
+    SPDX-FileCopyrightText: 2026 heaptrack contributors
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef CXXHOOKS_H
+#define CXXHOOKS_H
+
+/**
+ * @file cxxhooks.h
+ * @brief Recording of the C++ operators new and delete, shared by heaptrack_preload and heaptrack_inject.
+ */
+
+#include <cstddef>
+
+#include "libheaptrack.h"
+
+// the mangled name of size_t, for the symbols of operator new and delete
+#if __SIZEOF_SIZE_T__ == __SIZEOF_LONG__
+#define SIZE_T_MANGLING "m"
+#else
+#define SIZE_T_MANGLING "j"
+#endif
+
+/**
+ * The original operator new and delete call malloc and free, which must not be recorded
+ * again, as we record the allocation and deallocation with the hooks of the operators.
+ */
+struct IgnoreNested
+{
+    IgnoreNested()
+        : wasIgnored(heaptrack_ignore_thread(1))
+    {
+    }
+
+    ~IgnoreNested()
+    {
+        heaptrack_ignore_thread(wasIgnored);
+    }
+
+    const int wasIgnored;
+};
+
+// NOTE: these get inlined, such that the backtrace starts at the caller of the operator, like for malloc
+template <typename Original, typename... Args>
+__attribute__((always_inline)) inline void* recordNew(Original original, heaptrack_usable_size_t usableSize,
+                                                      size_t size, Args... args)
+{
+    void* ptr = nullptr;
+    {
+        IgnoreNested ignore;
+        ptr = original(size, args...);
+    }
+    heaptrack_malloc_usable(ptr, size, usableSize);
+    return ptr;
+}
+
+template <typename Original, typename... Args>
+__attribute__((always_inline)) inline void recordDelete(Original original, void* ptr, Args... args) noexcept
+{
+    // call handler before handing over the real delete implementation, like for free
+    heaptrack_free(ptr);
+    IgnoreNested ignore;
+    original(ptr, args...);
+}
+
+#endif // CXXHOOKS_H
@@ -0,0 +1,239 @@
+/*
+    SPDX-FileCopyrightText: 2026 heaptrack contributors
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef EVENTBUFFER_H
+#define EVENTBUFFER_H
+
+/**
+ * @file eventbuffer.h
+ * @brief Per-thread event buffers to record without taking a global lock.
+ *
+ * Every recording thread appends its events into its own single-producer,
+ * single-consumer ring buffer. Each event is tagged with a global sequence
+ * number. A single drainer later merges all buffers back into one stream
+ * that is ordered by that sequence number.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+
+#include <pthread.h>
+
+#include "tracetree.h"
+#include "util/internalarena.h"
+
+struct BufferedEvent
+{
+    uint64_t sequence;
+    uint64_t args[4];
+    char type;
+};
+
+class EventBuffer
+{
+public:
+    enum : uint64_t
+    {
+        CAPACITY = 8192
+    };
+    static constexpr uint64_t NO_EVENT = std::numeric_limits<uint64_t>::max();
+
+    /**
+     * @return the number of events that can be appended without blocking
+     *
+     * Must only be called by the owning thread.
+     */
+    uint64_t available() const
+    {
+        return CAPACITY - (m_head.load(std::memory_order_relaxed) - m_tail.load(std::memory_order_acquire));
+    }
+
+    /**
+     * Append an event, which must fit into the buffer, i.e. check available() first.
+     *
+     * Must only be called by the owning thread.
+     */
+    void append(std::atomic<uint64_t>& sequence, char type, uint64_t arg0, uint64_t arg1 = 0, uint64_t arg2 = 0,
+                uint64_t arg3 = 0)
+    {
+        // announce a lower bound of our sequence number before we take it, this ensures
+        // that the drainer never skips past an event which is not yet published
+        m_inFlight.store(sequence.load());
+        const auto head = m_head.load(std::memory_order_relaxed);
+        m_events[head % CAPACITY] = {sequence.fetch_add(1), {arg0, arg1, arg2, arg3}, type};
+        m_head.store(head + 1, std::memory_order_release);
+        m_inFlight.store(NO_EVENT);
+    }
+
+    /**
+     * Per-thread cache of the shared trace index, which allows us to resolve known
+     * backtraces without touching any shared state. The cache is only valid while
+     * @c traceCacheOwner matches the shared index it was filled from.
+     */
+    TraceTree traceCache;
+    const void* traceCacheOwner = nullptr;
+
+private:
+    friend class EventBufferRegistry;
+
+    std::atomic<uint64_t> m_head {0};
+    std::atomic<uint64_t> m_tail {0};
+    std::atomic<uint64_t> m_inFlight {NO_EVENT};
+    std::atomic<bool> m_released {false};
+    EventBuffer* m_next = nullptr;
+
+    /// the state of the drainer, which only touches the buffers with pending events
+    struct Cursor
+    {
+        uint64_t tail = 0;
+        uint64_t head = 0;
+        EventBuffer* next = nullptr;
+    } m_cursor;
+
+    const BufferedEvent& cursorEvent() const
+    {
+        return m_events[m_cursor.tail % CAPACITY];
+    }
+
+    BufferedEvent m_events[CAPACITY];
+};
+
+/**
+ * Owns all thread event buffers and merges them into a single ordered stream.
+ *
+ * Buffers are never freed, instead the buffer of an exited thread is reused
+ * once it got drained.
+ *
+ * The registry must be constant-initialized: when preloaded, we record allocations
+ * before the static constructors of libheaptrack run, which must not reset it.
+ */
+class EventBufferRegistry
+{
+public:
+    std::atomic<uint64_t> sequence {0};
+
+    /**
+     * @return the event buffer of the calling thread
+     */
+    EventBuffer* threadBuffer()
+    {
+        static thread_local EventBuffer* t_buffer = nullptr;
+        if (!t_buffer) {
+            t_buffer = acquire();
+        }
+        return t_buffer;
+    }
+
+    /**
+     * Merge all events with a sequence number lower than @p limit into the
+     * @p writer, in the order of their sequence numbers.
+     *
+     * The caller must ensure that only one thread drains at a time.
+     *
+     * @return the sequence number up to which all events have been written
+     */
+    template <typename Writer>
+    uint64_t drain(Writer writer, uint64_t limit = EventBuffer::NO_EVENT)
+    {
+        // events of threads that are currently appending may still show up below the
+        // current sequence number, so we may only write up to the lowest in-flight one
+        auto watermark = std::min(limit, sequence.load());
+        for (auto* buffer = m_buffers.load(); buffer; buffer = buffer->m_next) {
+            watermark = std::min(watermark, buffer->m_inFlight.load());
+        }
+
+        // link the buffers with pending events into a list
+        EventBuffer* cursors = nullptr;
+        for (auto* buffer = m_buffers.load(); buffer; buffer = buffer->m_next) {
+            auto& cursor = buffer->m_cursor;
+            cursor.tail = buffer->m_tail.load(std::memory_order_relaxed);
+            cursor.head = buffer->m_head.load(std::memory_order_acquire);
+            if (cursor.tail != cursor.head) {
+                cursor.next = cursors;
+                cursors = buffer;
+            }
+        }
+
+        while (cursors) {
+            // the number of threads is small in comparison to the number of events,
+            // a linear scan for the next event is good enough here
+            auto** next = &cursors;
+            for (auto** it = &cursors; *it; it = &(*it)->m_cursor.next) {
+                if ((*it)->cursorEvent().sequence < (*next)->cursorEvent().sequence) {
+                    next = it;
+                }
+            }
+            auto* buffer = *next;
+            if (buffer->cursorEvent().sequence >= watermark) {
+                break;
+            }
+            writer(buffer->cursorEvent());
+            if (++buffer->m_cursor.tail == buffer->m_cursor.head) {
+                buffer->m_tail.store(buffer->m_cursor.tail, std::memory_order_release);
+                *next = buffer->m_cursor.next;
+            }
+        }
+
+        for (auto* buffer = cursors; buffer; buffer = buffer->m_cursor.next) {
+            buffer->m_tail.store(buffer->m_cursor.tail, std::memory_order_release);
+        }
+        return watermark;
+    }
+
+    /**
+     * Drop all events which have not been drained yet.
+     *
+     * The caller must ensure that only one thread drains at a time.
+     */
+    void discard()
+    {
+        for (auto* buffer = m_buffers.load(); buffer; buffer = buffer->m_next) {
+            buffer->m_tail.store(buffer->m_head.load(std::memory_order_acquire), std::memory_order_release);
+        }
+    }
+
+private:
+    EventBuffer* acquire()
+    {
+        static pthread_key_t s_releaseKey;
+        static const bool s_keyCreated = pthread_key_create(&s_releaseKey, [](void* buffer) {
+            static_cast<EventBuffer*>(buffer)->m_released.store(true);
+        }) == 0;
+
+        EventBuffer* buffer = nullptr;
+        for (auto* candidate = m_buffers.load(); candidate; candidate = candidate->m_next) {
+            bool released = true;
+            if (!candidate->m_released.compare_exchange_strong(released, false)) {
+                continue;
+            } else if (candidate->available() != EventBuffer::CAPACITY) {
+                // not yet drained, try again later
+                candidate->m_released.store(true);
+                continue;
+            }
+            buffer = candidate;
+            break;
+        }
+
+        if (!buffer) {
+            // the buffers are never deleted, they get reused by later threads
+            buffer = new (InternalAllocator<EventBuffer>().allocate(1)) EventBuffer;
+            buffer->m_next = m_buffers.load();
+            while (!m_buffers.compare_exchange_weak(buffer->m_next, buffer)) {
+            }
+        }
+
+        if (s_keyCreated) {
+            pthread_setspecific(s_releaseKey, buffer);
+        }
+        return buffer;
+    }
+
+    std::atomic<EventBuffer*> m_buffers {nullptr};
+};
+
+#endif // EVENTBUFFER_H
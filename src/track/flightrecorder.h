@@ -0,0 +1,317 @@
+/*
+    SPDX-FileCopyrightText: 2026 heaptrack contributors
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef FLIGHTRECORDER_H
+#define FLIGHTRECORDER_H
+
+/**
+ * @file flightrecorder.h
+ * @brief Keeps the most recent events in memory, to write them out on demand only.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <tsl/robin_map.h>
+
+#include "util/binaryrecords.h"
+#include "util/internalarena.h"
+#include "util/linewriter.h"
+
+/**
+ * The flight recorder replaces the output of a LineWriter. All lines that describe
+ * the environment, like the header, the modules and the trace tree, are kept in
+ * memory in full. The allocations and deallocations as well as the time stamps
+ * are kept in a fixed size ring of events instead, older events get overwritten.
+ *
+ * A dump is a complete raw data file: the environment, followed by a checkpoint
+ * of all allocations that were alive at the start of the ring, and the events
+ * in the ring. To compute the checkpoint, the live allocations are tracked and
+ * the deallocation events keep the size and trace of their allocation.
+ *
+ * Dumping does not allocate any memory, such that it can be done when the
+ * process aborts, e.g. due to a corrupted heap.
+ */
+class FlightRecorder final : public LineWriter::OutputFilter
+{
+public:
+    /// the memory used per event, including the scratch space for dumping
+    static constexpr size_t BYTES_PER_EVENT = 64;
+
+    /**
+     * Keep up to @p capacity events. See dump() for @p binaryRecords and @p maxAge.
+     */
+    FlightRecorder(size_t capacity, bool binaryRecords, uint64_t maxAge)
+        : m_capacity(std::max(capacity, size_t(1)))
+        , m_events(m_capacity)
+        , m_scratchSize(scratchSizeFor(m_capacity))
+        , m_scratch(m_scratchSize)
+        , m_binaryRecords(binaryRecords)
+        , m_maxAge(maxAge)
+    {
+        m_metadata.reserve(LineWriter::BUFFER_CAPACITY);
+    }
+
+    bool write(int /*fd*/, const char* data, size_t size) override
+    {
+        m_metadata.append(data, size);
+        // ensure that the next flush of the LineWriter does not allocate, see dump()
+        if (m_metadata.capacity() - m_metadata.size() < LineWriter::BUFFER_CAPACITY) {
+            m_metadata.reserve(2 * m_metadata.capacity() + LineWriter::BUFFER_CAPACITY);
+        }
+        return true;
+    }
+
+    /**
+     * When the LineWriter gets closed, we write out a final dump.
+     */
+    bool finish(int fd) override
+    {
+        return dump(fd);
+    }
+
+    void allocate(uint64_t size, uint32_t traceIndex, uintptr_t ptr)
+    {
+        auto& allocation = m_pointers[ptr];
+        m_liveBytes += size - allocation.size;
+        allocation = {size, traceIndex};
+        add({'+', {size, traceIndex, ptr}});
+    }
+
+    void deallocate(uintptr_t ptr)
+    {
+        auto it = m_pointers.find(ptr);
+        if (it == m_pointers.end()) {
+            return;
+        }
+        add({'-', {ptr, it->second.size, it->second.traceIndex}});
+        m_liveBytes -= it->second.size;
+        m_pointers.erase(it);
+    }
+
+    /**
+     * @return the sum of the sizes of all live allocations
+     */
+    uint64_t liveBytes() const
+    {
+        return m_liveBytes;
+    }
+
+    /**
+     * Record a line of @p type with a single value, i.e. 'c', 'O' or 'R'.
+     */
+    void record(char type, uint64_t value)
+    {
+        add({type, {value, 0, 0}});
+    }
+
+    /**
+     * Write a raw data file to @p fd, which does not get closed. The events are written
+     * as binary records when enabled. When the maximum age is non-zero, only the events
+     * recorded at most that many milliseconds before the last time stamp get written.
+     *
+     * The LineWriter must be flushed before, which never allocates either.
+     */
+    bool dump(int fd)
+    {
+        const auto numEvents = std::min(m_numEvents, static_cast<uint64_t>(m_capacity));
+        auto first = m_numEvents - numEvents;
+        if (m_maxAge) {
+            first = firstEventAfter(first, m_maxAge);
+        }
+
+        // remember the first event for every pointer within the window
+        std::fill_n(m_scratch.data(), m_scratchSize, ScratchEntry {0, 0});
+        for (auto i = first; i < m_numEvents; ++i) {
+            const auto& event = eventAt(i);
+            if (event.type == '+' || event.type == '-') {
+                auto& entry = scratchEntry(event.type == '+' ? event.args[2] : event.args[0]);
+                if (!entry.ptr) {
+                    entry = {event.type == '+' ? event.args[2] : event.args[0], event.type};
+                }
+            }
+        }
+
+        DumpWriter writer(fd, m_binaryRecords);
+        if (!LineWriter::writeAll(fd, m_metadata.data(), m_metadata.size())) {
+            return false;
+        }
+
+        // the checkpoint: untouched allocations that are still alive, and those that got
+        // deallocated within the window but were allocated before it
+        for (const auto& pointer : m_pointers) {
+            if (!scratchEntry(pointer.first).ptr) {
+                const uint64_t args[] = {pointer.second.size, pointer.second.traceIndex, pointer.first};
+                writer.writeEvent('+', args);
+            }
+        }
+        for (auto i = first; i < m_numEvents; ++i) {
+            const auto& event = eventAt(i);
+            if (event.type == '-' && scratchEntry(event.args[0]).type == '-') {
+                const uint64_t args[] = {event.args[1], event.args[2], event.args[0]};
+                writer.writeEvent('+', args);
+                // only the first deallocation in the window matches an allocation from before it
+                scratchEntry(event.args[0]).type = '+';
+            }
+        }
+
+        for (auto i = first; i < m_numEvents; ++i) {
+            const auto& event = eventAt(i);
+            writer.writeEvent(event.type, event.args);
+        }
+        return writer.flush();
+    }
+
+private:
+    struct Event
+    {
+        char type;
+        uint64_t args[3];
+    };
+
+    struct ScratchEntry
+    {
+        uint64_t ptr;
+        char type;
+    };
+
+    struct Allocation
+    {
+        uint64_t size = 0;
+        uint32_t traceIndex = 0;
+    };
+
+    /**
+     * Writes the events into a fixed size buffer, like LineWriter but without allocating.
+     */
+    class DumpWriter
+    {
+    public:
+        DumpWriter(int fd, bool binaryRecords)
+            : m_fd(fd)
+            , m_binaryRecords(binaryRecords)
+        {
+        }
+
+        bool writeEvent(char type, const uint64_t* args)
+        {
+            // enough space for the mode, and three hex numbers or varints with their separators
+            constexpr size_t MAX_LINE_SIZE = 1 + 3 * 17 + 1;
+            if (sizeof(m_buffer) - m_size < MAX_LINE_SIZE && !flush()) {
+                return false;
+            }
+
+            const int numArgs = BinaryRecordCodec::numArgs(type) ? BinaryRecordCodec::numArgs(type) : 1;
+            auto* buffer = m_buffer + m_size;
+            if (m_binaryRecords && BinaryRecordCodec::numArgs(type)) {
+                uint64_t values[BinaryRecordCodec::MAX_ARGS];
+                std::copy_n(args, numArgs, values);
+                m_codec.encode(type, values);
+                *buffer++ = static_cast<char>(type | BinaryRecordCodec::TAG_BIT);
+                for (int i = 0; i < numArgs; ++i) {
+                    buffer = BinaryRecordCodec::writeVarint(buffer, values[i]);
+                }
+            } else {
+                *buffer++ = type;
+                for (int i = 0; i < numArgs; ++i) {
+                    *buffer++ = ' ';
+                    buffer = LineWriter::writeHexNumber(buffer, args[i]);
+                }
+                *buffer++ = '\n';
+            }
+            m_size = buffer - m_buffer;
+            return true;
+        }
+
+        bool flush()
+        {
+            if (!LineWriter::writeAll(m_fd, m_buffer, m_size)) {
+                return false;
+            }
+            m_size = 0;
+            return true;
+        }
+
+    private:
+        int m_fd;
+        bool m_binaryRecords;
+        BinaryRecordCodec m_codec;
+        char m_buffer[4096];
+        size_t m_size = 0;
+    };
+
+    static size_t scratchSizeFor(size_t capacity)
+    {
+        // a power of two with at most 50% load
+        size_t size = 1;
+        while (size < 2 * capacity) {
+            size *= 2;
+        }
+        return size;
+    }
+
+    void add(const Event& event)
+    {
+        m_events[m_numEvents % m_capacity] = event;
+        ++m_numEvents;
+    }
+
+    const Event& eventAt(uint64_t index) const
+    {
+        return m_events[index % m_capacity];
+    }
+
+    uint64_t firstEventAfter(uint64_t first, uint64_t maxAge) const
+    {
+        uint64_t lastTime = 0;
+        for (auto i = first; i < m_numEvents; ++i) {
+            if (eventAt(i).type == 'c') {
+                lastTime = eventAt(i).args[0];
+            }
+        }
+        for (auto i = first; i < m_numEvents; ++i) {
+            if (eventAt(i).type == 'c' && eventAt(i).args[0] + maxAge >= lastTime) {
+                return i;
+            }
+        }
+        return first;
+    }
+
+    /// linear probing, there is always a free entry as the window has fewer pointers than half the size
+    ScratchEntry& scratchEntry(uint64_t ptr)
+    {
+        const auto mask = m_scratchSize - 1;
+        auto index = ((ptr >> 4) * 0x9E3779B97F4A7C15ull) >> 20;
+        while (true) {
+            auto& entry = m_scratch[index & mask];
+            if (!entry.ptr || entry.ptr == ptr) {
+                return entry;
+            }
+            ++index;
+        }
+    }
+
+    const size_t m_capacity;
+    std::vector<Event, InternalAllocator<Event>> m_events;
+    uint64_t m_numEvents = 0;
+
+    const size_t m_scratchSize;
+    std::vector<ScratchEntry, InternalAllocator<ScratchEntry>> m_scratch;
+
+    const bool m_binaryRecords;
+    const uint64_t m_maxAge;
+
+    InternalString m_metadata;
+    tsl::robin_map<uintptr_t, Allocation, std::hash<uintptr_t>, std::equal_to<uintptr_t>,
+                   InternalAllocator<std::pair<uintptr_t, Allocation>>>
+        m_pointers;
+    uint64_t m_liveBytes = 0;
+};
+
+#endif // FLIGHTRECORDER_H
@@ -42,6 +42,97 @@ usage() {
     echo " --asan          Enables running heaptrack on binaries built with gcc's address sanitizer enabled."
     echo "                 Implies --use-inject."
     echo " --record-only   Only record and interpret the data, do not attempt to analyze it."
+    echo " --thread-buffers"
+    echo "                 Record into per-thread buffers instead of serializing all allocations"
+    echo "                 on a global lock. This reduces the overhead for heavily multi-threaded"
+    echo "                 applications, at the cost of some memory per thread."
+    echo " --sample-interval BYTES"
+    echo "                 Only record a random sample of allocations, on average one every BYTES"
+    echo "                 allocated bytes. This greatly reduces the overhead, the analyzers scale"
+    echo "                 the recorded data back up to estimate the real allocation behavior."
+    echo " --use-frame-pointers"
+    echo "                 Unwind by walking the frame pointer chain instead of parsing the DWARF"
+    echo "                 call frame information. This is much faster, but only yields complete"
+    echo "                 backtraces when all code got compiled with -fno-omit-frame-pointer."
+    echo " --unwind-cache"
+    echo "                 Stop unwinding once a frame of the previous backtrace of the same thread"
+    echo "                 is reached and reuse its outer frames. This speeds up applications which"
+    echo "                 allocate repeatedly from deep call stacks. Only supported on x86."
+    echo " --binary-records"
+    echo "                 Write the most frequent events in a compact binary encoding instead of"
+    echo "                 text. This reduces the size of the raw data and speeds up interpreting it."
+    echo " --coalesce-temporaries"
+    echo "                 Write a single event for allocations that get deallocated directly"
+    echo "                 afterwards. This reduces the size of the data for applications that"
+    echo "                 create many temporary allocations."
+    echo " --usable-size"
+    echo "                 Record the size that the allocator actually reserved for each allocation,"
+    echo "                 as reported by malloc_usable_size. This shows how much memory is lost to"
+    echo "                 the size classes of the allocator at each call site."
+    echo " --precise-timestamps"
+    echo "                 Write the time of every event in microseconds, in addition to the coarse"
+    echo "                 time stamps of the timer thread. This allows to analyze the lifetime of"
+    echo "                 temporary allocations, at the cost of a few bytes per event."
+    echo " --aggregate SECONDS"
+    echo "                 Aggregate the allocation costs per call site within the debuggee and only"
+    echo "                 write the changed costs in the given interval, instead of every event."
+    echo "                 The size of the data then depends on the number of call sites, not on the"
+    echo "                 runtime, at the cost of the temporal resolution and the size histogram."
+    echo " --async-buffer-size BYTES"
+    echo "                 Hand the recorded data over to a background writer thread, using two"
+    echo "                 buffers of the given size. Application threads then only have to wait"
+    echo "                 for the output when both buffers are full, e.g. with a slow interpreter."
+    echo " --drop-events"
+    echo "                 When both asynchronous buffers are full, drop allocation events instead of"
+    echo "                 waiting for the writer thread. The number of dropped events gets reported."
+    echo "                 Deallocation events are never dropped, so the leaks stay correct."
+    echo " --filter-frees"
+    echo "                 Skip deallocations of pointers whose allocation was definitely not recorded,"
+    echo "                 e.g. because it happened before heaptrack got attached. This is enabled"
+    echo "                 automatically when attaching to a running process."
+    echo " --zstd-level LEVEL"
+    echo "                 Compress the raw data with zstd at the given level within the debuggee,"
+    echo "                 on the asynchronous writer thread if enabled. This greatly reduces the"
+    echo "                 bandwidth needed to record, especially in combination with --raw."
+    echo " --flight-recorder BYTES"
+    echo "                 Keep only the most recent events in a ring buffer of the given size within"
+    echo "                 the debuggee and write them out on demand, together with all allocations"
+    echo "                 that were alive before. A dump gets written to a separate raw data file"
+    echo "                 on abort, via heaptrack_request_dump() from heaptrack_api.h, via a signal"
+    echo "                 or when a trigger fires. The output contains a final dump when the"
+    echo "                 debuggee exits."
+    echo " --flight-recorder-seconds SECONDS"
+    echo "                 Limit the flight recorder dumps to the events of the last seconds."
+    echo " --flight-recorder-signal SIGNAL"
+    echo "                 Write a flight recorder dump when the debuggee receives the signal number."
+    echo " --trigger-rss BYTES"
+    echo "                 Fire a trigger whenever the RSS exceeds the given size. Without a flight"
+    echo "                 recorder, nothing gets recorded until the first trigger fires, otherwise"
+    echo "                 every trigger writes a flight recorder dump."
+    echo " --trigger-heap BYTES"
+    echo "                 Fire a trigger whenever the live heap exceeds the given size."
+    echo " --trigger-rss-growth BYTES"
+    echo "                 Fire a trigger whenever the RSS grows faster than the given size per second."
+    echo " --timer-interval MILLISECONDS"
+    echo "                 Write time stamps and RSS values in the given interval, 10ms by default."
+    echo " --timer-max-interval MILLISECONDS"
+    echo "                 Double the timer interval up to the given maximum while the debuggee does"
+    echo "                 not allocate, and go back to --timer-interval once it does again."
+    echo " --follow-fork"
+    echo "                 Also trace forked child processes, e.g. the workers of a prefork server."
+    echo "                 Each child writes raw data to its own file, starting with the backtraces"
+    echo "                 known to its parent. These files get interpreted once the debuggee exits."
+    echo " --control-channel"
+    echo "                 Accept commands from heaptrack --control while the debuggee runs, see"
+    echo "                 below. This is enabled automatically when attaching to a running process."
+    echo " --rotate-seconds SECONDS"
+    echo "                 Continue recording into a new data file whenever the given number of seconds"
+    echo "                 passed, e.g. for long-running services. Each file can be analyzed on its own."
+    echo "                 In combination with --raw, a range of files can be interpreted as a whole"
+    echo "                 via --interpret-segments."
+    echo " --rotate-size BYTES"
+    echo "                 Continue recording into a new data file whenever the given number of bytes"
+    echo "                 of uncompressed raw data got written."
     echo "  ARGUMENT       Any number of arguments that will be passed verbatim"
     echo "                 to the debuggee."
     echo "  -h, --help     Show this help message and exit."
@@ -58,6 +149,17 @@ usage() {
     echo "Alternatively, to interpret a raw recorded heaptrack data file:"
     echo "  -i, --interpret FILE  Convert a raw heaptrack data file with heaptrack_interpret."
     echo "                        Any options passed after --analyze will be passed along."
+    echo "  --interpret-segments FILE..."
+    echo "                        Convert consecutive raw data files of a rotated output together,"
+    echo "                        such that they can be analyzed as a whole."
+    echo
+    echo "Alternatively, to control a process that is traced with --control-channel or --pid:"
+    echo "  --control PID COMMAND Send one of the following commands to the traced process:"
+    echo "                        pause     Stop recording, the allocations are not even unwound then."
+    echo "                        resume    Continue recording."
+    echo "                        snapshot  Write out the data recorded so far, or a flight recorder dump."
+    echo "                        rotate    Continue recording into a new data file."
+    echo "                        stop      Stop recording, also detaching from an attached process."
     echo
     echo "Alternatively, to analyze a recorded heaptrack data file:"
     echo "  -a, --analyze FILE    Open the heaptrack data file in heaptrack_gui, if available,"
@@ -77,6 +179,18 @@ asan=
 asan_ld_preload=
 quiet=
 output=
+zstd_level=
+flight_recorder=
+follow_fork=
+control_channel=
+rotate_segments=
+heaptrack_options=
+
+# set an environment variable for libheaptrack, also when runtime-attaching
+setHeaptrackOption() {
+    heaptrack_options="$heaptrack_options $1=$2"
+    export "$1=$2"
+}
 
 # path to current heaptrack.sh executable
 SCRIPT_PATH=$(readlink -f "$0")
@@ -127,7 +241,12 @@ interpretRawHeaptrackDataFile() {
             $GZ_UNCOMPRESSOR < "$input" | "$INTERPRETER" "$@" | $COMPRESSOR > "$output"
             ;;
         *.zst)
-            $ZSTD_UNCOMPRESSOR < "$input" | "$INTERPRETER" "$@" | $COMPRESSOR > "$output"
+            if [ "@ZSTD_FOUND@" = "TRUE" ]; then
+                # the interpreter decompresses its input on its own
+                "$INTERPRETER" "$@" < "$input" | $COMPRESSOR > "$output"
+            else
+                $ZSTD_UNCOMPRESSOR < "$input" | "$INTERPRETER" "$@" | $COMPRESSOR > "$output"
+            fi
             ;;
         *)
             "$INTERPRETER" "$@" | $COMPRESSOR > "$output"
@@ -140,6 +259,93 @@ interpretRawHeaptrackDataFile() {
     echo "  heaptrack --analyze \"$output\""
 }
 
+# print the control channel of the traced process with PID $1, see openControlChannel in libheaptrack.cpp
+# nothing gets printed unless the FIFO and its directory belong to the user that runs the process
+findControlChannel() {
+    control_uid=$(ps -o uid= -p "$1" 2> /dev/null | tr -d ' ')
+    if [ -z "$control_uid" ]; then
+        return 1
+    fi
+    control_dir="/tmp/heaptrack-$control_uid"
+    control="$control_dir/control.$1"
+    # ls does not follow symlinks, so their type is reported as 'l'
+    case "$(ls -ldn "$control_dir" 2> /dev/null | awk '{print $1 " " $3}')" in
+        d???------*" $control_uid") ;;
+        *) return 1 ;;
+    esac
+    case "$(ls -ldn "$control" 2> /dev/null | awk '{print $1 " " $3}')" in
+        p*" $control_uid") ;;
+        *) return 1 ;;
+    esac
+    echo "$control"
+}
+
+sendControlCommand() {
+    case "$2" in
+        pause | resume | snapshot | rotate | stop) ;;
+        *)
+            echo "Unknown control command \"$2\", expected pause, resume, snapshot, rotate or stop."
+            exit 1
+            ;;
+    esac
+    control=$(findControlChannel "$1")
+    if [ -z "$1" ] || [ -z "$control" ] || ! kill -0 "$1" 2> /dev/null; then
+        echo "No heaptrack control channel found for PID $1."
+        exit 1
+    fi
+    # the debuggee keeps the FIFO opened for reading, so this does not block
+    echo "$2" > "$control"
+}
+
+# interpret the raw data files that the debuggee wrote on its own, in parallel
+interpretDebuggeeFiles() {
+    raw_suffix="$1"
+    shift 1
+    for raw in "$@"; do
+        if [ -f "$raw" ]; then
+            # the interpreter decompresses zstd on its own
+            "$INTERPRETER" < "$raw" | $COMPRESSOR > "${raw%$raw_suffix}.$output_suffix" && rm -f "$raw" &
+        fi
+    done
+    wait
+}
+
+# interpret consecutive raw data files of a rotated output into a single data file
+interpretRawHeaptrackDataSegments() {
+    for raw in "$@"; do
+        if [ ! -f "$raw" ]; then
+            echo "raw file \"$raw\" does not exist"
+            exit 1
+        fi
+    done
+
+    output=$(echo $1 | sed -e 's/.zst$//' -e 's/.gz$//' -e 's/.raw$//')
+    output="$output.range.$output_suffix"
+    echo "writing interpreted data to $output..."
+
+    # the interpreter reads the segments one after the other, but only the
+    # first one may be compressed in-process, so we decompress them here
+    for raw in "$@"; do
+        case "$raw" in
+            *.gz)
+                $GZ_UNCOMPRESSOR < "$raw"
+                ;;
+            *)
+                if [ ! -z "$(command -v zstd 2> /dev/null)" ]; then
+                    $ZSTD_UNCOMPRESSOR -f < "$raw"
+                else
+                    cat "$raw"
+                fi
+                ;;
+        esac
+    done | "$INTERPRETER" | $COMPRESSOR > "$output"
+
+    echo
+    echo "Interpretation finished, you can now analyze the data:"
+    echo
+    echo "  heaptrack --analyze \"$output\""
+}
+
 openHeaptrackDataFiles() {
     if [ -x "$EXE_PATH/heaptrack_gui" ]; then
         "$EXE_PATH/heaptrack_gui" "$@"
@@ -177,6 +383,176 @@ while true; do
             record_only=1
             shift 1
             ;;
+        "--thread-buffers")
+            setHeaptrackOption HEAPTRACK_THREAD_BUFFERS 1
+            shift 1
+            ;;
+        "--sample-interval")
+            if [ -z "$2" ] || ! [ "$2" -gt 0 ] 2> /dev/null; then
+                echo "Missing or invalid sample interval argument."
+                exit 1
+            fi
+            setHeaptrackOption HEAPTRACK_SAMPLE_INTERVAL "$2"
+            shift 2
+            ;;
+        "--use-frame-pointers")
+            setHeaptrackOption HEAPTRACK_USE_FRAMEPOINTER 1
+            shift 1
+            ;;
+        "--unwind-cache")
+            setHeaptrackOption HEAPTRACK_UNWIND_CACHE 1
+            shift 1
+            ;;
+        "--binary-records")
+            setHeaptrackOption HEAPTRACK_BINARY_RECORDS 1
+            shift 1
+            ;;
+        "--coalesce-temporaries")
+            setHeaptrackOption HEAPTRACK_COALESCE_TEMPORARIES 1
+            shift 1
+            ;;
+        "--usable-size")
+            setHeaptrackOption HEAPTRACK_USABLE_SIZE 1
+            shift 1
+            ;;
+        "--precise-timestamps")
+            setHeaptrackOption HEAPTRACK_PRECISE_TIMESTAMPS 1
+            shift 1
+            ;;
+        "--aggregate")
+            if [ -z "$2" ] || ! [ "$2" -gt 0 ] 2> /dev/null; then
+                echo "Missing or invalid aggregation interval argument."
+                exit 1
+            fi
+            setHeaptrackOption HEAPTRACK_AGGREGATE "$2"
+            shift 2
+            ;;
+        "--async-buffer-size")
+            if [ -z "$2" ] || ! [ "$2" -gt 0 ] 2> /dev/null; then
+                echo "Missing or invalid buffer size argument."
+                exit 1
+            fi
+            setHeaptrackOption HEAPTRACK_ASYNC_BUFFER_SIZE "$2"
+            shift 2
+            ;;
+        "--drop-events")
+            setHeaptrackOption HEAPTRACK_ASYNC_DROP 1
+            shift 1
+            ;;
+        "--filter-frees")
+            setHeaptrackOption HEAPTRACK_FILTER_FREES 1
+            shift 1
+            ;;
+        "--zstd-level")
+            if [ "@ZSTD_FOUND@" != "TRUE" ]; then
+                echo "Heaptrack was built without zstd support, cannot compress the data in-process."
+                exit 1
+            fi
+            if [ -z "$2" ] || ! [ "$2" -gt 0 ] 2> /dev/null; then
+                echo "Missing or invalid compression level argument."
+                exit 1
+            fi
+            zstd_level="$2"
+            setHeaptrackOption HEAPTRACK_ZSTD_LEVEL "$2"
+            shift 2
+            ;;
+        "--flight-recorder")
+            if [ -z "$2" ] || ! [ "$2" -gt 0 ] 2> /dev/null; then
+                echo "Missing or invalid flight recorder size argument."
+                exit 1
+            fi
+            flight_recorder=1
+            setHeaptrackOption HEAPTRACK_FLIGHT_RECORDER "$2"
+            shift 2
+            ;;
+        "--flight-recorder-seconds")
+            if [ -z "$2" ] || ! [ "$2" -gt 0 ] 2> /dev/null; then
+                echo "Missing or invalid flight recorder duration argument."
+                exit 1
+            fi
+            setHeaptrackOption HEAPTRACK_FLIGHT_RECORDER_SECONDS "$2"
+            shift 2
+            ;;
+        "--flight-recorder-signal")
+            if [ -z "$2" ] || ! [ "$2" -gt 0 ] 2> /dev/null; then
+                echo "Missing or invalid signal number argument."
+                exit 1
+            fi
+            setHeaptrackOption HEAPTRACK_FLIGHT_RECORDER_SIGNAL "$2"
+            shift 2
+            ;;
+        "--trigger-rss")
+            if [ -z "$2" ] || ! [ "$2" -gt 0 ] 2> /dev/null; then
+                echo "Missing or invalid RSS threshold argument."
+                exit 1
+            fi
+            setHeaptrackOption HEAPTRACK_TRIGGER_RSS "$2"
+            shift 2
+            ;;
+        "--trigger-heap")
+            if [ -z "$2" ] || ! [ "$2" -gt 0 ] 2> /dev/null; then
+                echo "Missing or invalid heap threshold argument."
+                exit 1
+            fi
+            setHeaptrackOption HEAPTRACK_TRIGGER_HEAP "$2"
+            shift 2
+            ;;
+        "--trigger-rss-growth")
+            if [ -z "$2" ] || ! [ "$2" -gt 0 ] 2> /dev/null; then
+                echo "Missing or invalid RSS growth threshold argument."
+                exit 1
+            fi
+            setHeaptrackOption HEAPTRACK_TRIGGER_RSS_GROWTH "$2"
+            shift 2
+            ;;
+        "--timer-interval")
+            if [ -z "$2" ] || ! [ "$2" -gt 0 ] 2> /dev/null; then
+                echo "Missing or invalid timer interval argument."
+                exit 1
+            fi
+            setHeaptrackOption HEAPTRACK_TIMER_INTERVAL "$2"
+            shift 2
+            ;;
+        "--timer-max-interval")
+            if [ -z "$2" ] || ! [ "$2" -gt 0 ] 2> /dev/null; then
+                echo "Missing or invalid maximum timer interval argument."
+                exit 1
+            fi
+            setHeaptrackOption HEAPTRACK_TIMER_MAX_INTERVAL "$2"
+            shift 2
+            ;;
+        "--follow-fork")
+            follow_fork=1
+            setHeaptrackOption HEAPTRACK_FOLLOW_FORK 1
+            shift 1
+            ;;
+        "--control-channel")
+            control_channel=1
+            setHeaptrackOption HEAPTRACK_CONTROL 1
+            shift 1
+            ;;
+        "--rotate-seconds")
+            if [ -z "$2" ] || ! [ "$2" -gt 0 ] 2> /dev/null; then
+                echo "Missing or invalid rotation interval argument."
+                exit 1
+            fi
+            rotate_segments=1
+            setHeaptrackOption HEAPTRACK_ROTATE_SECONDS "$2"
+            shift 2
+            ;;
+        "--rotate-size")
+            if [ -z "$2" ] || ! [ "$2" -gt 0 ] 2> /dev/null; then
+                echo "Missing or invalid rotation size argument."
+                exit 1
+            fi
+            rotate_segments=1
+            setHeaptrackOption HEAPTRACK_ROTATE_SIZE "$2"
+            shift 2
+            ;;
+        "--control")
+            sendControlCommand "$2" "$3"
+            exit
+            ;;
         "-h" | "--help")
             usage
             exit 0
@@ -223,6 +599,11 @@ while true; do
                 echo "Cannot attach to unknown process with PID $pid."
                 exit 1
             fi
+            # all allocations made before attaching are unknown to us
+            setHeaptrackOption HEAPTRACK_FILTER_FREES 1
+            # this also allows us to detach without GDB
+            control_channel=1
+            setHeaptrackOption HEAPTRACK_CONTROL 1
             shift 2
             echo $@
             if [ ! -z "$@" ]; then
@@ -244,6 +625,11 @@ while true; do
             interpretRawHeaptrackDataFile "$@"
             exit
             ;;
+        "--interpret-segments")
+            shift 1
+            interpretRawHeaptrackDataSegments "$@"
+            exit
+            ;;
         "-a" | "--analyze")
             shift 1
             openHeaptrackDataFiles "$@"
@@ -356,8 +742,47 @@ fi
 output_no_suffix="$output"
 output_non_raw="$output.$output_suffix"
 
+if [ ! -z "$flight_recorder" ]; then
+    # the debuggee writes the dumps on its own, possibly from another working directory
+    flight_recorder_output="$output_no_suffix.flight"
+    case "$flight_recorder_output" in
+        /*) ;;
+        *) flight_recorder_output="$PWD/$flight_recorder_output" ;;
+    esac
+    setHeaptrackOption HEAPTRACK_FLIGHT_RECORDER_OUTPUT "$flight_recorder_output"
+fi
+
+if [ ! -z "$follow_fork" ]; then
+    # the forked children write to these files on their own, libheaptrack replaces $$ with their pid
+    follow_fork_output="$output_no_suffix.fork"
+    case "$follow_fork_output" in
+        /*) ;;
+        *) follow_fork_output="$PWD/$follow_fork_output" ;;
+    esac
+    follow_fork_raw_suffix="raw"
+    if [ ! -z "$zstd_level" ]; then
+        follow_fork_raw_suffix="raw.zst"
+    fi
+    setHeaptrackOption HEAPTRACK_FOLLOW_FORK_OUTPUT "$follow_fork_output.\$\$.$follow_fork_raw_suffix"
+fi
+
+if [ ! -z "$control_channel" ] || [ ! -z "$rotate_segments" ]; then
+    # rotating the output continues with files that are named after the pid and a running number
+    rotate_output="$output_no_suffix.rotated"
+    case "$rotate_output" in
+        /*) ;;
+        *) rotate_output="$PWD/$rotate_output" ;;
+    esac
+    setHeaptrackOption HEAPTRACK_ROTATE_OUTPUT "$rotate_output.\$\$"
+fi
+
 if [ ! -z "$write_raw_data" ]; then
     output_suffix="raw.$output_suffix"
+    if [ ! -z "$zstd_level" ]; then
+        # the data is compressed in-process already
+        output_suffix="raw.zst"
+        COMPRESSOR="cat"
+    fi
 fi
 
 # interpret the data and compress the output on the fly
@@ -370,7 +795,18 @@ fi
 debuggee=$!
 
 cleanup() {
-    if [ ! -z "$pid" ] && [ -d "/proc/$pid" ]; then
+    control=
+    if [ ! -z "$pid" ]; then
+        control=$(findControlChannel "$pid")
+    fi
+    if [ ! -z "$control" ] && kill -0 "$pid" 2> /dev/null; then
+        echo "removing heaptrack injection..."
+        echo stop > "$control"
+        # the control channel gets removed once all data got written
+        while [ -p "$control" ] && kill -0 "$pid" 2> /dev/null; do
+            sleep 0.1
+        done
+    elif [ ! -z "$pid" ] && [ -d "/proc/$pid" ]; then
         echo "removing heaptrack injection via GDB, this might take some time..."
         gdb --batch-silent -n -iex="set auto-solib-add off" \
             -iex="set language c" -p $pid \
@@ -402,6 +838,40 @@ cleanup() {
       fi
 
       echo "  heaptrack --analyze \"$output\""
+
+      if [ ! -z "$follow_fork" ] && [ ! -z "$write_raw_data" ]; then
+          echo
+          echo "The data of the forked child processes, if any, must be interpreted as well:"
+          echo
+          echo "  heaptrack --interpret \"$follow_fork_output.PID.$follow_fork_raw_suffix\""
+      elif [ ! -z "$follow_fork" ]; then
+          echo
+          echo "The data of the forked child processes, if any, was written to:"
+          echo
+          echo "  $follow_fork_output.PID.$output_suffix"
+      fi
+
+      if [ ! -z "$control_channel" ] || [ ! -z "$rotate_segments" ]; then
+          echo
+          echo "The data recorded after rotating the output, if any, was written to:"
+          echo
+          if [ ! -z "$write_raw_data" ]; then
+              echo "  $rotate_output.PID.N (raw data, which must be interpreted first)"
+              echo
+              echo "To analyze a range of them as a whole, interpret them together:"
+              echo
+              echo "  heaptrack --interpret-segments \"$output\" \"$rotate_output.PID.1\" ..."
+          else
+              echo "  $rotate_output.PID.N.$output_suffix"
+          fi
+      fi
+
+      if [ ! -z "$flight_recorder" ]; then
+          echo
+          echo "The flight recorder dumps, if any, are raw data files which must be interpreted first:"
+          echo
+          echo "  heaptrack --interpret \"$flight_recorder_output.N\""
+      fi
     fi
 
     if [ -z "$record_only" ] && [ -z "$write_raw_data" ] && [ -x "$EXE_PATH/heaptrack_gui" ]; then
@@ -439,12 +909,17 @@ else
       echo "injecting heaptrack into application via GDB, this might take some time..."
     fi
     dlopen=$($ENVCHECKER dlopen "$LIBHEAPTRACK_INJECT")
+    # forward the heaptrack options into the environment of the running process
+    for option in $heaptrack_options; do
+        set -- "$@" --eval-command="call (int) setenv(\"${option%%=*}\", \"${option#*=}\", 1)"
+    done
     if [ -z "$debug" ]; then
         unset DEBUGINFOD_URLS
         gdb --batch-silent -n -iex="set auto-solib-add off" \
             -iex="set language c" -p $pid \
             --eval-command="sharedlibrary libc.so" \
             --eval-command="call (void) $dlopen" \
+            "$@" \
             --eval-command="sharedlibrary libheaptrack_inject" \
             --eval-command="call (void) heaptrack_inject(\"$pipe\")" \
             --eval-command="detach"
@@ -453,6 +928,7 @@ else
         gdb --quiet -iex="set language c" -p $pid \
             --eval-command="sharedlibrary libc.so" \
             --eval-command="print (void*) $dlopen" \
+            "$@" \
             --eval-command="sharedlibrary libheaptrack_inject" \
             --eval-command="call (void) heaptrack_inject(\"$pipe\")"
     fi
@@ -464,6 +940,14 @@ else
 fi
 
 wait $debuggee
+
+if [ ! -z "$follow_fork" ] && [ -z "$write_raw_data" ]; then
+    interpretDebuggeeFiles ".$follow_fork_raw_suffix" "$follow_fork_output".*."$follow_fork_raw_suffix"
+fi
+if { [ ! -z "$control_channel" ] || [ ! -z "$rotate_segments" ]; } && [ -z "$write_raw_data" ]; then
+    interpretDebuggeeFiles "" "$rotate_output".*[0-9]
+fi
+
 exit $EXIT_CODE
 
 # kate: hl Bash
@@ -16,6 +16,10 @@
  * Once you run your code within heaptrack though, this information will be
  * picked up and included in the heap profile data.
  *
+ * When heaptrack runs in flight recorder mode, @c heaptrack_request_dump
+ * writes the recent heap history to a new file, e.g. when your application
+ * detects a latency spike.
+ *
  * Note: If you use static linking, or have a custom allocator in your main
  * executable, then you must define HEAPTRACK_API_DLSYM before including
  * this header and link against libdl to make this work properly. The other,
@@ -48,6 +52,7 @@ extern "C" {
 __attribute__((weak)) void heaptrack_malloc(void* ptr, size_t size);
 __attribute__((weak)) void heaptrack_realloc(void* ptr_in, size_t size, void* ptr_out);
 __attribute__((weak)) void heaptrack_free(void* ptr);
+__attribute__((weak)) void heaptrack_dump();
 
 #ifdef __cplusplus
 }
@@ -65,6 +70,10 @@ __attribute__((weak)) void heaptrack_free(void* ptr);
     if (heaptrack_free)                                                                                                \
     heaptrack_free(ptr)
 
+#define heaptrack_request_dump()                                                                                       \
+    if (heaptrack_dump)                                                                                                \
+    heaptrack_dump()
+
 #else // HEAPTRACK_API_DLSYM
 
 /**
@@ -91,8 +100,9 @@ struct heaptrack_api_t
     void (*malloc)(void*, size_t);
     void (*free)(void*);
     void (*realloc)(void*, size_t, void*);
+    void (*dump)(void);
 };
-static struct heaptrack_api_t heaptrack_api = {0, 0, 0};
+static struct heaptrack_api_t heaptrack_api = {0, 0, 0, 0};
 
 void heaptrack_init_api()
 {
@@ -110,6 +120,10 @@ void heaptrack_init_api()
         if (sym)
             heaptrack_api.free = (void (*)(void*))sym;
 
+        sym = dlsym(RTLD_NEXT, "heaptrack_dump");
+        if (sym)
+            heaptrack_api.dump = (void (*)(void))sym;
+
         initialized = 1;
     }
 }
@@ -135,6 +149,13 @@ void heaptrack_init_api()
             heaptrack_api.free(ptr);                                                                                   \
     } while (0)
 
+#define heaptrack_request_dump()                                                                                       \
+    do {                                                                                                               \
+        heaptrack_init_api();                                                                                          \
+        if (heaptrack_api.dump)                                                                                        \
+            heaptrack_api.dump();                                                                                      \
+    } while (0)
+
 #endif // HEAPTRACK_API_DLSYM
 
 /**
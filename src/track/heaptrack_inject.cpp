@@ -4,6 +4,7 @@
     SPDX-License-Identifier: LGPL-2.1-or-later
 */
 
+#include "cxxhooks.h"
 #include "libheaptrack.h"
 #include "util/config.h"
 #include "util/linewriter.h"
@@ -23,8 +24,13 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 
+#include <new>
 #include <type_traits>
 
+#if HAVE_MALLOC_USABLE_SIZE
+#include <malloc.h>
+#endif
+
 /**
  * @file heaptrack_inject.cpp
  *
@@ -78,6 +84,36 @@ __attribute__((weak)) void* GC_malloc(size_t size) LIBC_FUN_ATTRS;
 __attribute__((weak)) void* GC_realloc(void* p, size_t newsize) LIBC_FUN_ATTRS;
 __attribute__((weak)) void GC_free_profiler_hook(void* p) LIBC_FUN_ATTRS;
 __attribute__((weak)) int GC_posix_memalign(void** memptr, size_t alignment, size_t size) LIBC_FUN_ATTRS;
+
+// Forward declare the non-standard API of jemalloc (https://jemalloc.net)
+__attribute__((weak)) void* mallocx(size_t size, int flags) LIBC_FUN_ATTRS;
+__attribute__((weak)) void* rallocx(void* ptr, size_t size, int flags) LIBC_FUN_ATTRS;
+__attribute__((weak)) size_t xallocx(void* ptr, size_t size, size_t extra, int flags) LIBC_FUN_ATTRS;
+__attribute__((weak)) void dallocx(void* ptr, int flags) LIBC_FUN_ATTRS;
+__attribute__((weak)) void sdallocx(void* ptr, size_t size, int flags) LIBC_FUN_ATTRS;
+
+// Forward declare the API of gperftools tcmalloc (https://github.com/gperftools/gperftools)
+__attribute__((weak)) void* tc_malloc(size_t size) LIBC_FUN_ATTRS;
+__attribute__((weak)) void* tc_malloc_skip_new_handler(size_t size) LIBC_FUN_ATTRS;
+__attribute__((weak)) void tc_free(void* ptr) LIBC_FUN_ATTRS;
+__attribute__((weak)) void tc_free_sized(void* ptr, size_t size) LIBC_FUN_ATTRS;
+__attribute__((weak)) void* tc_realloc(void* ptr, size_t size) LIBC_FUN_ATTRS;
+__attribute__((weak)) void* tc_calloc(size_t count, size_t size) LIBC_FUN_ATTRS;
+__attribute__((weak)) void tc_cfree(void* ptr) LIBC_FUN_ATTRS;
+__attribute__((weak)) void* tc_memalign(size_t alignment, size_t size) LIBC_FUN_ATTRS;
+__attribute__((weak)) int tc_posix_memalign(void** memptr, size_t alignment, size_t size) LIBC_FUN_ATTRS;
+__attribute__((weak)) void* tc_valloc(size_t size) LIBC_FUN_ATTRS;
+__attribute__((weak)) void* tc_pvalloc(size_t size) LIBC_FUN_ATTRS;
+__attribute__((weak)) void* tc_new(size_t size);
+__attribute__((weak)) void* tc_newarray(size_t size);
+__attribute__((weak)) void* tc_new_nothrow(size_t size, const std::nothrow_t&) LIBC_FUN_ATTRS;
+__attribute__((weak)) void* tc_newarray_nothrow(size_t size, const std::nothrow_t&) LIBC_FUN_ATTRS;
+__attribute__((weak)) void tc_delete(void* ptr) LIBC_FUN_ATTRS;
+__attribute__((weak)) void tc_deletearray(void* ptr) LIBC_FUN_ATTRS;
+__attribute__((weak)) void tc_delete_sized(void* ptr, size_t size) LIBC_FUN_ATTRS;
+__attribute__((weak)) void tc_deletearray_sized(void* ptr, size_t size) LIBC_FUN_ATTRS;
+__attribute__((weak)) void tc_delete_nothrow(void* ptr, const std::nothrow_t&) LIBC_FUN_ATTRS;
+__attribute__((weak)) void tc_deletearray_nothrow(void* ptr, const std::nothrow_t&) LIBC_FUN_ATTRS;
 }
 
 namespace {
@@ -109,6 +145,13 @@ void overwrite_symbols() noexcept;
 
 namespace hooks {
 
+/// queries the usable size of the allocations of the libc functions, see HEAPTRACK_USABLE_SIZE
+#if HAVE_MALLOC_USABLE_SIZE
+const heaptrack_usable_size_t usableSize = &::malloc_usable_size;
+#else
+const heaptrack_usable_size_t usableSize = nullptr;
+#endif
+
 struct malloc
 {
     static constexpr auto name = "malloc";
@@ -117,7 +160,7 @@ struct malloc
     static void* hook(size_t size) noexcept
     {
         auto ptr = original(size);
-        heaptrack_malloc(ptr, size);
+        heaptrack_malloc_usable(ptr, size, usableSize);
         return ptr;
     }
 };
@@ -143,7 +186,7 @@ struct realloc
     {
         auto inPtr = reinterpret_cast<uintptr_t>(ptr);
         auto ret = original(ptr, size);
-        heaptrack_realloc2(inPtr, size, reinterpret_cast<uintptr_t>(ret));
+        heaptrack_realloc2_usable(inPtr, size, reinterpret_cast<uintptr_t>(ret), usableSize);
 
         return ret;
     }
@@ -157,7 +200,7 @@ struct calloc
     static void* hook(size_t num, size_t size) noexcept
     {
         auto ptr = original(num, size);
-        heaptrack_malloc(ptr, num * size);
+        heaptrack_malloc_usable(ptr, num * size, usableSize);
         return ptr;
     }
 };
@@ -215,7 +258,7 @@ struct posix_memalign
     {
         auto ret = original(memptr, alignment, size);
         if (!ret) {
-            heaptrack_malloc(*memptr, size);
+            heaptrack_malloc_usable(*memptr, size, usableSize);
         }
         return ret;
     }
@@ -327,6 +370,575 @@ struct GC_posix_memalign
     }
 };
 
+// jemalloc functions
+struct mallocx
+{
+    static constexpr auto name = "mallocx";
+    static constexpr auto original = &::mallocx;
+
+    static void* hook(size_t size, int flags) noexcept
+    {
+        auto ptr = original(size, flags);
+        heaptrack_malloc_usable(ptr, size, usableSize);
+        return ptr;
+    }
+};
+
+struct rallocx
+{
+    static constexpr auto name = "rallocx";
+    static constexpr auto original = &::rallocx;
+
+    static void* hook(void* ptr, size_t size, int flags) noexcept
+    {
+        auto ret = original(ptr, size, flags);
+        heaptrack_realloc_usable(ptr, size, ret, usableSize);
+        return ret;
+    }
+};
+
+struct xallocx
+{
+    static constexpr auto name = "xallocx";
+    static constexpr auto original = &::xallocx;
+
+    static size_t hook(void* ptr, size_t size, size_t extra, int flags) noexcept
+    {
+        // resizes in place, the result is the new usable size which is smaller than the requested one on failure
+        auto ret = original(ptr, size, extra, flags);
+        if (ret >= size) {
+            heaptrack_realloc_usable(ptr, ret, ptr, usableSize);
+        }
+        return ret;
+    }
+};
+
+struct dallocx
+{
+    static constexpr auto name = "dallocx";
+    static constexpr auto original = &::dallocx;
+
+    static void hook(void* ptr, int flags) noexcept
+    {
+        heaptrack_free(ptr);
+        original(ptr, flags);
+    }
+};
+
+struct sdallocx
+{
+    static constexpr auto name = "sdallocx";
+    static constexpr auto original = &::sdallocx;
+
+    static void hook(void* ptr, size_t size, int flags) noexcept
+    {
+        heaptrack_free(ptr);
+        original(ptr, size, flags);
+    }
+};
+
+// tcmalloc functions
+struct tc_malloc
+{
+    static constexpr auto name = "tc_malloc";
+    static constexpr auto original = &::tc_malloc;
+
+    static void* hook(size_t size) noexcept
+    {
+        auto ptr = original(size);
+        heaptrack_malloc_usable(ptr, size, usableSize);
+        return ptr;
+    }
+};
+
+struct tc_malloc_skip_new_handler
+{
+    static constexpr auto name = "tc_malloc_skip_new_handler";
+    static constexpr auto original = &::tc_malloc_skip_new_handler;
+
+    static void* hook(size_t size) noexcept
+    {
+        auto ptr = original(size);
+        heaptrack_malloc_usable(ptr, size, usableSize);
+        return ptr;
+    }
+};
+
+struct tc_free
+{
+    static constexpr auto name = "tc_free";
+    static constexpr auto original = &::tc_free;
+
+    static void hook(void* ptr) noexcept
+    {
+        heaptrack_free(ptr);
+        original(ptr);
+    }
+};
+
+struct tc_free_sized
+{
+    static constexpr auto name = "tc_free_sized";
+    static constexpr auto original = &::tc_free_sized;
+
+    static void hook(void* ptr, size_t size) noexcept
+    {
+        heaptrack_free(ptr);
+        original(ptr, size);
+    }
+};
+
+struct tc_realloc
+{
+    static constexpr auto name = "tc_realloc";
+    static constexpr auto original = &::tc_realloc;
+
+    static void* hook(void* ptr, size_t size) noexcept
+    {
+        auto ret = original(ptr, size);
+        heaptrack_realloc_usable(ptr, size, ret, usableSize);
+        return ret;
+    }
+};
+
+struct tc_calloc
+{
+    static constexpr auto name = "tc_calloc";
+    static constexpr auto original = &::tc_calloc;
+
+    static void* hook(size_t num, size_t size) noexcept
+    {
+        auto ptr = original(num, size);
+        heaptrack_malloc_usable(ptr, num * size, usableSize);
+        return ptr;
+    }
+};
+
+struct tc_cfree
+{
+    static constexpr auto name = "tc_cfree";
+    static constexpr auto original = &::tc_cfree;
+
+    static void hook(void* ptr) noexcept
+    {
+        heaptrack_free(ptr);
+        original(ptr);
+    }
+};
+
+struct tc_memalign
+{
+    static constexpr auto name = "tc_memalign";
+    static constexpr auto original = &::tc_memalign;
+
+    static void* hook(size_t alignment, size_t size) noexcept
+    {
+        auto ptr = original(alignment, size);
+        heaptrack_malloc_usable(ptr, size, usableSize);
+        return ptr;
+    }
+};
+
+struct tc_posix_memalign
+{
+    static constexpr auto name = "tc_posix_memalign";
+    static constexpr auto original = &::tc_posix_memalign;
+
+    static int hook(void** memptr, size_t alignment, size_t size) noexcept
+    {
+        auto ret = original(memptr, alignment, size);
+        if (!ret) {
+            heaptrack_malloc_usable(*memptr, size, usableSize);
+        }
+        return ret;
+    }
+};
+
+struct tc_valloc
+{
+    static constexpr auto name = "tc_valloc";
+    static constexpr auto original = &::tc_valloc;
+
+    static void* hook(size_t size) noexcept
+    {
+        auto ptr = original(size);
+        heaptrack_malloc_usable(ptr, size, usableSize);
+        return ptr;
+    }
+};
+
+struct tc_pvalloc
+{
+    static constexpr auto name = "tc_pvalloc";
+    static constexpr auto original = &::tc_pvalloc;
+
+    static void* hook(size_t size) noexcept
+    {
+        auto ptr = original(size);
+        heaptrack_malloc_usable(ptr, size, usableSize);
+        return ptr;
+    }
+};
+
+struct tc_new
+{
+    static constexpr auto name = "tc_new";
+    static constexpr auto original = &::tc_new;
+
+    static void* hook(size_t size)
+    {
+        auto ptr = original(size);
+        heaptrack_malloc_usable(ptr, size, usableSize);
+        return ptr;
+    }
+};
+
+struct tc_newarray
+{
+    static constexpr auto name = "tc_newarray";
+    static constexpr auto original = &::tc_newarray;
+
+    static void* hook(size_t size)
+    {
+        auto ptr = original(size);
+        heaptrack_malloc_usable(ptr, size, usableSize);
+        return ptr;
+    }
+};
+
+struct tc_new_nothrow
+{
+    static constexpr auto name = "tc_new_nothrow";
+    static constexpr auto original = &::tc_new_nothrow;
+
+    static void* hook(size_t size, const std::nothrow_t& tag) noexcept
+    {
+        auto ptr = original(size, tag);
+        heaptrack_malloc_usable(ptr, size, usableSize);
+        return ptr;
+    }
+};
+
+struct tc_newarray_nothrow
+{
+    static constexpr auto name = "tc_newarray_nothrow";
+    static constexpr auto original = &::tc_newarray_nothrow;
+
+    static void* hook(size_t size, const std::nothrow_t& tag) noexcept
+    {
+        auto ptr = original(size, tag);
+        heaptrack_malloc_usable(ptr, size, usableSize);
+        return ptr;
+    }
+};
+
+struct tc_delete
+{
+    static constexpr auto name = "tc_delete";
+    static constexpr auto original = &::tc_delete;
+
+    static void hook(void* ptr) noexcept
+    {
+        heaptrack_free(ptr);
+        original(ptr);
+    }
+};
+
+struct tc_deletearray
+{
+    static constexpr auto name = "tc_deletearray";
+    static constexpr auto original = &::tc_deletearray;
+
+    static void hook(void* ptr) noexcept
+    {
+        heaptrack_free(ptr);
+        original(ptr);
+    }
+};
+
+struct tc_delete_sized
+{
+    static constexpr auto name = "tc_delete_sized";
+    static constexpr auto original = &::tc_delete_sized;
+
+    static void hook(void* ptr, size_t size) noexcept
+    {
+        heaptrack_free(ptr);
+        original(ptr, size);
+    }
+};
+
+struct tc_deletearray_sized
+{
+    static constexpr auto name = "tc_deletearray_sized";
+    static constexpr auto original = &::tc_deletearray_sized;
+
+    static void hook(void* ptr, size_t size) noexcept
+    {
+        heaptrack_free(ptr);
+        original(ptr, size);
+    }
+};
+
+struct tc_delete_nothrow
+{
+    static constexpr auto name = "tc_delete_nothrow";
+    static constexpr auto original = &::tc_delete_nothrow;
+
+    static void hook(void* ptr, const std::nothrow_t& tag) noexcept
+    {
+        heaptrack_free(ptr);
+        original(ptr, tag);
+    }
+};
+
+struct tc_deletearray_nothrow
+{
+    static constexpr auto name = "tc_deletearray_nothrow";
+    static constexpr auto original = &::tc_deletearray_nothrow;
+
+    static void hook(void* ptr, const std::nothrow_t& tag) noexcept
+    {
+        heaptrack_free(ptr);
+        original(ptr, tag);
+    }
+};
+
+// operator new and delete, including the sized and aligned variants
+struct operator_new
+{
+    static constexpr auto name = "_Znw" SIZE_T_MANGLING;
+    static constexpr auto original = static_cast<void* (*)(size_t)>(&::operator new);
+
+    static void* hook(size_t size)
+    {
+        return recordNew(original, usableSize, size);
+    }
+};
+
+struct operator_new_array
+{
+    static constexpr auto name = "_Zna" SIZE_T_MANGLING;
+    static constexpr auto original = static_cast<void* (*)(size_t)>(&::operator new[]);
+
+    static void* hook(size_t size)
+    {
+        return recordNew(original, usableSize, size);
+    }
+};
+
+struct operator_new_nothrow
+{
+    static constexpr auto name = "_Znw" SIZE_T_MANGLING "RKSt9nothrow_t";
+    static constexpr auto original = static_cast<void* (*)(size_t, const std::nothrow_t&) noexcept>(&::operator new);
+
+    static void* hook(size_t size, const std::nothrow_t& tag) noexcept
+    {
+        return recordNew(original, usableSize, size, tag);
+    }
+};
+
+struct operator_new_array_nothrow
+{
+    static constexpr auto name = "_Zna" SIZE_T_MANGLING "RKSt9nothrow_t";
+    static constexpr auto original =
+        static_cast<void* (*)(size_t, const std::nothrow_t&) noexcept>(&::operator new[]);
+
+    static void* hook(size_t size, const std::nothrow_t& tag) noexcept
+    {
+        return recordNew(original, usableSize, size, tag);
+    }
+};
+
+struct operator_delete
+{
+    static constexpr auto name = "_ZdlPv";
+    static constexpr auto original = static_cast<void (*)(void*) noexcept>(&::operator delete);
+
+    static void hook(void* ptr) noexcept
+    {
+        recordDelete(original, ptr);
+    }
+};
+
+struct operator_delete_array
+{
+    static constexpr auto name = "_ZdaPv";
+    static constexpr auto original = static_cast<void (*)(void*) noexcept>(&::operator delete[]);
+
+    static void hook(void* ptr) noexcept
+    {
+        recordDelete(original, ptr);
+    }
+};
+
+struct operator_delete_nothrow
+{
+    static constexpr auto name = "_ZdlPvRKSt9nothrow_t";
+    static constexpr auto original = static_cast<void (*)(void*, const std::nothrow_t&) noexcept>(&::operator delete);
+
+    static void hook(void* ptr, const std::nothrow_t& tag) noexcept
+    {
+        recordDelete(original, ptr, tag);
+    }
+};
+
+struct operator_delete_array_nothrow
+{
+    static constexpr auto name = "_ZdaPvRKSt9nothrow_t";
+    static constexpr auto original =
+        static_cast<void (*)(void*, const std::nothrow_t&) noexcept>(&::operator delete[]);
+
+    static void hook(void* ptr, const std::nothrow_t& tag) noexcept
+    {
+        recordDelete(original, ptr, tag);
+    }
+};
+
+#if __cpp_sized_deallocation
+struct operator_delete_sized
+{
+    static constexpr auto name = "_ZdlPv" SIZE_T_MANGLING;
+    static constexpr auto original = static_cast<void (*)(void*, size_t) noexcept>(&::operator delete);
+
+    static void hook(void* ptr, size_t size) noexcept
+    {
+        recordDelete(original, ptr, size);
+    }
+};
+
+struct operator_delete_array_sized
+{
+    static constexpr auto name = "_ZdaPv" SIZE_T_MANGLING;
+    static constexpr auto original = static_cast<void (*)(void*, size_t) noexcept>(&::operator delete[]);
+
+    static void hook(void* ptr, size_t size) noexcept
+    {
+        recordDelete(original, ptr, size);
+    }
+};
+#endif
+
+#if __cpp_aligned_new
+struct operator_new_aligned
+{
+    static constexpr auto name = "_Znw" SIZE_T_MANGLING "St11align_val_t";
+    static constexpr auto original = static_cast<void* (*)(size_t, std::align_val_t)>(&::operator new);
+
+    static void* hook(size_t size, std::align_val_t alignment)
+    {
+        return recordNew(original, usableSize, size, alignment);
+    }
+};
+
+struct operator_new_array_aligned
+{
+    static constexpr auto name = "_Zna" SIZE_T_MANGLING "St11align_val_t";
+    static constexpr auto original = static_cast<void* (*)(size_t, std::align_val_t)>(&::operator new[]);
+
+    static void* hook(size_t size, std::align_val_t alignment)
+    {
+        return recordNew(original, usableSize, size, alignment);
+    }
+};
+
+struct operator_new_aligned_nothrow
+{
+    static constexpr auto name = "_Znw" SIZE_T_MANGLING "St11align_val_tRKSt9nothrow_t";
+    static constexpr auto original =
+        static_cast<void* (*)(size_t, std::align_val_t, const std::nothrow_t&) noexcept>(&::operator new);
+
+    static void* hook(size_t size, std::align_val_t alignment, const std::nothrow_t& tag) noexcept
+    {
+        return recordNew(original, usableSize, size, alignment, tag);
+    }
+};
+
+struct operator_new_array_aligned_nothrow
+{
+    static constexpr auto name = "_Zna" SIZE_T_MANGLING "St11align_val_tRKSt9nothrow_t";
+    static constexpr auto original =
+        static_cast<void* (*)(size_t, std::align_val_t, const std::nothrow_t&) noexcept>(&::operator new[]);
+
+    static void* hook(size_t size, std::align_val_t alignment, const std::nothrow_t& tag) noexcept
+    {
+        return recordNew(original, usableSize, size, alignment, tag);
+    }
+};
+
+struct operator_delete_aligned
+{
+    static constexpr auto name = "_ZdlPvSt11align_val_t";
+    static constexpr auto original = static_cast<void (*)(void*, std::align_val_t) noexcept>(&::operator delete);
+
+    static void hook(void* ptr, std::align_val_t alignment) noexcept
+    {
+        recordDelete(original, ptr, alignment);
+    }
+};
+
+struct operator_delete_array_aligned
+{
+    static constexpr auto name = "_ZdaPvSt11align_val_t";
+    static constexpr auto original = static_cast<void (*)(void*, std::align_val_t) noexcept>(&::operator delete[]);
+
+    static void hook(void* ptr, std::align_val_t alignment) noexcept
+    {
+        recordDelete(original, ptr, alignment);
+    }
+};
+
+struct operator_delete_aligned_nothrow
+{
+    static constexpr auto name = "_ZdlPvSt11align_val_tRKSt9nothrow_t";
+    static constexpr auto original =
+        static_cast<void (*)(void*, std::align_val_t, const std::nothrow_t&) noexcept>(&::operator delete);
+
+    static void hook(void* ptr, std::align_val_t alignment, const std::nothrow_t& tag) noexcept
+    {
+        recordDelete(original, ptr, alignment, tag);
+    }
+};
+
+struct operator_delete_array_aligned_nothrow
+{
+    static constexpr auto name = "_ZdaPvSt11align_val_tRKSt9nothrow_t";
+    static constexpr auto original =
+        static_cast<void (*)(void*, std::align_val_t, const std::nothrow_t&) noexcept>(&::operator delete[]);
+
+    static void hook(void* ptr, std::align_val_t alignment, const std::nothrow_t& tag) noexcept
+    {
+        recordDelete(original, ptr, alignment, tag);
+    }
+};
+
+#if __cpp_sized_deallocation
+struct operator_delete_sized_aligned
+{
+    static constexpr auto name = "_ZdlPv" SIZE_T_MANGLING "St11align_val_t";
+    static constexpr auto original =
+        static_cast<void (*)(void*, size_t, std::align_val_t) noexcept>(&::operator delete);
+
+    static void hook(void* ptr, size_t size, std::align_val_t alignment) noexcept
+    {
+        recordDelete(original, ptr, size, alignment);
+    }
+};
+
+struct operator_delete_array_sized_aligned
+{
+    static constexpr auto name = "_ZdaPv" SIZE_T_MANGLING "St11align_val_t";
+    static constexpr auto original =
+        static_cast<void (*)(void*, size_t, std::align_val_t) noexcept>(&::operator delete[]);
+
+    static void hook(void* ptr, size_t size, std::align_val_t alignment) noexcept
+    {
+        recordDelete(original, ptr, size, alignment);
+    }
+};
+#endif
+#endif
+
 template <typename Hook>
 bool hook(const char* symname, Elf::Addr addr, bool restore)
 {
@@ -370,7 +982,48 @@ void apply(const char* symname, Elf::Addr addr, bool restore)
         || hook<mi_realloc>(symname, addr, restore) || hook<mi_calloc>(symname, addr, restore)
         // bdwgc functions
         || hook<GC_malloc>(symname, addr, restore) || hook<GC_free_profiler_hook>(symname, addr, restore)
-        || hook<GC_realloc>(symname, addr, restore) || hook<GC_posix_memalign>(symname, addr, restore);
+        || hook<GC_realloc>(symname, addr, restore) || hook<GC_posix_memalign>(symname, addr, restore)
+        // jemalloc functions
+        || hook<mallocx>(symname, addr, restore) || hook<rallocx>(symname, addr, restore)
+        || hook<xallocx>(symname, addr, restore) || hook<dallocx>(symname, addr, restore)
+        || hook<sdallocx>(symname, addr, restore)
+        // tcmalloc functions
+        || hook<tc_malloc>(symname, addr, restore) || hook<tc_malloc_skip_new_handler>(symname, addr, restore)
+        || hook<tc_free>(symname, addr, restore) || hook<tc_free_sized>(symname, addr, restore)
+        || hook<tc_realloc>(symname, addr, restore) || hook<tc_calloc>(symname, addr, restore)
+        || hook<tc_cfree>(symname, addr, restore) || hook<tc_memalign>(symname, addr, restore)
+        || hook<tc_posix_memalign>(symname, addr, restore) || hook<tc_valloc>(symname, addr, restore)
+        || hook<tc_pvalloc>(symname, addr, restore) || hook<tc_new>(symname, addr, restore)
+        || hook<tc_newarray>(symname, addr, restore) || hook<tc_new_nothrow>(symname, addr, restore)
+        || hook<tc_newarray_nothrow>(symname, addr, restore) || hook<tc_delete>(symname, addr, restore)
+        || hook<tc_deletearray>(symname, addr, restore) || hook<tc_delete_sized>(symname, addr, restore)
+        || hook<tc_deletearray_sized>(symname, addr, restore) || hook<tc_delete_nothrow>(symname, addr, restore)
+        || hook<tc_deletearray_nothrow>(symname, addr, restore)
+        // operator new and delete
+        || hook<operator_new>(symname, addr, restore) || hook<operator_new_array>(symname, addr, restore)
+        || hook<operator_new_nothrow>(symname, addr, restore)
+        || hook<operator_new_array_nothrow>(symname, addr, restore) || hook<operator_delete>(symname, addr, restore)
+        || hook<operator_delete_array>(symname, addr, restore) || hook<operator_delete_nothrow>(symname, addr, restore)
+        || hook<operator_delete_array_nothrow>(symname, addr, restore)
+#if __cpp_sized_deallocation
+        || hook<operator_delete_sized>(symname, addr, restore)
+        || hook<operator_delete_array_sized>(symname, addr, restore)
+#endif
+#if __cpp_aligned_new
+        || hook<operator_new_aligned>(symname, addr, restore)
+        || hook<operator_new_array_aligned>(symname, addr, restore)
+        || hook<operator_new_aligned_nothrow>(symname, addr, restore)
+        || hook<operator_new_array_aligned_nothrow>(symname, addr, restore)
+        || hook<operator_delete_aligned>(symname, addr, restore)
+        || hook<operator_delete_array_aligned>(symname, addr, restore)
+        || hook<operator_delete_aligned_nothrow>(symname, addr, restore)
+        || hook<operator_delete_array_aligned_nothrow>(symname, addr, restore)
+#if __cpp_sized_deallocation
+        || hook<operator_delete_sized_aligned>(symname, addr, restore)
+        || hook<operator_delete_array_sized_aligned>(symname, addr, restore)
+#endif
+#endif
+        ;
 }
 }
 
@@ -4,6 +4,7 @@
     SPDX-License-Identifier: LGPL-2.1-or-later
 */
 
+#include "cxxhooks.h"
 #include "libheaptrack.h"
 #include "util/config.h"
 
@@ -14,8 +15,13 @@
 #include <unistd.h>
 
 #include <atomic>
+#include <new>
 #include <type_traits>
 
+#if HAVE_MALLOC_USABLE_SIZE
+#include <malloc.h>
+#endif
+
 using namespace std;
 
 #if defined(_ISOC11_SOURCE)
@@ -44,6 +50,36 @@ void* GC_malloc(size_t size) LIBC_FUN_ATTRS;
 void* GC_realloc(void* p, size_t newsize) LIBC_FUN_ATTRS;
 void GC_free_profiler_hook(void* p) LIBC_FUN_ATTRS;
 int GC_posix_memalign(void** memptr, size_t alignment, size_t size) LIBC_FUN_ATTRS;
+
+// Forward declare the non-standard API of jemalloc (https://jemalloc.net)
+void* mallocx(size_t size, int flags) LIBC_FUN_ATTRS;
+void* rallocx(void* ptr, size_t size, int flags) LIBC_FUN_ATTRS;
+size_t xallocx(void* ptr, size_t size, size_t extra, int flags) LIBC_FUN_ATTRS;
+void dallocx(void* ptr, int flags) LIBC_FUN_ATTRS;
+void sdallocx(void* ptr, size_t size, int flags) LIBC_FUN_ATTRS;
+
+// Forward declare the API of gperftools tcmalloc (https://github.com/gperftools/gperftools)
+void* tc_malloc(size_t size) LIBC_FUN_ATTRS;
+void* tc_malloc_skip_new_handler(size_t size) LIBC_FUN_ATTRS;
+void tc_free(void* ptr) LIBC_FUN_ATTRS;
+void tc_free_sized(void* ptr, size_t size) LIBC_FUN_ATTRS;
+void* tc_realloc(void* ptr, size_t size) LIBC_FUN_ATTRS;
+void* tc_calloc(size_t count, size_t size) LIBC_FUN_ATTRS;
+void tc_cfree(void* ptr) LIBC_FUN_ATTRS;
+void* tc_memalign(size_t alignment, size_t size) LIBC_FUN_ATTRS;
+int tc_posix_memalign(void** memptr, size_t alignment, size_t size) LIBC_FUN_ATTRS;
+void* tc_valloc(size_t size) LIBC_FUN_ATTRS;
+void* tc_pvalloc(size_t size) LIBC_FUN_ATTRS;
+void* tc_new(size_t size);
+void* tc_newarray(size_t size);
+void* tc_new_nothrow(size_t size, const std::nothrow_t&) LIBC_FUN_ATTRS;
+void* tc_newarray_nothrow(size_t size, const std::nothrow_t&) LIBC_FUN_ATTRS;
+void tc_delete(void* ptr) LIBC_FUN_ATTRS;
+void tc_deletearray(void* ptr) LIBC_FUN_ATTRS;
+void tc_delete_sized(void* ptr, size_t size) LIBC_FUN_ATTRS;
+void tc_deletearray_sized(void* ptr, size_t size) LIBC_FUN_ATTRS;
+void tc_delete_nothrow(void* ptr, const std::nothrow_t&) LIBC_FUN_ATTRS;
+void tc_deletearray_nothrow(void* ptr, const std::nothrow_t&) LIBC_FUN_ATTRS;
 }
 
 namespace {
@@ -122,9 +158,91 @@ HOOK(GC_malloc, HookType::Optional);
 HOOK(GC_realloc, HookType::Optional);
 HOOK(GC_free_profiler_hook, HookType::Optional);
 HOOK(GC_posix_memalign, HookType::Optional);
+
+// jemalloc functions
+HOOK(mallocx, HookType::Optional);
+HOOK(rallocx, HookType::Optional);
+HOOK(xallocx, HookType::Optional);
+HOOK(dallocx, HookType::Optional);
+HOOK(sdallocx, HookType::Optional);
+
+// tcmalloc functions
+HOOK(tc_malloc, HookType::Optional);
+HOOK(tc_malloc_skip_new_handler, HookType::Optional);
+HOOK(tc_free, HookType::Optional);
+HOOK(tc_free_sized, HookType::Optional);
+HOOK(tc_realloc, HookType::Optional);
+HOOK(tc_calloc, HookType::Optional);
+HOOK(tc_cfree, HookType::Optional);
+HOOK(tc_memalign, HookType::Optional);
+HOOK(tc_posix_memalign, HookType::Optional);
+HOOK(tc_valloc, HookType::Optional);
+HOOK(tc_pvalloc, HookType::Optional);
+HOOK(tc_new, HookType::Optional);
+HOOK(tc_newarray, HookType::Optional);
+HOOK(tc_new_nothrow, HookType::Optional);
+HOOK(tc_newarray_nothrow, HookType::Optional);
+HOOK(tc_delete, HookType::Optional);
+HOOK(tc_deletearray, HookType::Optional);
+HOOK(tc_delete_sized, HookType::Optional);
+HOOK(tc_deletearray_sized, HookType::Optional);
+HOOK(tc_delete_nothrow, HookType::Optional);
+HOOK(tc_deletearray_nothrow, HookType::Optional);
 #pragma GCC diagnostic pop
 #undef HOOK
 
+// operator new and delete, which we cannot refer to by name
+#define CXX_HOOK(name, signature, mangledName, type)                                                                   \
+    struct name##_t : public hook<signature, name##_t, type>                                                           \
+    {                                                                                                                  \
+        static constexpr const char* identifier = mangledName;                                                         \
+    } name
+
+using new_t = void* (*)(size_t);
+using new_nothrow_t = void* (*)(size_t, const std::nothrow_t&) noexcept;
+using delete_t = void (*)(void*) noexcept;
+using delete_sized_t = void (*)(void*, size_t) noexcept;
+using delete_nothrow_t = void (*)(void*, const std::nothrow_t&) noexcept;
+
+CXX_HOOK(operator_new, new_t, "_Znw" SIZE_T_MANGLING, HookType::Required);
+CXX_HOOK(operator_new_array, new_t, "_Zna" SIZE_T_MANGLING, HookType::Required);
+CXX_HOOK(operator_new_nothrow, new_nothrow_t, "_Znw" SIZE_T_MANGLING "RKSt9nothrow_t", HookType::Required);
+CXX_HOOK(operator_new_array_nothrow, new_nothrow_t, "_Zna" SIZE_T_MANGLING "RKSt9nothrow_t", HookType::Required);
+CXX_HOOK(operator_delete, delete_t, "_ZdlPv", HookType::Required);
+CXX_HOOK(operator_delete_array, delete_t, "_ZdaPv", HookType::Required);
+CXX_HOOK(operator_delete_nothrow, delete_nothrow_t, "_ZdlPvRKSt9nothrow_t", HookType::Required);
+CXX_HOOK(operator_delete_array_nothrow, delete_nothrow_t, "_ZdaPvRKSt9nothrow_t", HookType::Required);
+// only available since GCC 5, we fall back to the unsized variants otherwise
+CXX_HOOK(operator_delete_sized, delete_sized_t, "_ZdlPv" SIZE_T_MANGLING, HookType::Optional);
+CXX_HOOK(operator_delete_array_sized, delete_sized_t, "_ZdaPv" SIZE_T_MANGLING, HookType::Optional);
+
+#if __cpp_aligned_new
+using new_aligned_t = void* (*)(size_t, std::align_val_t);
+using new_aligned_nothrow_t = void* (*)(size_t, std::align_val_t, const std::nothrow_t&) noexcept;
+using delete_aligned_t = void (*)(void*, std::align_val_t) noexcept;
+using delete_sized_aligned_t = void (*)(void*, size_t, std::align_val_t) noexcept;
+using delete_aligned_nothrow_t = void (*)(void*, std::align_val_t, const std::nothrow_t&) noexcept;
+
+// only available since GCC 7, which any program that calls them requires
+CXX_HOOK(operator_new_aligned, new_aligned_t, "_Znw" SIZE_T_MANGLING "St11align_val_t", HookType::Optional);
+CXX_HOOK(operator_new_array_aligned, new_aligned_t, "_Zna" SIZE_T_MANGLING "St11align_val_t", HookType::Optional);
+CXX_HOOK(operator_new_aligned_nothrow, new_aligned_nothrow_t, "_Znw" SIZE_T_MANGLING "St11align_val_tRKSt9nothrow_t",
+         HookType::Optional);
+CXX_HOOK(operator_new_array_aligned_nothrow, new_aligned_nothrow_t,
+         "_Zna" SIZE_T_MANGLING "St11align_val_tRKSt9nothrow_t", HookType::Optional);
+CXX_HOOK(operator_delete_aligned, delete_aligned_t, "_ZdlPvSt11align_val_t", HookType::Optional);
+CXX_HOOK(operator_delete_array_aligned, delete_aligned_t, "_ZdaPvSt11align_val_t", HookType::Optional);
+CXX_HOOK(operator_delete_sized_aligned, delete_sized_aligned_t, "_ZdlPv" SIZE_T_MANGLING "St11align_val_t",
+         HookType::Optional);
+CXX_HOOK(operator_delete_array_sized_aligned, delete_sized_aligned_t, "_ZdaPv" SIZE_T_MANGLING "St11align_val_t",
+         HookType::Optional);
+CXX_HOOK(operator_delete_aligned_nothrow, delete_aligned_nothrow_t, "_ZdlPvSt11align_val_tRKSt9nothrow_t",
+         HookType::Optional);
+CXX_HOOK(operator_delete_array_aligned_nothrow, delete_aligned_nothrow_t, "_ZdaPvSt11align_val_tRKSt9nothrow_t",
+         HookType::Optional);
+#endif
+#undef CXX_HOOK
+
 /**
  * Dummy implementation, since the call to dlsym from findReal triggers a call
  * to calloc.
@@ -206,12 +324,91 @@ void init()
             hooks::GC_free_profiler_hook.init();
             hooks::GC_posix_memalign.init();
 
+            // jemalloc functions
+            hooks::mallocx.init();
+            hooks::rallocx.init();
+            hooks::xallocx.init();
+            hooks::dallocx.init();
+            hooks::sdallocx.init();
+
+            // tcmalloc functions
+            hooks::tc_malloc.init();
+            hooks::tc_malloc_skip_new_handler.init();
+            hooks::tc_free.init();
+            hooks::tc_free_sized.init();
+            hooks::tc_realloc.init();
+            hooks::tc_calloc.init();
+            hooks::tc_cfree.init();
+            hooks::tc_memalign.init();
+            hooks::tc_posix_memalign.init();
+            hooks::tc_valloc.init();
+            hooks::tc_pvalloc.init();
+            hooks::tc_new.init();
+            hooks::tc_newarray.init();
+            hooks::tc_new_nothrow.init();
+            hooks::tc_newarray_nothrow.init();
+            hooks::tc_delete.init();
+            hooks::tc_deletearray.init();
+            hooks::tc_delete_sized.init();
+            hooks::tc_deletearray_sized.init();
+            hooks::tc_delete_nothrow.init();
+            hooks::tc_deletearray_nothrow.init();
+
+            // operator new and delete
+            hooks::operator_new.init();
+            hooks::operator_new_array.init();
+            hooks::operator_new_nothrow.init();
+            hooks::operator_new_array_nothrow.init();
+            hooks::operator_delete.init();
+            hooks::operator_delete_array.init();
+            hooks::operator_delete_nothrow.init();
+            hooks::operator_delete_array_nothrow.init();
+            hooks::operator_delete_sized.init();
+            hooks::operator_delete_array_sized.init();
+#if __cpp_aligned_new
+            hooks::operator_new_aligned.init();
+            hooks::operator_new_array_aligned.init();
+            hooks::operator_new_aligned_nothrow.init();
+            hooks::operator_new_array_aligned_nothrow.init();
+            hooks::operator_delete_aligned.init();
+            hooks::operator_delete_array_aligned.init();
+            hooks::operator_delete_sized_aligned.init();
+            hooks::operator_delete_array_sized_aligned.init();
+            hooks::operator_delete_aligned_nothrow.init();
+            hooks::operator_delete_array_aligned_nothrow.init();
+#endif
+
             // cleanup environment to prevent tracing of child apps
             unsetenv("LD_PRELOAD");
             unsetenv("DUMP_HEAPTRACK_OUTPUT");
         },
         nullptr, nullptr);
 }
+
+void ensureInitialized()
+{
+    if (!hooks::malloc) {
+        hooks::init();
+    }
+}
+
+/// queries the usable size of the allocations of the libc functions, see HEAPTRACK_USABLE_SIZE
+#if HAVE_MALLOC_USABLE_SIZE
+const heaptrack_usable_size_t usableSize = &::malloc_usable_size;
+#else
+const heaptrack_usable_size_t usableSize = nullptr;
+#endif
+
+/// the original function of an optional hook, which must be available once the hook gets called
+template <typename Hook>
+auto requireOriginal(const Hook& hook) noexcept -> decltype(hook.original)
+{
+    if (!hook) {
+        fprintf(stderr, "Could not find original function %s\n", Hook::identifier);
+        abort();
+    }
+    return hook.original;
+}
 }
 }
 
@@ -226,7 +423,7 @@ void* malloc(size_t size) LIBC_FUN_ATTRS
     }
 
     void* ptr = hooks::malloc(size);
-    heaptrack_malloc(ptr, size);
+    heaptrack_malloc_usable(ptr, size, hooks::usableSize);
     return ptr;
 }
 
@@ -257,7 +454,7 @@ void* realloc(void* ptr, size_t size) LIBC_FUN_ATTRS
     void* ret = hooks::realloc(ptr, size);
 
     if (ret) {
-        heaptrack_realloc(ptr, size, ret);
+        heaptrack_realloc_usable(ptr, size, ret, hooks::usableSize);
     }
 
     return ret;
@@ -272,7 +469,7 @@ void* calloc(size_t num, size_t size) LIBC_FUN_ATTRS
     void* ret = hooks::calloc(num, size);
 
     if (ret) {
-        heaptrack_malloc(ret, num * size);
+        heaptrack_malloc_usable(ret, num * size, hooks::usableSize);
     }
 
     return ret;
@@ -305,7 +502,7 @@ int posix_memalign(void** memptr, size_t alignment, size_t size) LIBC_FUN_ATTRS
     int ret = hooks::posix_memalign(memptr, alignment, size);
 
     if (!ret) {
-        heaptrack_malloc(*memptr, size);
+        heaptrack_malloc_usable(*memptr, size, hooks::usableSize);
     }
 
     return ret;
@@ -321,7 +518,7 @@ void* aligned_alloc(size_t alignment, size_t size) LIBC_FUN_ATTRS
     void* ret = hooks::aligned_alloc(alignment, size);
 
     if (ret) {
-        heaptrack_malloc(ret, size);
+        heaptrack_malloc_usable(ret, size, hooks::usableSize);
     }
 
     return ret;
@@ -338,7 +535,7 @@ void* valloc(size_t size) LIBC_FUN_ATTRS
     void* ret = hooks::valloc(size);
 
     if (ret) {
-        heaptrack_malloc(ret, size);
+        heaptrack_malloc_usable(ret, size, hooks::usableSize);
     }
 
     return ret;
@@ -502,4 +699,440 @@ int GC_posix_memalign(void** memptr, size_t alignment, size_t size) LIBC_FUN_ATT
     return ret;
 }
 
+// jemalloc functions
+
+void* mallocx(size_t size, int flags) LIBC_FUN_ATTRS
+{
+    if (!hooks::mallocx) {
+        hooks::init();
+    }
+
+    void* ptr = hooks::mallocx(size, flags);
+    heaptrack_malloc_usable(ptr, size, hooks::usableSize);
+    return ptr;
+}
+
+void* rallocx(void* ptr, size_t size, int flags) LIBC_FUN_ATTRS
+{
+    if (!hooks::rallocx) {
+        hooks::init();
+    }
+
+    void* ret = hooks::rallocx(ptr, size, flags);
+
+    if (ret) {
+        heaptrack_realloc_usable(ptr, size, ret, hooks::usableSize);
+    }
+
+    return ret;
+}
+
+size_t xallocx(void* ptr, size_t size, size_t extra, int flags) LIBC_FUN_ATTRS
+{
+    if (!hooks::xallocx) {
+        hooks::init();
+    }
+
+    // resizes in place, the result is the new usable size which is smaller than the requested one on failure
+    size_t ret = hooks::xallocx(ptr, size, extra, flags);
+
+    if (ret >= size) {
+        heaptrack_realloc_usable(ptr, ret, ptr, hooks::usableSize);
+    }
+
+    return ret;
+}
+
+void dallocx(void* ptr, int flags) LIBC_FUN_ATTRS
+{
+    if (!hooks::dallocx) {
+        hooks::init();
+    }
+
+    heaptrack_free(ptr);
+    hooks::dallocx(ptr, flags);
+}
+
+void sdallocx(void* ptr, size_t size, int flags) LIBC_FUN_ATTRS
+{
+    if (!hooks::sdallocx) {
+        hooks::init();
+    }
+
+    heaptrack_free(ptr);
+    hooks::sdallocx(ptr, size, flags);
+}
+
+// tcmalloc functions
+
+void* tc_malloc(size_t size) LIBC_FUN_ATTRS
+{
+    if (!hooks::tc_malloc) {
+        hooks::init();
+    }
+
+    void* ptr = hooks::tc_malloc(size);
+    heaptrack_malloc_usable(ptr, size, hooks::usableSize);
+    return ptr;
+}
+
+void* tc_malloc_skip_new_handler(size_t size) LIBC_FUN_ATTRS
+{
+    if (!hooks::tc_malloc_skip_new_handler) {
+        hooks::init();
+    }
+
+    void* ptr = hooks::tc_malloc_skip_new_handler(size);
+    heaptrack_malloc_usable(ptr, size, hooks::usableSize);
+    return ptr;
+}
+
+void tc_free(void* ptr) LIBC_FUN_ATTRS
+{
+    if (!hooks::tc_free) {
+        hooks::init();
+    }
+
+    heaptrack_free(ptr);
+    hooks::tc_free(ptr);
+}
+
+void tc_free_sized(void* ptr, size_t size) LIBC_FUN_ATTRS
+{
+    if (!hooks::tc_free_sized) {
+        hooks::init();
+    }
+
+    heaptrack_free(ptr);
+    hooks::tc_free_sized(ptr, size);
+}
+
+void* tc_realloc(void* ptr, size_t size) LIBC_FUN_ATTRS
+{
+    if (!hooks::tc_realloc) {
+        hooks::init();
+    }
+
+    void* ret = hooks::tc_realloc(ptr, size);
+
+    if (ret) {
+        heaptrack_realloc_usable(ptr, size, ret, hooks::usableSize);
+    }
+
+    return ret;
+}
+
+void* tc_calloc(size_t num, size_t size) LIBC_FUN_ATTRS
+{
+    if (!hooks::tc_calloc) {
+        hooks::init();
+    }
+
+    void* ptr = hooks::tc_calloc(num, size);
+    heaptrack_malloc_usable(ptr, num * size, hooks::usableSize);
+    return ptr;
+}
+
+void tc_cfree(void* ptr) LIBC_FUN_ATTRS
+{
+    if (!hooks::tc_cfree) {
+        hooks::init();
+    }
+
+    heaptrack_free(ptr);
+    hooks::tc_cfree(ptr);
+}
+
+void* tc_memalign(size_t alignment, size_t size) LIBC_FUN_ATTRS
+{
+    if (!hooks::tc_memalign) {
+        hooks::init();
+    }
+
+    void* ptr = hooks::tc_memalign(alignment, size);
+    heaptrack_malloc_usable(ptr, size, hooks::usableSize);
+    return ptr;
+}
+
+int tc_posix_memalign(void** memptr, size_t alignment, size_t size) LIBC_FUN_ATTRS
+{
+    if (!hooks::tc_posix_memalign) {
+        hooks::init();
+    }
+
+    int ret = hooks::tc_posix_memalign(memptr, alignment, size);
+
+    if (!ret) {
+        heaptrack_malloc_usable(*memptr, size, hooks::usableSize);
+    }
+
+    return ret;
+}
+
+void* tc_valloc(size_t size) LIBC_FUN_ATTRS
+{
+    if (!hooks::tc_valloc) {
+        hooks::init();
+    }
+
+    void* ptr = hooks::tc_valloc(size);
+    heaptrack_malloc_usable(ptr, size, hooks::usableSize);
+    return ptr;
+}
+
+void* tc_pvalloc(size_t size) LIBC_FUN_ATTRS
+{
+    if (!hooks::tc_pvalloc) {
+        hooks::init();
+    }
+
+    void* ptr = hooks::tc_pvalloc(size);
+    heaptrack_malloc_usable(ptr, size, hooks::usableSize);
+    return ptr;
+}
+
+void* tc_new(size_t size)
+{
+    if (!hooks::tc_new) {
+        hooks::init();
+    }
+
+    // this throws on failure, which the noexcept call operator of the hook would not allow
+    void* ptr = hooks::tc_new.original(size);
+    heaptrack_malloc_usable(ptr, size, hooks::usableSize);
+    return ptr;
+}
+
+void* tc_newarray(size_t size)
+{
+    if (!hooks::tc_newarray) {
+        hooks::init();
+    }
+
+    // this throws on failure, which the noexcept call operator of the hook would not allow
+    void* ptr = hooks::tc_newarray.original(size);
+    heaptrack_malloc_usable(ptr, size, hooks::usableSize);
+    return ptr;
+}
+
+void* tc_new_nothrow(size_t size, const std::nothrow_t& tag) LIBC_FUN_ATTRS
+{
+    if (!hooks::tc_new_nothrow) {
+        hooks::init();
+    }
+
+    void* ptr = hooks::tc_new_nothrow(size, tag);
+    heaptrack_malloc_usable(ptr, size, hooks::usableSize);
+    return ptr;
+}
+
+void* tc_newarray_nothrow(size_t size, const std::nothrow_t& tag) LIBC_FUN_ATTRS
+{
+    if (!hooks::tc_newarray_nothrow) {
+        hooks::init();
+    }
+
+    void* ptr = hooks::tc_newarray_nothrow(size, tag);
+    heaptrack_malloc_usable(ptr, size, hooks::usableSize);
+    return ptr;
+}
+
+void tc_delete(void* ptr) LIBC_FUN_ATTRS
+{
+    if (!hooks::tc_delete) {
+        hooks::init();
+    }
+
+    heaptrack_free(ptr);
+    hooks::tc_delete(ptr);
+}
+
+void tc_deletearray(void* ptr) LIBC_FUN_ATTRS
+{
+    if (!hooks::tc_deletearray) {
+        hooks::init();
+    }
+
+    heaptrack_free(ptr);
+    hooks::tc_deletearray(ptr);
+}
+
+void tc_delete_sized(void* ptr, size_t size) LIBC_FUN_ATTRS
+{
+    if (!hooks::tc_delete_sized) {
+        hooks::init();
+    }
+
+    heaptrack_free(ptr);
+    hooks::tc_delete_sized(ptr, size);
+}
+
+void tc_deletearray_sized(void* ptr, size_t size) LIBC_FUN_ATTRS
+{
+    if (!hooks::tc_deletearray_sized) {
+        hooks::init();
+    }
+
+    heaptrack_free(ptr);
+    hooks::tc_deletearray_sized(ptr, size);
+}
+
+void tc_delete_nothrow(void* ptr, const std::nothrow_t& tag) LIBC_FUN_ATTRS
+{
+    if (!hooks::tc_delete_nothrow) {
+        hooks::init();
+    }
+
+    heaptrack_free(ptr);
+    hooks::tc_delete_nothrow(ptr, tag);
+}
+
+void tc_deletearray_nothrow(void* ptr, const std::nothrow_t& tag) LIBC_FUN_ATTRS
+{
+    if (!hooks::tc_deletearray_nothrow) {
+        hooks::init();
+    }
+
+    heaptrack_free(ptr);
+    hooks::tc_deletearray_nothrow(ptr, tag);
+}
+
 }
+
+// operator new and delete, including the sized and aligned variants, such that the backtraces don't
+// contain the frames of the C++ runtime and we don't have to filter them out when analyzing the data
+void* operator new(size_t size)
+{
+    hooks::ensureInitialized();
+    return recordNew(hooks::operator_new.original, hooks::usableSize, size);
+}
+
+void* operator new[](size_t size)
+{
+    hooks::ensureInitialized();
+    return recordNew(hooks::operator_new_array.original, hooks::usableSize, size);
+}
+
+void* operator new(size_t size, const std::nothrow_t& tag) noexcept
+{
+    hooks::ensureInitialized();
+    return recordNew(hooks::operator_new_nothrow.original, hooks::usableSize, size, tag);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept
+{
+    hooks::ensureInitialized();
+    return recordNew(hooks::operator_new_array_nothrow.original, hooks::usableSize, size, tag);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    hooks::ensureInitialized();
+    recordDelete(hooks::operator_delete.original, ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    hooks::ensureInitialized();
+    recordDelete(hooks::operator_delete_array.original, ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t& tag) noexcept
+{
+    hooks::ensureInitialized();
+    recordDelete(hooks::operator_delete_nothrow.original, ptr, tag);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t& tag) noexcept
+{
+    hooks::ensureInitialized();
+    recordDelete(hooks::operator_delete_array_nothrow.original, ptr, tag);
+}
+
+#if __cpp_sized_deallocation
+void operator delete(void* ptr, size_t size) noexcept
+{
+    hooks::ensureInitialized();
+    if (hooks::operator_delete_sized) {
+        recordDelete(hooks::operator_delete_sized.original, ptr, size);
+    } else {
+        recordDelete(hooks::operator_delete.original, ptr);
+    }
+}
+
+void operator delete[](void* ptr, size_t size) noexcept
+{
+    hooks::ensureInitialized();
+    if (hooks::operator_delete_array_sized) {
+        recordDelete(hooks::operator_delete_array_sized.original, ptr, size);
+    } else {
+        recordDelete(hooks::operator_delete_array.original, ptr);
+    }
+}
+#endif
+
+#if __cpp_aligned_new
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    hooks::ensureInitialized();
+    return recordNew(hooks::requireOriginal(hooks::operator_new_aligned), hooks::usableSize, size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    hooks::ensureInitialized();
+    return recordNew(hooks::requireOriginal(hooks::operator_new_array_aligned), hooks::usableSize, size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t& tag) noexcept
+{
+    hooks::ensureInitialized();
+    return recordNew(hooks::requireOriginal(hooks::operator_new_aligned_nothrow), hooks::usableSize, size, alignment,
+                     tag);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t& tag) noexcept
+{
+    hooks::ensureInitialized();
+    return recordNew(hooks::requireOriginal(hooks::operator_new_array_aligned_nothrow), hooks::usableSize, size,
+                     alignment, tag);
+}
+
+void operator delete(void* ptr, std::align_val_t alignment) noexcept
+{
+    hooks::ensureInitialized();
+    recordDelete(hooks::requireOriginal(hooks::operator_delete_aligned), ptr, alignment);
+}
+
+void operator delete[](void* ptr, std::align_val_t alignment) noexcept
+{
+    hooks::ensureInitialized();
+    recordDelete(hooks::requireOriginal(hooks::operator_delete_array_aligned), ptr, alignment);
+}
+
+void operator delete(void* ptr, std::align_val_t alignment, const std::nothrow_t& tag) noexcept
+{
+    hooks::ensureInitialized();
+    recordDelete(hooks::requireOriginal(hooks::operator_delete_aligned_nothrow), ptr, alignment, tag);
+}
+
+void operator delete[](void* ptr, std::align_val_t alignment, const std::nothrow_t& tag) noexcept
+{
+    hooks::ensureInitialized();
+    recordDelete(hooks::requireOriginal(hooks::operator_delete_array_aligned_nothrow), ptr, alignment, tag);
+}
+
+#if __cpp_sized_deallocation
+void operator delete(void* ptr, size_t size, std::align_val_t alignment) noexcept
+{
+    hooks::ensureInitialized();
+    recordDelete(hooks::requireOriginal(hooks::operator_delete_sized_aligned), ptr, size, alignment);
+}
+
+void operator delete[](void* ptr, size_t size, std::align_val_t alignment) noexcept
+{
+    hooks::ensureInitialized();
+    recordDelete(hooks::requireOriginal(hooks::operator_delete_array_sized_aligned), ptr, size, alignment);
+}
+#endif
+#endif
@@ -19,6 +19,7 @@
 #include <pthread.h>
 #include <signal.h>
 #ifdef __linux__
+#include <malloc.h>
 #include <stdio_ext.h>
 #include <syscall.h>
 #endif
@@ -30,20 +31,34 @@
 #include <sys/user.h>
 #endif
 #include <sys/file.h>
+#include <sys/stat.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cinttypes>
+#include <cmath>
+#include <cstddef>
 #include <memory>
 #include <mutex>
 #include <sstream>
 #include <string>
 #include <thread>
 
+#include "allocationaggregator.h"
+#include "eventbuffer.h"
+#include "flightrecorder.h"
+#include "livepointerfilter.h"
+#include "sampledpointers.h"
 #include "tracetree.h"
+#include "triggerrules.h"
 #include "util/config.h"
+#include "util/internalarena.h"
 #include "util/libunwind_config.h"
 #include "util/linewriter.h"
 #include "util/macroutils.h"
+#if ZSTD_FOUND
+#include "util/zstdstream.h"
+#endif
 
 extern "C" {
 // see upstream "documentation" at:
@@ -65,6 +80,16 @@ __attribute__((weak)) extern void __freeres();
 #include <tsl/robin_set.h>
 #endif
 
+// mallinfo2 reports the size of the heap without overflowing, see HEAPTRACK_TRIGGER_HEAP
+#if defined(__GLIBC__) && defined(__GLIBC_PREREQ)
+#if __GLIBC_PREREQ(2, 33)
+#define HAVE_MALLINFO2 1
+#endif
+#endif
+#ifndef HAVE_MALLINFO2
+#define HAVE_MALLINFO2 0
+#endif
+
 using namespace std;
 
 namespace {
@@ -248,6 +273,117 @@ int createFile(const char* fileName)
     return out;
 }
 
+bool envFlag(const char* name)
+{
+    const auto* value = getenv(name);
+    return value && value[0] && strcmp(value, "0") != 0;
+}
+
+uint64_t envNumber(const char* name, uint64_t defaultValue)
+{
+    const auto* value = getenv(name);
+    if (!value || !value[0]) {
+        return defaultValue;
+    }
+    char* end = nullptr;
+    const auto number = strtoull(value, &end, 10);
+    return *end ? defaultValue : number;
+}
+
+/**
+ * Parse the second field of /proc/self/statm, i.e. the RSS in pages.
+ * This runs on every tick of the timer thread, so we don't use sscanf.
+ */
+bool parseStatmRss(const char* statm, size_t* rss)
+{
+    auto* it = statm;
+    while (*it >= '0' && *it <= '9') {
+        ++it;
+    }
+    if (it == statm || *it != ' ') {
+        return false;
+    }
+    ++it;
+    if (*it < '0' || *it > '9') {
+        return false;
+    }
+    size_t value = 0;
+    while (*it >= '0' && *it <= '9') {
+        value = value * 10 + static_cast<size_t>(*it - '0');
+        ++it;
+    }
+    *rss = value;
+    return true;
+}
+
+/**
+ * Find the GNU build-id note of a loaded module and write it as a NUL terminated hex string into @p buffer.
+ * The notes are read from the mapped memory, so this works even when the file got replaced since.
+ *
+ * @return the length of the hex string, or zero when the module has no build-id that fits into the buffer
+ */
+size_t readBuildId(const struct dl_phdr_info* info, char* buffer, size_t bufferSize)
+{
+    auto align = [](size_t size, size_t alignment) { return (size + alignment - 1) & ~(alignment - 1); };
+    for (int i = 0; i < info->dlpi_phnum; i++) {
+        const auto& phdr = info->dlpi_phdr[i];
+        if (phdr.p_type != PT_NOTE) {
+            continue;
+        }
+        const size_t alignment = phdr.p_align == 8 ? 8 : 4;
+        const auto* note = reinterpret_cast<const char*>(info->dlpi_addr + phdr.p_vaddr);
+        const auto* end = note + phdr.p_memsz;
+        while (note + sizeof(ElfW(Nhdr)) <= end) {
+            const auto* header = reinterpret_cast<const ElfW(Nhdr)*>(note);
+            const auto* name = note + sizeof(ElfW(Nhdr));
+            const auto* desc = name + align(header->n_namesz, alignment);
+            note = desc + align(header->n_descsz, alignment);
+            if (note > end) {
+                break;
+            }
+            if (header->n_type != NT_GNU_BUILD_ID || header->n_namesz != 4 || memcmp(name, "GNU", 4) != 0) {
+                continue;
+            }
+            if (2 * header->n_descsz >= bufferSize) {
+                return 0;
+            }
+            static const char digits[] = "0123456789abcdef";
+            for (size_t j = 0; j < header->n_descsz; ++j) {
+                const auto byte = static_cast<unsigned char>(desc[j]);
+                buffer[2 * j] = digits[byte >> 4];
+                buffer[2 * j + 1] = digits[byte & 0xf];
+            }
+            buffer[2 * header->n_descsz] = '\0';
+            return 2 * header->n_descsz;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Per-thread state for the byte-based allocation sampling.
+ */
+struct SamplingState
+{
+    int64_t bytesUntilSample = 0;
+    uint64_t random = 0;
+
+    /**
+     * @return a random, exponentially distributed distance to the next sample in bytes
+     */
+    int64_t nextDistance(uint64_t interval)
+    {
+        // xorshift64*
+        random ^= random >> 12;
+        random ^= random << 25;
+        random ^= random >> 27;
+        const auto uniform = static_cast<double>(((random * 0x2545F4914F6CDD1Dull) >> 11) + 1) * 0x1.0p-53;
+        return max(int64_t(1), static_cast<int64_t>(-log(uniform) * static_cast<double>(interval)));
+    }
+};
+
+thread_local SamplingState t_sampling;
+
 /**
  * Thread-Safe heaptrack API
  *
@@ -304,8 +440,7 @@ public:
 
             Trace::setup();
 
-            // do not trace forked child processes
-            // TODO: make this configurable
+            // forked child processes are only traced when HEAPTRACK_FOLLOW_FORK is set
             pthread_atfork(&prepare_fork, &parent_fork, &child_fork);
 
             atexit([]() {
@@ -334,13 +469,143 @@ public:
             return;
         }
 
-        s_data = new LockedData(out, stopCallback);
+        const auto flightRecorderSize = envNumber("HEAPTRACK_FLIGHT_RECORDER", 0);
+        auto asyncBufferSize = envNumber("HEAPTRACK_ASYNC_BUFFER_SIZE", 0);
+        if (flightRecorderSize && asyncBufferSize) {
+            // nothing gets written while recording, so there is nothing to do for a writer thread
+            debugLog<WarningOutput>("%s", "HEAPTRACK_ASYNC_BUFFER_SIZE is not supported by "
+                                          "HEAPTRACK_FLIGHT_RECORDER, ignoring it");
+            asyncBufferSize = 0;
+        }
+        const auto overflowPolicy =
+            envFlag("HEAPTRACK_ASYNC_DROP") ? LineWriter::OverflowPolicy::Drop : LineWriter::OverflowPolicy::Block;
+        const auto timerInterval = chrono::milliseconds(max(envNumber("HEAPTRACK_TIMER_INTERVAL", 10), uint64_t(1)));
+        const auto maxTimerInterval =
+            max(chrono::milliseconds(envNumber("HEAPTRACK_TIMER_MAX_INTERVAL", 0)), timerInterval);
+        s_data = new LockedData(out, stopCallback, asyncBufferSize, overflowPolicy, timerInterval, maxTimerInterval);
+        s_data->binaryRecords = envFlag("HEAPTRACK_BINARY_RECORDS");
+        s_data->coalesceTemporaries = envFlag("HEAPTRACK_COALESCE_TEMPORARIES");
+        s_data->preciseTimestamps = envFlag("HEAPTRACK_PRECISE_TIMESTAMPS");
+        s_moduleCacheDirty = true;
+
+        if (flightRecorderSize) {
+            initializeFlightRecorder(flightRecorderSize);
+        } else if (const auto zstdLevel = envNumber("HEAPTRACK_ZSTD_LEVEL", 0)) {
+#if ZSTD_FOUND
+            s_data->out.setOutputFilter(makeInternal<ZstdOutputFilter>(static_cast<int>(zstdLevel)));
+#else
+            debugLog<WarningOutput>("%s", "heaptrack was built without zstd support, ignoring HEAPTRACK_ZSTD_LEVEL");
+#endif
+        }
+
+        if (getenv("HEAPTRACK_USE_FRAMEPOINTER")) {
+            Trace::setFramePointerUnwinding(envFlag("HEAPTRACK_USE_FRAMEPOINTER"));
+        }
+        Trace::setUnwindCaching(envFlag("HEAPTRACK_UNWIND_CACHE"));
+
+        s_data->aggregateInterval = chrono::seconds(envNumber("HEAPTRACK_AGGREGATE", 0));
+        if (s_data->flightRecorder && s_data->aggregateInterval.count()) {
+            debugLog<WarningOutput>("%s",
+                                    "HEAPTRACK_AGGREGATE is not supported by HEAPTRACK_FLIGHT_RECORDER, ignoring it");
+            s_data->aggregateInterval = chrono::seconds(0);
+        }
+        s_data->nextSnapshot = clock::now() + s_data->aggregateInterval;
+
+        if (!s_rotating) {
+            s_sampledPointers.clear();
+        }
+        s_sampleInterval = envNumber("HEAPTRACK_SAMPLE_INTERVAL", 0);
+        if (s_sampleInterval && s_data->aggregateInterval.count()) {
+            // the snapshots don't contain the sizes which are required to weight the samples
+            debugLog<WarningOutput>("%s",
+                                    "HEAPTRACK_SAMPLE_INTERVAL is not supported by HEAPTRACK_AGGREGATE, ignoring it");
+            s_sampleInterval = 0;
+        }
+
+        // record the usable size next to the requested one, to find the slack of the allocator
+        s_usableSizes = envFlag("HEAPTRACK_USABLE_SIZE");
+        if (s_usableSizes && (s_data->flightRecorder || s_data->aggregateInterval.count())) {
+            debugLog<WarningOutput>("%s", "HEAPTRACK_USABLE_SIZE is not supported by HEAPTRACK_FLIGHT_RECORDER "
+                                          "or HEAPTRACK_AGGREGATE, ignoring it");
+            s_usableSizes = false;
+        }
+        s_data->out.setUsableSizes(s_usableSizes);
+
+        s_data->triggers.rssThreshold = envNumber("HEAPTRACK_TRIGGER_RSS", 0);
+        s_data->triggers.heapThreshold = envNumber("HEAPTRACK_TRIGGER_HEAP", 0);
+        s_data->triggers.rssGrowthThreshold = envNumber("HEAPTRACK_TRIGGER_RSS_GROWTH", 0);
+#if !HAVE_MALLINFO2
+        if (s_data->triggers.heapThreshold && !s_data->flightRecorder) {
+            debugLog<WarningOutput>("%s", "HEAPTRACK_TRIGGER_HEAP requires HEAPTRACK_FLIGHT_RECORDER on this platform, "
+                                          "ignoring it");
+            s_data->triggers.heapThreshold = 0;
+        }
+#endif
+        if (s_data->triggers.isEnabled() && !s_data->flightRecorder) {
+            s_data->pausedUntilTrigger = true;
+            setPaused(true);
+        }
+
+        // trace forked child processes into their own output, see child_fork
+        s_followFork = envFlag("HEAPTRACK_FOLLOW_FORK");
+        if (s_followFork) {
+            const auto* output = getenv("HEAPTRACK_FOLLOW_FORK_OUTPUT");
+            s_data->followForkOutput = output && output[0] ? output : "heaptrack.$$";
+        }
+
+        // commands of heaptrack --control, see handleControlCommands
+        const bool controlChannel = envFlag("HEAPTRACK_CONTROL");
+        s_data->rotateInterval = chrono::seconds(envNumber("HEAPTRACK_ROTATE_SECONDS", 0));
+        s_data->rotateSize = envNumber("HEAPTRACK_ROTATE_SIZE", 0);
+        if (s_data->flightRecorder && (s_data->rotateInterval.count() || s_data->rotateSize)) {
+            debugLog<WarningOutput>("%s", "HEAPTRACK_ROTATE_SECONDS and HEAPTRACK_ROTATE_SIZE are not supported by "
+                                          "HEAPTRACK_FLIGHT_RECORDER, ignoring them");
+            s_data->rotateInterval = chrono::seconds(0);
+            s_data->rotateSize = 0;
+        }
+        s_data->nextRotation = clock::now() + s_data->rotateInterval;
+        if (controlChannel || s_data->rotateInterval.count() || s_data->rotateSize) {
+            const auto* output = getenv("HEAPTRACK_ROTATE_OUTPUT");
+            s_data->rotateOutput = output && output[0] ? output : "heaptrack.$$";
+        }
+        if (controlChannel) {
+            openControlChannel();
+        }
+
+        // when rotating, the deallocations of the allocations written to the previous files must
+        // still be written, such that a range of files can be analyzed as a whole
+        if (!s_rotating) {
+            s_filterFrees = false;
+            s_livePointers.clear();
+        }
+        // we will see many deallocations of memory that got allocated while we were paused
+        if (envFlag("HEAPTRACK_FILTER_FREES") || s_data->pausedUntilTrigger || controlChannel) {
+            enableFreeFilter();
+        }
+
+        if (envFlag("HEAPTRACK_THREAD_BUFFERS")) {
+            // when rotating, we keep the index and the events of allocations that were in flight,
+            // they get written to the new output, see writeBufferedTrace
+            if (!s_rotating || !s_traceIndex) {
+                // drop anything that got recorded after a previous shutdown
+                s_eventBuffers.discard();
+                // NOTE: we leak the previous index, as other threads may still be accessing it
+                s_traceIndex = new (InternalAllocator<ConcurrentTraceIndex>().allocate(1)) ConcurrentTraceIndex;
+                if (!s_bufferedFrames) {
+                    s_bufferedFrames = new (InternalAllocator<BufferedFrames>().allocate(1)) BufferedFrames;
+                }
+                s_bufferedFrames->clear();
+            }
+            s_useEventBuffers = true;
+        }
 
         writeVersion();
         writeExe();
         writeCommandLine();
         writeSystemInfo();
         writeSuppressions();
+        writeSampleInterval();
+        writeUsableSizes();
 
         if (initAfterCallback) {
             debugLog<MinimalOutput>("%s", "calling initAfterCallback");
@@ -351,7 +616,10 @@ public:
         debugLog<MinimalOutput>("%s", "initialization done");
     }
 
-    void shutdown()
+    /**
+     * @p rotatedAggregator receives the live allocations when aggregating, see rotateOutput
+     */
+    void shutdown(AllocationAggregator* rotatedAggregator = nullptr)
     {
         if (!s_data) {
             return;
@@ -359,12 +627,40 @@ public:
 
         debugLog<MinimalOutput>("%s", "shutdown()");
 
+        if (s_useEventBuffers) {
+            // from now on, allocations wait for s_lock. Write what the other threads appended
+            // since the last sync into this output, instead of dropping it or, when rotating,
+            // moving it to the next one.
+            s_useEventBuffers = false;
+            drainEventBuffersUntil(s_eventBuffers.sequence.fetch_add(1));
+        }
+        writeSnapshot();
         writeTimestamp();
         writeRSS();
+        if (s_data->out.canWrite()) {
+            flushPendingAllocation();
+        }
+        writeAsyncStats();
+        restoreFlightRecorderSignals();
+        if (s_data->pausedUntilTrigger) {
+            setPaused(false);
+        }
 
+        // in flight recorder mode, this writes the final dump
         s_data->out.flush();
         s_data->out.close();
 
+        // this also signals heaptrack --control that everything got written
+        if (s_data->controlFd != -1) {
+            close(s_data->controlFd);
+            s_data->controlFd = -1;
+            unlink(s_data->controlPath.c_str());
+        }
+
+        if (rotatedAggregator) {
+            *rotatedAggregator = std::move(s_data->aggregator);
+        }
+
         // NOTE: we leak heaptrack data on exit, intentionally
         // This way, we can be sure to get all static deallocations.
         if (!s_atexit || s_forceCleanup) {
@@ -380,7 +676,7 @@ public:
         if (!s_data) {
             return;
         }
-        s_data->moduleCacheDirty = true;
+        s_moduleCacheDirty = true;
     }
 
     void writeTimestamp()
@@ -389,13 +685,305 @@ public:
             return;
         }
 
+        syncEventBuffers();
+        flushPendingAllocation();
+
         auto elapsed = elapsedTime();
 
         debugLog<VeryVerboseOutput>("writeTimestamp(%" PRIx64 ")", elapsed.count());
 
+        if (s_data->flightRecorder) {
+            s_data->flightRecorder->record('c', static_cast<uint64_t>(elapsed.count()));
+            return;
+        }
         s_data->out.writeHexLine('c', static_cast<size_t>(elapsed.count()));
     }
 
+    /**
+     * Write a dump of the flight recorder to the next dump file, when HEAPTRACK_FLIGHT_RECORDER is set.
+     */
+    void dumpFlightRecorder()
+    {
+        if (!s_data || !s_data->flightRecorder || !s_data->out.canWrite()) {
+            return;
+        }
+
+        syncEventBuffers();
+        writeFlightRecorderDump();
+    }
+
+    /**
+     * Dump the flight recorder when the process aborts. This must not allocate, as the heap
+     * may be corrupted. Other threads usually are within a hook, so we retry to get the lock for
+     * a while. We cannot wait for it indefinitely, as the aborting thread may hold it itself.
+     */
+    static void dumpFlightRecorderOnAbort()
+    {
+        const auto deadline = chrono::steady_clock::now() + chrono::seconds(1);
+        while (!s_lock.try_lock()) {
+            if (chrono::steady_clock::now() >= deadline) {
+                // debugLog is not async-signal-safe
+                const char message[] = "heaptrack warning: skipping the flight recorder dump on abort, "
+                                       "the lock is held by another thread\n";
+                LineWriter::writeAll(STDERR_FILENO, message, sizeof(message) - 1);
+                return;
+            }
+            this_thread::sleep_for(chrono::microseconds(10));
+        }
+        if (s_data && s_data->flightRecorder && s_data->out.canWrite()) {
+            writeFlightRecorderDump();
+        }
+        s_lock.unlock();
+    }
+
+    /**
+     * Write the time stamp on behalf of the timer thread, which does not wait for the lock
+     * while another thread is recording. Reading the RSS, checking the triggers and writing
+     * dumps stays with the timer thread, to keep file I/O out of the allocation path.
+     */
+    void writeDueTimestamp()
+    {
+        if (s_timestampDue.load(std::memory_order_relaxed) && s_timestampDue.exchange(false)) {
+            writeTimestamp();
+        }
+    }
+
+    /**
+     * Write the cost of all traces that changed since the last snapshot, when HEAPTRACK_AGGREGATE is set.
+     */
+    void writeSnapshot()
+    {
+        if (!s_data || !s_data->out.canWrite() || !s_data->aggregateInterval.count()) {
+            return;
+        }
+
+        syncEventBuffers();
+
+        s_data->aggregator.takeChanges([](uint32_t traceIndex, const AllocationAggregator::Cost& cost) {
+            s_data->out.writeHexLine('N', traceIndex, cost.allocations, cost.temporary, cost.leaked);
+        });
+        // allocations of earlier segments of a rotated output, see rotateOutput
+        s_data->aggregator.takeEarlierDeallocations([](uint32_t segmentsAgo, uint32_t traceIndex, uint64_t bytes) {
+            s_data->out.writeHexLine('n', segmentsAgo, traceIndex, bytes);
+        });
+        s_data->nextSnapshot = clock::now() + s_data->aggregateInterval;
+    }
+
+    static void enableFreeFilter()
+    {
+        if (s_livePointers.initialize()) {
+            s_filterFrees = true;
+        } else {
+            debugLog<WarningOutput>("%s", "failed to allocate the filter for HEAPTRACK_FILTER_FREES");
+        }
+    }
+
+    /**
+     * Create the FIFO from which the timer thread reads the commands of heaptrack --control.
+     *
+     * The FIFO lives in /tmp/heaptrack-<uid>, which only we may write to. Otherwise another user
+     * could create the FIFO in our place and get the commands or block the control channel.
+     * heaptrack.sh does the same checks, see sendControlCommand.
+     */
+    void openControlChannel()
+    {
+        const auto uid = geteuid();
+        const auto directory = "/tmp/heaptrack-" + std::to_string(uid);
+        struct stat info;
+        if (mkdir(directory.c_str(), 0700) != 0 && errno != EEXIST) {
+            debugLog<WarningOutput>("failed to create the control channel directory %s: %s", directory.c_str(),
+                                    strerror(errno));
+            return;
+        } else if (lstat(directory.c_str(), &info) != 0 || !S_ISDIR(info.st_mode) || info.st_uid != uid
+                   || (info.st_mode & 077)) {
+            debugLog<WarningOutput>("refusing to use the control channel directory %s, it must be a directory "
+                                    "that is only accessible by uid %u",
+                                    directory.c_str(), static_cast<unsigned>(uid));
+            return;
+        }
+
+        s_data->controlPath = (directory + "/control." + std::to_string(getpid())).c_str();
+        s_data->controlCommand.clear();
+        const auto* path = s_data->controlPath.c_str();
+        unlink(path);
+        if (mkfifo(path, 0600) != 0) {
+            debugLog<WarningOutput>("failed to create the control channel %s: %s", path, strerror(errno));
+            return;
+        }
+        // we never block, not even while no client has the FIFO opened
+        s_data->controlFd = open(path, O_RDONLY | O_NONBLOCK | O_NOFOLLOW | O_CLOEXEC);
+        if (s_data->controlFd == -1) {
+            debugLog<WarningOutput>("failed to open the control channel %s: %s", path, strerror(errno));
+            unlink(path);
+        } else if (fstat(s_data->controlFd, &info) != 0 || !S_ISFIFO(info.st_mode) || info.st_uid != uid) {
+            debugLog<WarningOutput>("refusing to use the control channel %s, it is not a FIFO of uid %u", path,
+                                    static_cast<unsigned>(uid));
+            close(s_data->controlFd);
+            s_data->controlFd = -1;
+        }
+    }
+
+    /**
+     * Execute the commands that got written to the control channel, called by the timer thread.
+     *
+     * Stopping and rotating the output destroys the timer thread, so that is done by a helper thread.
+     */
+    void handleControlCommands()
+    {
+        if (!s_data || s_data->controlFd == -1) {
+            return;
+        }
+
+        char buffer[256];
+        const auto size = read(s_data->controlFd, buffer, sizeof(buffer));
+        if (size <= 0) {
+            return;
+        }
+
+        // a command may be split across reads, the incomplete last line is kept for the next one
+        auto& pending = s_data->controlCommand;
+        pending.append(buffer, size);
+        size_t start = 0;
+        for (auto end = pending.find('\n'); end != InternalString::npos;
+             start = end + 1, end = pending.find('\n', start)) {
+            pending[end] = 0;
+            const auto* command = pending.c_str() + start;
+            if (!*command) {
+                continue;
+            }
+            debugLog<MinimalOutput>("control command: %s", command);
+            if (!strcmp(command, "pause")) {
+                setPaused(true);
+            } else if (!strcmp(command, "resume")) {
+                setPaused(false);
+            } else if (!strcmp(command, "snapshot")) {
+                writeControlSnapshot();
+            } else if (!strcmp(command, "rotate")) {
+                requestRotation();
+            } else if (!strcmp(command, "stop")) {
+                runDetached([]() {
+                    if (!s_forceCleanup) {
+                        heaptrack_stop();
+                    }
+                });
+            } else {
+                debugLog<WarningOutput>("unknown control command: %s", command);
+            }
+        }
+        pending.erase(0, start);
+        if (pending.size() > sizeof(buffer)) {
+            debugLog<WarningOutput>("%s", "discarding an overlong control command");
+            pending.clear();
+        }
+    }
+
+    /**
+     * Rotate the output once HEAPTRACK_ROTATE_SECONDS passed or HEAPTRACK_ROTATE_SIZE bytes got written.
+     */
+    void rotateOutputIfDue()
+    {
+        if ((s_data->rotateInterval.count() && clock::now() >= s_data->nextRotation)
+            || (s_data->rotateSize && s_data->out.bytesWritten() >= s_data->rotateSize)) {
+            requestRotation();
+        }
+    }
+
+    /**
+     * The rotation shuts down the timer thread, so it has to happen on a separate one.
+     */
+    static void requestRotation()
+    {
+        if (s_rotationPending.exchange(true)) {
+            return;
+        }
+        const bool started = runDetached([]() {
+            RecursionGuard guard;
+            op(guard, [](HeapTrack& heaptrack) { heaptrack.rotateOutput(); });
+            s_rotationPending = false;
+        });
+        if (!started) {
+            s_rotationPending = false;
+        }
+    }
+
+    template <typename Function>
+    static bool runDetached(Function function)
+    {
+        try {
+            std::thread(function).detach();
+            return true;
+        } catch (const std::system_error& error) {
+            debugLog<WarningOutput>("failed to start a thread for the control command: %s", error.what());
+            return false;
+        }
+    }
+
+    /**
+     * Make the data recorded so far available: write a flight recorder dump or the aggregated
+     * costs, when enabled, otherwise flush the output such that it can be analyzed right away.
+     */
+    void writeControlSnapshot()
+    {
+        if (s_data->flightRecorder) {
+            dumpFlightRecorder();
+        } else if (s_data->aggregateInterval.count()) {
+            writeSnapshot();
+        } else {
+            writeTimestamp();
+            writeRSS();
+            flushPendingAllocation();
+            s_data->out.flush();
+        }
+    }
+
+    /**
+     * Continue with a new output file, named after HEAPTRACK_ROTATE_OUTPUT with a running number.
+     * Like the first one, the new file starts with the header, the modules and the backtraces it
+     * references. The allocations from before are unknown to it, like when we get attached to a
+     * process, but their deallocations still get written, see initialize(). When aggregating, the
+     * deallocations get attributed to the segment of their allocation, see AllocationAggregator.
+     */
+    void rotateOutput()
+    {
+        if (!s_data || s_atexit) {
+            return;
+        }
+
+        const auto rotateOutput = s_data->rotateOutput;
+        const auto rotateInterval = s_data->rotateInterval;
+        const auto rotateSize = s_data->rotateSize;
+        const bool controlChannel = s_data->controlFd != -1;
+        const auto output = rotateOutput + "." + std::to_string(++s_rotations).c_str();
+        const auto stopCallback = s_data->stopCallback;
+        // we continue tracing, so the stop callback must not unhook us
+        s_data->stopCallback = nullptr;
+        AllocationAggregator aggregator;
+        shutdown(&aggregator);
+
+        s_rotating = true;
+        initialize(output.c_str(), nullptr, nullptr, stopCallback);
+        s_rotating = false;
+        if (!s_data) {
+            return;
+        }
+        if (s_data->aggregateInterval.count()) {
+            s_data->aggregator = std::move(aggregator);
+            s_data->aggregator.startSegment();
+        }
+        s_data->out.write("A\n");
+        // keep rotating, even when the environment got changed in the meantime
+        s_data->rotateOutput = rotateOutput;
+        s_data->rotateInterval = rotateInterval;
+        s_data->rotateSize = rotateSize;
+        s_data->nextRotation = clock::now() + rotateInterval;
+        if (controlChannel && s_data->controlFd == -1) {
+            openControlChannel();
+            if (!s_filterFrees) {
+                enableFreeFilter();
+            }
+        }
+    }
+
     void writeRSS()
     {
         if (!s_data || !s_data->out.canWrite()) {
@@ -408,19 +996,20 @@ public:
         if (s_data->procStatm == -1) {
             return;
         }
-        // read RSS in pages from statm, then rewind for next read
+        // read RSS in pages from statm, pread saves us the rewind for the next read
         // NOTE: don't use fscanf here, it could potentially deadlock us
         const int BUF_SIZE = 512;
         char buf[BUF_SIZE + 1];
-        if (read(s_data->procStatm, buf, BUF_SIZE) <= 0) {
+        const auto bytesRead = pread(s_data->procStatm, buf, BUF_SIZE, 0);
+        if (bytesRead <= 0) {
             fprintf(stderr, "WARNING: Failed to read RSS value from /proc/self/statm.\n");
             close(s_data->procStatm);
             s_data->procStatm = -1;
             return;
         }
-        lseek(s_data->procStatm, 0, SEEK_SET);
+        buf[bytesRead] = '\0';
 
-        if (sscanf(buf, "%*u %zu", &rss) != 1) {
+        if (!parseStatmRss(buf, &rss)) {
             fprintf(stderr, "WARNING: Failed to read RSS value from /proc/self/statm.\n");
             close(s_data->procStatm);
             s_data->procStatm = -1;
@@ -438,69 +1027,245 @@ public:
 #endif
 
         // TODO: compare to rusage.ru_maxrss (getrusage) to find "real" peak?
-        // TODO: use custom allocators with known page sizes to prevent tainting
-        //       the RSS numbers with heaptrack-internal data
 
-        s_data->out.writeHexLine('R', rss);
-    }
+        // our own data lives in the internal arena, report it such that it can be subtracted from the RSS
+        const auto pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+        const auto overhead = (InternalArena::instance().usedBytes() + pageSize - 1) / pageSize;
 
-    void writeVersion()
-    {
-        s_data->out.writeHexLine('v', static_cast<size_t>(HEAPTRACK_VERSION),
-                                 static_cast<size_t>(HEAPTRACK_FILE_FORMAT_VERSION));
+        if (s_data->flightRecorder) {
+            // a dump only contains the latest events, so we cannot rely on an earlier 'O' line
+            s_data->flightRecorder->record('O', overhead);
+            s_data->flightRecorder->record('R', rss);
+        } else {
+            if (overhead != s_data->lastOverhead) {
+                s_data->out.writeHexLine('O', overhead);
+                s_data->lastOverhead = overhead;
+            }
+            s_data->out.writeHexLine('R', rss);
+        }
+
+        checkTriggers((rss > overhead ? rss - overhead : 0) * pageSize);
     }
 
-    void writeExe()
+    /**
+     * Write a flight recorder dump when a trigger fires, or start to record when we
+     * were paused until then. See TriggerRules.
+     */
+    void checkTriggers(uint64_t rss)
     {
-        const int BUF_SIZE = 1023;
-        char buf[BUF_SIZE + 1];
+        auto& triggers = s_data->triggers;
+        if (!triggers.isEnabled()) {
+            return;
+        }
 
-#ifdef __linux__
-        ssize_t size = readlink("/proc/self/exe", buf, BUF_SIZE);
-#elif defined(__FreeBSD__)
-        int mib[4] = {CTL_KERN, KERN_PROC, KERN_PROC_PATHNAME, -1};
-        size_t size = BUF_SIZE;
-        sysctl(mib, 4, buf, &size, NULL, 0);
-#endif
+        const auto heap = triggers.heapThreshold ? heapSize() : 0;
+        const auto fired = triggers.update(rss, heap, clock::now());
+        if (fired == TriggerRules::Metric::None) {
+            return;
+        }
+        debugLog<MinimalOutput>("%s threshold exceeded", TriggerRules::name(fired));
 
-        if (size > 0 && size < BUF_SIZE) {
-            buf[size] = 0;
-            s_data->out.write("x %x %s\n", size, buf);
+        if (s_data->flightRecorder) {
+            writeFlightRecorderDump();
+            return;
         }
+
+        s_data->out.write("# %s threshold exceeded, recording from here on\n", TriggerRules::name(fired));
+        // nothing left to trigger, we keep recording until the end
+        triggers = {};
+        s_data->pausedUntilTrigger = false;
+        setPaused(false);
     }
 
-    void writeCommandLine()
+    /**
+     * @return the size of the live heap in bytes, as tracked by the flight recorder or reported by malloc
+     */
+    static uint64_t heapSize()
     {
-        s_data->out.write("X");
-        const int BUF_SIZE = 4096;
-        char buf[BUF_SIZE + 1] = {0};
-
-#ifdef __linux__
-        auto fd = open("/proc/self/cmdline", O_RDONLY);
-        auto bytesRead = read(fd, buf, BUF_SIZE);
-        close(fd);
-#elif defined(__FreeBSD__)
-        int mib[4] = {CTL_KERN, KERN_PROC, KERN_PROC_ARGS, getpid()};
-        size_t bytesRead = BUF_SIZE;
-        sysctl(mib, 4, buf, &bytesRead, NULL, 0);
-#endif
-
-        char* end = buf + bytesRead;
-        for (char* p = buf; p < end;) {
-            s_data->out.write(" %s", p);
-            while (*p++)
-                ; // skip until start of next 0-terminated section
+        if (s_data->flightRecorder) {
+            return s_data->flightRecorder->liveBytes();
         }
-
-        s_data->out.write("\n");
+#if HAVE_MALLINFO2
+        const auto info = mallinfo2();
+        return info.uordblks + info.hblkhd;
+#else
+        return 0;
+#endif
     }
 
-    void writeSystemInfo()
+    /**
+     * Keep the events in memory and only write them on demand, see FlightRecorder.
+     */
+    void initializeFlightRecorder(uint64_t size)
+    {
+        const auto maxAge = envNumber("HEAPTRACK_FLIGHT_RECORDER_SECONDS", 0) * 1000;
+        auto recorder =
+            makeInternal<FlightRecorder>(size / FlightRecorder::BYTES_PER_EVENT, s_data->binaryRecords, maxAge);
+        s_data->flightRecorder = recorder.get();
+        s_data->out.setOutputFilter(std::move(recorder));
+
+        if (envNumber("HEAPTRACK_ZSTD_LEVEL", 0)) {
+            debugLog<WarningOutput>("%s",
+                                    "HEAPTRACK_ZSTD_LEVEL is not supported by HEAPTRACK_FLIGHT_RECORDER, ignoring it");
+        }
+
+        const auto* output = getenv("HEAPTRACK_FLIGHT_RECORDER_OUTPUT");
+        if (output && output[0]) {
+            s_data->flightRecorderOutput = output;
+        } else {
+            s_data->flightRecorderOutput = ("heaptrack.flight." + std::to_string(getpid())).c_str();
+        }
+
+        struct sigaction action = {};
+        sigemptyset(&action.sa_mask);
+        s_flightRecorderSignal = static_cast<int>(envNumber("HEAPTRACK_FLIGHT_RECORDER_SIGNAL", 0));
+        if (s_flightRecorderSignal) {
+            // we cannot take the lock within the signal handler, so let the timer thread do the work
+            action.sa_handler = [](int) { s_flightRecorderDumpRequested = true; };
+            action.sa_flags = SA_RESTART;
+            if (sigaction(s_flightRecorderSignal, &action, &s_previousFlightRecorderAction) != 0) {
+                debugLog<WarningOutput>("failed to install the handler for HEAPTRACK_FLIGHT_RECORDER_SIGNAL: %s",
+                                        strerror(errno));
+                s_flightRecorderSignal = 0;
+            }
+        }
+
+        action.sa_handler = [](int) {
+            dumpFlightRecorderOnAbort();
+            // SIGABRT is blocked while we handle it, the previous handler gets it once we return
+            sigaction(SIGABRT, &s_previousAbortAction, nullptr);
+            raise(SIGABRT);
+        };
+        action.sa_flags = 0;
+        sigaction(SIGABRT, &action, &s_previousAbortAction);
+    }
+
+    void restoreFlightRecorderSignals()
+    {
+        if (!s_data->flightRecorder) {
+            return;
+        }
+        if (s_flightRecorderSignal) {
+            sigaction(s_flightRecorderSignal, &s_previousFlightRecorderAction, nullptr);
+            s_flightRecorderSignal = 0;
+        }
+        sigaction(SIGABRT, &s_previousAbortAction, nullptr);
+    }
+
+    /**
+     * Write all data of the flight recorder to a new file. This must not allocate, see dumpFlightRecorderOnAbort.
+     */
+    static void writeFlightRecorderDump()
+    {
+        // move the lines that are still buffered into the flight recorder
+        s_data->out.flush();
+
+        char fileName[4096];
+        snprintf(fileName, sizeof(fileName), "%s.%u", s_data->flightRecorderOutput.c_str(),
+                 ++s_data->flightRecorderDumps);
+        const int fd = open(fileName, O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            debugLog<WarningOutput>("failed to open flight recorder dump %s: %s", fileName, strerror(errno));
+            return;
+        }
+        if (!s_data->flightRecorder->dump(fd)) {
+            debugLog<WarningOutput>("failed to write flight recorder dump %s: %s", fileName, strerror(errno));
+        }
+        close(fd);
+        debugLog<MinimalOutput>("wrote flight recorder dump %s", fileName);
+    }
+
+    void writeAsyncStats()
+    {
+        if (!s_data->out.isAsync()) {
+            return;
+        }
+        const auto stats = s_data->out.asyncStats();
+        const auto stallMilliseconds = stats.stallNanoseconds / 1000000;
+        s_data->out.write("# async writer: %" PRIu64 " buffers, %" PRIu64 " stalls for %" PRIu64 "ms, %" PRIu64
+                          " dropped lines\n",
+                          stats.buffers, stats.stalls, stallMilliseconds, stats.dropped);
+        if (stats.dropped) {
+            debugLog<WarningOutput>("dropped %" PRIu64 " allocation events as the writer thread could not keep up, "
+                                    "consider a larger HEAPTRACK_ASYNC_BUFFER_SIZE",
+                                    stats.dropped);
+        }
+    }
+
+    void writeVersion()
+    {
+        s_data->out.writeHexLine('v', static_cast<size_t>(HEAPTRACK_VERSION),
+                                 static_cast<size_t>(HEAPTRACK_FILE_FORMAT_VERSION));
+    }
+
+    void writeExe()
+    {
+        const int BUF_SIZE = 1023;
+        char buf[BUF_SIZE + 1];
+
+#ifdef __linux__
+        ssize_t size = readlink("/proc/self/exe", buf, BUF_SIZE);
+#elif defined(__FreeBSD__)
+        int mib[4] = {CTL_KERN, KERN_PROC, KERN_PROC_PATHNAME, -1};
+        size_t size = BUF_SIZE;
+        sysctl(mib, 4, buf, &size, NULL, 0);
+#endif
+
+        if (size > 0 && size < BUF_SIZE) {
+            buf[size] = 0;
+            s_data->out.write("x %x %s\n", size, buf);
+        }
+    }
+
+    void writeCommandLine()
+    {
+        s_data->out.write("X");
+        const int BUF_SIZE = 4096;
+        char buf[BUF_SIZE + 1] = {0};
+
+#ifdef __linux__
+        auto fd = open("/proc/self/cmdline", O_RDONLY);
+        auto bytesRead = read(fd, buf, BUF_SIZE);
+        close(fd);
+#elif defined(__FreeBSD__)
+        int mib[4] = {CTL_KERN, KERN_PROC, KERN_PROC_ARGS, getpid()};
+        size_t bytesRead = BUF_SIZE;
+        sysctl(mib, 4, buf, &bytesRead, NULL, 0);
+#endif
+
+        char* end = buf + bytesRead;
+        for (char* p = buf; p < end;) {
+            s_data->out.write(" %s", p);
+            while (*p++)
+                ; // skip until start of next 0-terminated section
+        }
+
+        s_data->out.write("\n");
+    }
+
+    void writeSystemInfo()
     {
         s_data->out.writeHexLine('I', static_cast<size_t>(sysconf(_SC_PAGESIZE)),
                                  static_cast<size_t>(sysconf(_SC_PHYS_PAGES)));
     }
 
+    void writeSampleInterval()
+    {
+        if (s_sampleInterval) {
+            s_data->out.writeHexLine('P', static_cast<uint64_t>(s_sampleInterval));
+        }
+    }
+
+    /**
+     * Announce that the allocations carry their usable size, which changes the binary records.
+     */
+    void writeUsableSizes()
+    {
+        if (s_usableSizes) {
+            s_data->out.write("U\n");
+        }
+    }
+
     void writeSuppressions()
     {
         if (!__lsan_default_suppressions)
@@ -519,11 +1284,12 @@ public:
         }
     }
 
-    void handleMalloc(void* ptr, size_t size, const Trace& trace)
+    void handleMalloc(void* ptr, size_t size, uint64_t usableSize, const Trace& trace)
     {
         if (!s_data || !s_data->out.canWrite()) {
             return;
         }
+        writeDueTimestamp();
         updateModuleCache();
 
         const auto index = s_data->traceTree.index(trace, [](uintptr_t ip, uint32_t index) {
@@ -533,7 +1299,7 @@ public:
             // and https://bugs.kde.org/show_bug.cgi?id=439897
             --ip;
 
-            return s_data->out.writeHexLine('t', ip, index);
+            return writeEvent('t', ip, index);
         });
 
 #ifdef DEBUG_MALLOC_PTRS
@@ -542,7 +1308,7 @@ public:
         s_data->known.insert(ptr);
 #endif
 
-        s_data->out.writeHexLine('+', size, index, reinterpret_cast<uintptr_t>(ptr));
+        writeAllocation(size, usableSize, index, reinterpret_cast<uintptr_t>(ptr));
     }
 
     void handleFree(void* ptr)
@@ -557,7 +1323,312 @@ public:
         s_data->known.erase(it);
 #endif
 
-        s_data->out.writeHexLine('-', reinterpret_cast<uintptr_t>(ptr));
+        writeDeallocation(reinterpret_cast<uintptr_t>(ptr));
+        // afterwards, as the time stamp would break up a temporary allocation otherwise
+        writeDueTimestamp();
+    }
+
+    /**
+     * Write a '+' line. When HEAPTRACK_COALESCE_TEMPORARIES is set, it is held back
+     * until we know whether the next event deallocates it again.
+     */
+    static void writeAllocation(uint64_t size, uint64_t usableSize, uint32_t traceIndex, uintptr_t ptr)
+    {
+        ++s_data->eventsSinceTick;
+        if (s_data->flightRecorder) {
+            s_data->flightRecorder->allocate(size, traceIndex, ptr);
+            return;
+        }
+        if (s_data->aggregateInterval.count()) {
+            s_data->aggregator.allocate(size, traceIndex, ptr);
+            return;
+        }
+        flushPendingAllocation();
+        if (s_data->preciseTimestamps) {
+            writePreciseTimestamp(preciseTime());
+        }
+        if (!s_data->coalesceTemporaries) {
+            writeAllocationEvent(size, usableSize, traceIndex, ptr);
+            return;
+        }
+        s_data->pendingAllocation = {size, traceIndex, ptr, usableSize};
+    }
+
+    /**
+     * Write a '+' line, with the usable size as the last argument when HEAPTRACK_USABLE_SIZE is set.
+     */
+    static bool writeAllocationEvent(uint64_t size, uint64_t usableSize, uint32_t traceIndex, uintptr_t ptr)
+    {
+        if (s_usableSizes) {
+            return writeEvent('+', size, traceIndex, ptr, usableSize);
+        }
+        return writeEvent('+', size, traceIndex, ptr);
+    }
+
+    /**
+     * Write a '-' line, or a single 'T' line for a temporary allocation, i.e. when
+     * the pending allocation gets deallocated directly.
+     */
+    static void writeDeallocation(uintptr_t ptr)
+    {
+        ++s_data->eventsSinceTick;
+        if (s_data->flightRecorder) {
+            s_data->flightRecorder->deallocate(ptr);
+            return;
+        }
+        if (s_data->aggregateInterval.count()) {
+            s_data->aggregator.deallocate(ptr);
+            return;
+        }
+        // with precise time stamps, we only coalesce when no time passed in between
+        const auto now = s_data->preciseTimestamps ? preciseTime() : 0;
+        auto& pending = s_data->pendingAllocation;
+        if (pending.ptr && pending.ptr == ptr && now == s_data->lastPreciseTimestamp) {
+            pending.ptr = 0;
+            if (s_usableSizes) {
+                writeEvent('T', pending.size, pending.traceIndex, pending.usableSize);
+            } else {
+                writeEvent('T', pending.size, pending.traceIndex);
+            }
+            return;
+        }
+        flushPendingAllocation();
+        if (s_data->preciseTimestamps) {
+            writePreciseTimestamp(now);
+        }
+        writeEvent('-', ptr);
+    }
+
+    /**
+     * @return the microseconds since the start, for HEAPTRACK_PRECISE_TIMESTAMPS
+     */
+    static int64_t preciseTime()
+    {
+        return chrono::duration_cast<chrono::microseconds>(clock::now() - startTime()).count();
+    }
+
+    /**
+     * Write a 'C' line with the microseconds that passed since the last one, if any.
+     * The deltas stay small, such that a binary record only takes a few bytes.
+     */
+    static void writePreciseTimestamp(int64_t now)
+    {
+        if (now != s_data->lastPreciseTimestamp) {
+            writeEvent('C', static_cast<uint64_t>(now - s_data->lastPreciseTimestamp));
+            s_data->lastPreciseTimestamp = now;
+        }
+    }
+
+    /**
+     * Write the pending allocation, if any. This must be called before writing any
+     * other data, such that the order of the lines stays intact.
+     */
+    static void flushPendingAllocation()
+    {
+        auto& pending = s_data->pendingAllocation;
+        if (pending.ptr) {
+            const auto ptr = pending.ptr;
+            pending.ptr = 0;
+            writeAllocationEvent(pending.size, pending.usableSize, pending.traceIndex, ptr);
+        }
+    }
+
+    /**
+     * Write one of the frequent '+', '-', 'T' or 't' lines, as a binary record when enabled.
+     */
+    template <typename... T>
+    static bool writeEvent(char type, T... args)
+    {
+        if (s_data->binaryRecords) {
+            return s_data->out.writeBinaryLine(type, args...);
+        }
+        return s_data->out.writeHexLine(type, args...);
+    }
+
+    /**
+     * Write all buffered events with a sequence number below @p limit to the output.
+     *
+     * @return the sequence number up to which all events have been written
+     */
+    uint64_t drainEventBuffers(uint64_t limit = EventBuffer::NO_EVENT)
+    {
+        return s_eventBuffers.drain(
+            [](const BufferedEvent& event) {
+                if (event.type == 't') {
+                    // remember the frame even when we cannot write it, later outputs may reference it
+                    auto& frames = *s_bufferedFrames;
+                    if (frames.size() <= event.args[2]) {
+                        frames.resize(event.args[2] + 1, {0, 0});
+                    }
+                    frames[event.args[2]] = {event.args[0], static_cast<uint32_t>(event.args[1])};
+                }
+                if (!s_data || !s_data->out.canWrite()) {
+                    return;
+                }
+                switch (event.type) {
+                case 't':
+                    writeBufferedTrace(static_cast<uint32_t>(event.args[2]));
+                    break;
+                case '+': {
+                    const auto traceIndex = writeBufferedTrace(static_cast<uint32_t>(event.args[1]));
+                    writeAllocation(event.args[0], event.args[3], traceIndex, event.args[2]);
+                    break;
+                }
+                case '-':
+                    writeDeallocation(event.args[0]);
+                    break;
+                }
+            },
+            limit);
+    }
+
+    /**
+     * The threads assign the indices of the buffered traces concurrently, but the 't' lines
+     * must appear in index order, so we map them to the order in which we write them. The
+     * shared index outlives a rotation of the output, the traces that are unknown to the
+     * current output are written on their first use then.
+     *
+     * @return the index of the buffered trace @p index in the current output
+     */
+    static uint32_t writeBufferedTrace(uint32_t index)
+    {
+        const auto& frames = *s_bufferedFrames;
+        auto& traceIndices = s_data->bufferedTraceIndices;
+        if (!index || index >= frames.size()) {
+            return 0;
+        } else if (index < traceIndices.size() && traceIndices[index]) {
+            return traceIndices[index];
+        }
+
+        // the recursion is bounded by Trace::MAX_SIZE
+        const auto frame = frames[index];
+        const auto parentIndex = writeBufferedTrace(frame.parentIndex);
+        if (traceIndices.size() <= index) {
+            traceIndices.resize(index + 1, 0);
+        }
+        traceIndices[index] = s_data->nextBufferedTraceIndex++;
+        writeEvent('t', frame.ip, parentIndex);
+        return traceIndices[index];
+    }
+
+    /**
+     * Record an allocation in the event buffer of the calling thread, without taking s_lock.
+     */
+    static void bufferMalloc(const RecursionGuard& guard, void* ptr, size_t size, uint64_t usableSize,
+                             const Trace& trace)
+    {
+        if (s_moduleCacheDirty) {
+            op(guard, [](HeapTrack& heaptrack) { heaptrack.updateModuleCache(); });
+        }
+
+        // we may need to write up to one event per frame, plus the allocation itself
+        auto* buffer = reserveEventBuffer(guard, Trace::MAX_SIZE + 1);
+        if (!buffer) {
+            return;
+        }
+
+        auto* traceIndex = s_traceIndex.load();
+        if (buffer->traceCacheOwner != traceIndex) {
+            buffer->traceCache.clear();
+            buffer->traceCacheOwner = traceIndex;
+        }
+
+        // hot backtraces are resolved by the per-thread cache, only new frames hit the shared index
+        const auto index = buffer->traceCache.indexWith(trace, [buffer, traceIndex](uintptr_t ip, uint32_t parentIndex) {
+            return traceIndex->index(ip, parentIndex, [buffer, ip, parentIndex](uint32_t index) {
+                // new trace indices must be written before anyone else can reference them
+                // see handleMalloc for why we decrement the address
+                buffer->append(s_eventBuffers.sequence, 't', ip - 1, parentIndex, index);
+            });
+        });
+
+        buffer->append(s_eventBuffers.sequence, '+', size, index, reinterpret_cast<uintptr_t>(ptr), usableSize);
+    }
+
+    /**
+     * Record a deallocation in the event buffer of the calling thread, without taking s_lock.
+     */
+    static void bufferFree(const RecursionGuard& guard, void* ptr)
+    {
+        if (auto* buffer = reserveEventBuffer(guard, 1)) {
+            buffer->append(s_eventBuffers.sequence, '-', reinterpret_cast<uintptr_t>(ptr));
+        }
+    }
+
+    static bool useEventBuffers()
+    {
+        return s_useEventBuffers;
+    }
+
+    /**
+     * Decide whether an allocation of @p size bytes gets recorded.
+     *
+     * When HEAPTRACK_SAMPLE_INTERVAL is set, we sample on average once every that many
+     * allocated bytes, like tcmalloc does it. The thread-local countdown keeps the
+     * unsampled case cheap. An allocation of size s is sampled with the probability
+     * 1 - exp(-s / interval), which the analyzers use to scale the data back up.
+     */
+    static bool sampleAllocation(size_t size)
+    {
+        const auto interval = s_sampleInterval.load(std::memory_order_relaxed);
+        if (!interval) {
+            return true;
+        }
+
+        auto& state = t_sampling;
+        state.bytesUntilSample -= static_cast<int64_t>(size);
+        if (state.bytesUntilSample > 0) {
+            return false;
+        }
+
+        if (!state.random) {
+            // first allocation in this thread, start at a random position
+            state.random = (static_cast<uint64_t>(gettid()) << 32)
+                ^ static_cast<uint64_t>(clock::now().time_since_epoch().count()) ^ 1;
+            state.bytesUntilSample = state.nextDistance(interval) - static_cast<int64_t>(size);
+            if (state.bytesUntilSample > 0) {
+                return false;
+            }
+        }
+
+        state.bytesUntilSample = state.nextDistance(interval);
+        return true;
+    }
+
+    /**
+     * Remember @p ptr of a recorded allocation, such that we will also record its deallocation.
+     */
+    static void addRecordedPointer(const RecursionGuard& /*recursionGuard*/, void* ptr)
+    {
+        if (s_sampleInterval.load(std::memory_order_relaxed)) {
+            s_sampledPointers.insert(ptr);
+        } else if (s_filterFrees.load(std::memory_order_acquire)) {
+            s_livePointers.insert(ptr);
+        }
+    }
+
+    /**
+     * @return true when the deallocation of @p ptr gets recorded, i.e. if it was sampled
+     *         or may have been recorded otherwise
+     */
+    static bool recordDeallocation(void* ptr)
+    {
+        if (s_sampleInterval.load(std::memory_order_relaxed)) {
+            return s_sampledPointers.erase(ptr);
+        }
+        return !s_filterFrees.load(std::memory_order_acquire) || s_livePointers.mayContain(ptr);
+    }
+
+    /**
+     * @return the size of the allocation at @p ptr that is usable according to the allocator when
+     *         HEAPTRACK_USABLE_SIZE is set and the allocator can tell, otherwise the requested @p size
+     */
+    static uint64_t usableSize(void* ptr, size_t size, heaptrack_usable_size_t usableSizeFunction)
+    {
+        if (!usableSizeFunction || !s_usableSizes.load(std::memory_order_relaxed)) {
+            return size;
+        }
+        return max(static_cast<uint64_t>(usableSizeFunction(ptr)), static_cast<uint64_t>(size));
     }
 
     static bool isPaused()
@@ -571,13 +1642,51 @@ public:
     }
 
 private:
-    static int dl_iterate_phdr_callback(struct dl_phdr_info* info, size_t /*size*/, void* data)
+    static const char* moduleFileName(const struct dl_phdr_info* info)
     {
-        auto heaptrack = reinterpret_cast<HeapTrack*>(data);
         const char* fileName = info->dlpi_name;
         if (!fileName || !fileName[0]) {
             fileName = "x";
         }
+        return fileName;
+    }
+
+    /**
+     * Marks the known modules that are still loaded. Stops the iteration right away when
+     * no module got loaded or unloaded since the last update, in which case @p data stays false.
+     */
+    static int mark_loaded_modules_callback(struct dl_phdr_info* info, size_t size, void* data)
+    {
+        auto* changed = reinterpret_cast<bool*>(data);
+        if (!*changed) {
+            // the counters are the same for all modules, so only look at them once
+            const bool hasCounters = size >= offsetof(struct dl_phdr_info, dlpi_subs) + sizeof(info->dlpi_subs);
+            if (hasCounters && s_data->hasModuleCounters && info->dlpi_adds == s_data->moduleAdds
+                && info->dlpi_subs == s_data->moduleSubs) {
+                return 1;
+            }
+            if (hasCounters) {
+                s_data->moduleAdds = info->dlpi_adds;
+                s_data->moduleSubs = info->dlpi_subs;
+            }
+            s_data->hasModuleCounters = hasCounters;
+            *changed = true;
+        }
+
+        if (auto* module = s_data->findKnownModule(info->dlpi_addr, moduleFileName(info))) {
+            module->loaded = true;
+        }
+        return 0;
+    }
+
+    static int dl_iterate_phdr_callback(struct dl_phdr_info* info, size_t /*size*/, void* data)
+    {
+        auto heaptrack = reinterpret_cast<HeapTrack*>(data);
+        const char* fileName = moduleFileName(info);
+        if (heaptrack->s_data->findKnownModule(info->dlpi_addr, fileName)) {
+            return 0;
+        }
+        heaptrack->s_data->knownModules.push_back({info->dlpi_addr, fileName, true});
 
         debugLog<VerboseOutput>("dlopen_notify_callback: %s %zx", fileName, info->dlpi_addr);
 
@@ -585,6 +1694,23 @@ private:
             return 1;
         }
 
+        // identify the file, such that it can be found again when it got replaced before the interpretation
+        char buildId[129];
+        auto buildIdSize = readBuildId(info, buildId, sizeof(buildId));
+        if (!buildIdSize) {
+            strcpy(buildId, "-");
+            buildIdSize = 1;
+        }
+        struct stat fileInfo = {};
+        if (stat(info->dlpi_name && info->dlpi_name[0] ? info->dlpi_name : "/proc/self/exe", &fileInfo) != 0) {
+            fileInfo = {};
+        }
+        if (!heaptrack->s_data->out.write(" %zx %s %" PRIx64 " %" PRIx64, buildIdSize, buildId,
+                                          static_cast<uint64_t>(fileInfo.st_size),
+                                          static_cast<uint64_t>(fileInfo.st_mtime))) {
+            return 1;
+        }
+
         for (int i = 0; i < info->dlpi_phnum; i++) {
             const auto& phdr = info->dlpi_phdr[i];
             if (phdr.p_type == PT_LOAD) {
@@ -606,11 +1732,22 @@ private:
         debugLog<MinimalOutput>("%s", "prepare_fork()");
         // don't do any custom malloc handling while inside fork
         RecursionGuard::isActive = true;
+        if (s_followFork) {
+            // the child must not inherit our data while another thread is modifying it
+            s_lock.lock();
+            InternalArena::instance().lockForFork();
+            s_lockedForFork = true;
+        }
     }
 
     static void parent_fork()
     {
         debugLog<MinimalOutput>("%s", "parent_fork()");
+        if (s_lockedForFork) {
+            s_lockedForFork = false;
+            InternalArena::instance().unlockAfterFork();
+            s_lock.unlock();
+        }
         // the parent process can now continue its custom malloc tracking
         RecursionGuard::isActive = false;
     }
@@ -618,23 +1755,139 @@ private:
     static void child_fork()
     {
         debugLog<MinimalOutput>("%s", "child_fork()");
-        // but the forked child process cleans up itself
-        // this is important to prevent two processes writing to the same file
+        if (!s_lockedForFork) {
+            // but the forked child process cleans up itself
+            // this is important to prevent two processes writing to the same file
+            s_data = nullptr;
+            RecursionGuard::isActive = true;
+            return;
+        }
+
+        s_lockedForFork = false;
+        InternalArena::instance().unlockAfterFork();
+        {
+            // the lock was taken in prepare_fork, it gets released when this goes out of scope
+            HeapTrack heaptrack(LockStatus(true));
+            heaptrack.initializeFollowedFork();
+        }
+        RecursionGuard::isActive = false;
+    }
+
+    /**
+     * Continue tracing in a forked child process, writing to a new output.
+     *
+     * The data of the parent is leaked, as its threads don't exist in the child
+     * and the buffered output must not get written twice. The trace tree is
+     * inherited and written out first, such that the trace indices of the child
+     * match those of the parent.
+     */
+    void initializeFollowedFork()
+    {
+        auto* parentData = s_data;
+        if (!parentData) {
+            return;
+        }
+        restoreFlightRecorderSignals();
         s_data = nullptr;
-        RecursionGuard::isActive = true;
+
+        const auto output = parentData->followForkOutput;
+        initialize(output.c_str(), nullptr, nullptr, parentData->stopCallback);
+        if (!s_data) {
+            return;
+        }
+
+        // allocations from before the fork are unknown to us, like when we get attached to a process
+        s_data->out.write("A\n");
+        if (s_data->flightRecorder) {
+            s_data->flightRecorderOutput += ("." + std::to_string(getpid())).c_str();
+        }
+
+        if (s_useEventBuffers) {
+            // the buffered traces use a new index, see initialize
+            return;
+        }
+        updateModuleCache();
+        auto& traceTree = parentData->traceTree;
+        const bool inherited = traceTree.forEachNode([](uintptr_t ip, uint32_t parentIndex) {
+            // see handleMalloc for why we decrement the address
+            writeEvent('t', ip - 1, parentIndex);
+        });
+        if (inherited) {
+            s_data->traceTree = std::move(traceTree);
+        }
     }
 
     void updateModuleCache()
     {
-        if (!s_data || !s_data->out.canWrite() || !s_data->moduleCacheDirty) {
+        if (!s_data || !s_data->out.canWrite() || !s_moduleCacheDirty) {
             return;
         }
         debugLog<MinimalOutput>("%s", "updateModuleCache()");
-        if (!s_data->out.write("m 1 -\n")) {
+        syncEventBuffers();
+        flushPendingAllocation();
+
+        // only write the modules that got unloaded or loaded since the last update
+        auto& modules = s_data->knownModules;
+        for (auto& module : modules) {
+            module.loaded = false;
+        }
+        bool changed = false;
+        dl_iterate_phdr(&mark_loaded_modules_callback, &changed);
+        s_moduleCacheDirty = false;
+        if (!changed) {
             return;
         }
+
+        for (const auto& module : modules) {
+            if (!module.loaded && !s_data->out.write("m 1 - %zx\n", module.address)) {
+                return;
+            }
+        }
+        modules.erase(std::remove_if(modules.begin(), modules.end(),
+                                     [](const LockedData::KnownModule& module) { return !module.loaded; }),
+                      modules.end());
+
         dl_iterate_phdr(&dl_iterate_phdr_callback, this);
-        s_data->moduleCacheDirty = false;
+    }
+
+    /**
+     * Write all events that got buffered before this call, such that data which we write
+     * directly afterwards ends up at the correct position within the output stream.
+     */
+    void syncEventBuffers()
+    {
+        if (!s_useEventBuffers) {
+            return;
+        }
+
+        drainEventBuffersUntil(s_eventBuffers.sequence.fetch_add(1));
+    }
+
+    /**
+     * Write all buffered events with a sequence number below @p barrier.
+     */
+    void drainEventBuffersUntil(uint64_t barrier)
+    {
+        while (drainEventBuffers(barrier) < barrier) {
+            // another thread is still appending an event recorded before the barrier
+            this_thread::yield();
+        }
+    }
+
+    /**
+     * @return the event buffer of the calling thread with space for at least @p events,
+     *         or nullptr when we are shutting down
+     */
+    static EventBuffer* reserveEventBuffer(const RecursionGuard& guard, uint64_t events)
+    {
+        auto* buffer = s_eventBuffers.threadBuffer();
+        while (buffer->available() < events) {
+            // help the timer thread in draining the buffers
+            if (!op(guard, [](HeapTrack& heaptrack) { heaptrack.drainEventBuffers(); }) || !s_useEventBuffers) {
+                return nullptr;
+            }
+        }
+        return buffer;
     }
 
     void writeError()
@@ -689,8 +1942,12 @@ private:
 
     struct LockedData
     {
-        LockedData(int out, heaptrack_callback_t stopCallback)
+        LockedData(int out, heaptrack_callback_t stopCallback, size_t asyncBufferSize,
+                   LineWriter::OverflowPolicy overflowPolicy, chrono::milliseconds timerInterval,
+                   chrono::milliseconds maxTimerInterval)
             : out(out)
+            , timerInterval(timerInterval)
+            , maxTimerInterval(maxTimerInterval)
             , stopCallback(stopCallback)
         {
 
@@ -702,7 +1959,7 @@ private:
             }
 #endif
 
-            // ensure this utility thread is not handling any signals
+            // ensure these utility threads are not handling any signals
             // our host application may assume only one specific thread
             // will handle the threads, if that's not the case things
             // seemingly break in non-obvious ways.
@@ -715,24 +1972,69 @@ private:
                 return;
             }
 
-            // the mask we set above will be inherited by the thread that we spawn below
+            // the mask we set above will be inherited by the threads that we spawn below
+            if (asyncBufferSize) {
+                this->out.enableAsync(asyncBufferSize, overflowPolicy);
+                writerThread = std::thread([this]() {
+                    RecursionGuard::isActive = true;
+                    debugLog<MinimalOutput>("%s", "writer thread started");
+                    this->out.runAsyncWriter();
+                });
+            }
+
             timerThread = std::thread([&]() {
                 RecursionGuard::isActive = true;
                 debugLog<MinimalOutput>("%s", "timer thread started");
 
                 // now loop and repeatedly print the timestamp and RSS usage to the data stream
+                auto interval = this->timerInterval;
+                int busyTicks = 0;
                 while (!stopTimerThread) {
-                    // TODO: make interval customizable
-                    this_thread::sleep_for(chrono::milliseconds(10));
-
-                    const auto locked = tryLock([&] { return stopTimerThread.load(); });
+                    this_thread::sleep_for(interval);
+
+                    // when the lock is taken, the thread holding it writes the time stamp for us
+                    // we only wait for the lock when that did not happen for a while
+                    s_timestampDue = true;
+                    LockStatus locked = s_lock.try_lock();
+                    if (!locked && ++busyTicks < MAX_BUSY_TICKS) {
+                        interval = this->timerInterval;
+                        continue;
+                    }
                     if (!locked) {
-                        break;
+                        locked = tryLock([&] { return stopTimerThread.load(); });
+                        if (!locked) {
+                            break;
+                        }
                     }
+                    busyTicks = 0;
 
                     HeapTrack heaptrack(locked);
-                    heaptrack.writeTimestamp();
+                    if (this->aggregateInterval.count() && clock::now() >= this->nextSnapshot) {
+                        heaptrack.writeSnapshot();
+                    }
+                    if (s_flightRecorderDumpRequested.exchange(false)) {
+                        heaptrack.dumpFlightRecorder();
+                    }
+                    heaptrack.handleControlCommands();
+                    heaptrack.rotateOutputIfDue();
+                    // this also drains the buffered events when HEAPTRACK_THREAD_BUFFERS is enabled
+                    if (s_timestampDue.exchange(false)) {
+                        heaptrack.writeTimestamp();
+                    } else {
+                        heaptrack.syncEventBuffers();
+                    }
+                    // the time stamp may have been written by a recording thread, see writeDueTimestamp
                     heaptrack.writeRSS();
+                    // don't let the data sit in the large asynchronous buffers for too long
+                    this->out.flushIfIdle();
+
+                    // tick fast while allocating, and back off when idle
+                    if (this->eventsSinceTick) {
+                        interval = this->timerInterval;
+                    } else {
+                        interval = min(2 * interval, this->maxTimerInterval);
+                    }
+                    this->eventsSinceTick = 0;
                 }
             });
 
@@ -754,6 +2056,12 @@ private:
             }
 
             out.close();
+            if (writerThread.joinable()) {
+                try {
+                    writerThread.join();
+                } catch (const std::system_error&) {
+                }
+            }
 
             if (procStatm != -1) {
                 close(procStatm);
@@ -765,25 +2073,118 @@ private:
             debugLog<MinimalOutput>("%s", "done destroying LockedData");
         }
 
+        /// like the data of the containers below, we put ourselves into the InternalArena
+        static void* operator new(size_t size)
+        {
+            if (auto* ptr = InternalArena::instance().allocate(size)) {
+                return ptr;
+            }
+            throw std::bad_alloc();
+        }
+
+        static void operator delete(void* ptr, size_t size)
+        {
+            InternalArena::instance().deallocate(ptr, size);
+        }
+
         LineWriter out;
 
+        /// write the frequent lines as binary records, see BinaryRecordCodec
+        bool binaryRecords = false;
+
+        /// write a single 'T' line for allocations that get deallocated directly afterwards
+        bool coalesceTemporaries = false;
+
+        /// write 'C' lines with the time of the events in microseconds, see writePreciseTimestamp
+        bool preciseTimestamps = false;
+        int64_t lastPreciseTimestamp = 0;
+
+        /// when non-zero, write snapshots of the aggregated costs in this interval instead of every event
+        chrono::seconds aggregateInterval {0};
+        chrono::time_point<clock> nextSnapshot;
+        AllocationAggregator aggregator;
+
+        /// keeps the events in memory instead of writing them, when HEAPTRACK_FLIGHT_RECORDER is set
+        /// NOTE: this is owned by the LineWriter, as its output filter
+        FlightRecorder* flightRecorder = nullptr;
+        /// the dumps are written to files with this prefix, followed by a running number
+        InternalString flightRecorderOutput;
+        unsigned flightRecorderDumps = 0;
+
+        /// the output of forked child processes, when HEAPTRACK_FOLLOW_FORK is set
+        InternalString followForkOutput;
+
+        /// the FIFO of heaptrack --control, when HEAPTRACK_CONTROL is set
+        int controlFd = -1;
+        InternalString controlPath;
+        /// the incomplete last line that got read from the control channel
+        InternalString controlCommand;
+        /// the prefix of the files we continue with when the output gets rotated
+        InternalString rotateOutput;
+        /// when non-zero, rotate the output in this interval or after writing this many bytes
+        chrono::seconds rotateInterval {0};
+        chrono::time_point<clock> nextRotation;
+        uint64_t rotateSize = 0;
+
+        /// dump the flight recorder, or start to record once one of these fires
+        TriggerRules triggers;
+        /// nothing gets recorded until a trigger fires, when there is no flight recorder
+        bool pausedUntilTrigger = false;
+
+        /// the allocation that was held back, see writeAllocation
+        struct PendingAllocation
+        {
+            uint64_t size;
+            uint32_t traceIndex;
+            uintptr_t ptr;
+            uint64_t usableSize;
+        };
+        PendingAllocation pendingAllocation = {0, 0, 0, 0};
+
+        /// the modules that got written out already, identified by their load address and file name
+        struct KnownModule
+        {
+            uintptr_t address;
+            InternalString fileName;
+            bool loaded;
+        };
+        std::vector<KnownModule, InternalAllocator<KnownModule>> knownModules;
+
+        KnownModule* findKnownModule(uintptr_t address, const char* fileName)
+        {
+            auto it = std::find_if(knownModules.begin(), knownModules.end(), [=](const KnownModule& module) {
+                return module.address == address && module.fileName == fileName;
+            });
+            return it == knownModules.end() ? nullptr : &*it;
+        }
+        /// the dlpi_adds and dlpi_subs counters at the last update of the modules, if available
+        unsigned long long moduleAdds = 0;
+        unsigned long long moduleSubs = 0;
+        bool hasModuleCounters = false;
+
         /// /proc/self/statm file descriptor to read RSS value from
         int procStatm = -1;
+        /// the pages of the InternalArena in the last 'O' line, which only gets written when this changes
+        uint64_t lastOverhead = 0;
 
-        /**
-         * Calls to dlopen/dlclose mark the cache as dirty.
-         * When this happened, all modules and their section addresses
-         * must be found again via dl_iterate_phdr before we output the
-         * next instruction pointer. Otherwise, heaptrack_interpret might
-         * encounter IPs of an unknown/invalid module.
-         */
-        bool moduleCacheDirty = true;
+        /// the timer thread ticks in this interval while allocating, and backs off up to the maximum when idle
+        const chrono::milliseconds timerInterval;
+        const chrono::milliseconds maxTimerInterval;
+        /// the number of allocations and deallocations since the last tick of the timer thread
+        uint64_t eventsSinceTick = 0;
 
         TraceTree traceTree;
 
+        /// maps the trace indices of the buffered events to the ones we write out
+        std::vector<uint32_t, InternalAllocator<uint32_t>> bufferedTraceIndices = {0};
+        uint32_t nextBufferedTraceIndex = 1;
+
         atomic<bool> stopTimerThread {false};
         std::thread timerThread;
 
+        /// writes the output in the background, when HEAPTRACK_ASYNC_BUFFER_SIZE is set
+        std::thread writerThread;
+
         heaptrack_callback_t stopCallback = nullptr;
 
 #ifdef DEBUG_MALLOC_PTRS
@@ -794,34 +2195,177 @@ private:
     static std::mutex s_lock;
     static LockedData* s_data;
 
+    /**
+     * Calls to dlopen/dlclose mark the cache as dirty.
+     * When this happened, all modules and their section addresses
+     * must be found again via dl_iterate_phdr before we output the
+     * next instruction pointer. Otherwise, heaptrack_interpret might
+     * encounter IPs of an unknown/invalid module.
+     */
+    static std::atomic<bool> s_moduleCacheDirty;
+
+    /**
+     * When HEAPTRACK_THREAD_BUFFERS is set, allocations and deallocations are
+     * recorded into per-thread buffers that get drained by the timer thread.
+     * The data for this mode lives outside of s_data, as it is accessed
+     * without holding s_lock.
+     */
+    static std::atomic<bool> s_useEventBuffers;
+    static EventBufferRegistry s_eventBuffers;
+    static std::atomic<ConcurrentTraceIndex*> s_traceIndex;
+    struct BufferedFrame
+    {
+        uintptr_t ip;
+        uint32_t parentIndex;
+    };
+    using BufferedFrames = std::vector<BufferedFrame, InternalAllocator<BufferedFrame>>;
+    /// the frames of s_traceIndex by their index, only accessed by the drainer
+    static BufferedFrames* s_bufferedFrames;
+
+    /// mean distance between samples in bytes, or zero when all allocations get recorded
+    static std::atomic<uint64_t> s_sampleInterval;
+    static SampledPointers s_sampledPointers;
+
+    /**
+     * When HEAPTRACK_FILTER_FREES is set, deallocations of pointers whose allocation
+     * was definitely not recorded are skipped. This is mostly useful when heaptrack
+     * got attached to a running process.
+     */
+    static std::atomic<bool> s_filterFrees;
+    static LivePointerFilter s_livePointers;
+
+    /**
+     * Set by the signal handler for HEAPTRACK_FLIGHT_RECORDER_SIGNAL, the timer thread
+     * then writes the dump. The previous signal handlers get restored on shutdown.
+     */
+    static std::atomic<bool> s_flightRecorderDumpRequested;
+
+    /// set by the timer thread, cleared by whoever writes the next time stamp
+    static std::atomic<bool> s_timestampDue;
+    /// the number of ticks after which the timer thread waits for the lock
+    static constexpr int MAX_BUSY_TICKS = 10;
+    static int s_flightRecorderSignal;
+    static struct sigaction s_previousFlightRecorderAction;
+    static struct sigaction s_previousAbortAction;
+
+    /// set when HEAPTRACK_FOLLOW_FORK is enabled, s_lock is then held across fork
+    static std::atomic<bool> s_followFork;
+    static bool s_lockedForFork;
+
+    /// set when HEAPTRACK_USABLE_SIZE is enabled, see usableSize
+    static std::atomic<bool> s_usableSizes;
+
+    /// the number of times the output got rotated, via the control channel or HEAPTRACK_ROTATE_*
+    static unsigned s_rotations;
+    /// set while initializing the output we rotate to, see rotateOutput
+    static bool s_rotating;
+    static std::atomic<bool> s_rotationPending;
+
 private:
     static std::atomic<bool> s_paused;
 };
 
 std::mutex HeapTrack::s_lock;
 HeapTrack::LockedData* HeapTrack::s_data {nullptr};
+std::atomic<bool> HeapTrack::s_moduleCacheDirty {true};
+std::atomic<bool> HeapTrack::s_useEventBuffers {false};
+EventBufferRegistry HeapTrack::s_eventBuffers;
+std::atomic<ConcurrentTraceIndex*> HeapTrack::s_traceIndex {nullptr};
+HeapTrack::BufferedFrames* HeapTrack::s_bufferedFrames {nullptr};
+std::atomic<uint64_t> HeapTrack::s_sampleInterval {0};
+SampledPointers HeapTrack::s_sampledPointers;
+std::atomic<bool> HeapTrack::s_filterFrees {false};
+LivePointerFilter HeapTrack::s_livePointers;
+std::atomic<bool> HeapTrack::s_flightRecorderDumpRequested {false};
+std::atomic<bool> HeapTrack::s_timestampDue {false};
+int HeapTrack::s_flightRecorderSignal = 0;
+struct sigaction HeapTrack::s_previousFlightRecorderAction;
+struct sigaction HeapTrack::s_previousAbortAction;
+std::atomic<bool> HeapTrack::s_followFork {false};
+std::atomic<bool> HeapTrack::s_usableSizes {false};
+bool HeapTrack::s_lockedForFork = false;
+unsigned HeapTrack::s_rotations = 0;
+bool HeapTrack::s_rotating = false;
+std::atomic<bool> HeapTrack::s_rotationPending {false};
 std::atomic<bool> HeapTrack::s_paused {false};
 }
 
-static void heaptrack_realloc_impl(void* ptr_in, size_t size, void* ptr_out)
+static void heaptrack_free_impl(void* ptr)
+{
+    RecursionGuard guard;
+
+    debugLog<VeryVerboseOutput>("heaptrack_free(%p)", ptr);
+
+    if (HeapTrack::useEventBuffers()) {
+        HeapTrack::bufferFree(guard, ptr);
+        return;
+    }
+
+    HeapTrack::op(guard, [&](HeapTrack& heaptrack) { heaptrack.handleFree(ptr); });
+}
+
+static void heaptrack_realloc_impl(void* ptr_in, size_t size, void* ptr_out,
+                                   heaptrack_usable_size_t usableSizeFunction)
 {
     if (!HeapTrack::isPaused() && ptr_out && !RecursionGuard::isActive) {
+        if (ptr_in && !HeapTrack::recordDeallocation(ptr_in)) {
+            // the previous allocation was not recorded, so we must not record its deallocation
+            ptr_in = nullptr;
+        }
+        if (!HeapTrack::sampleAllocation(size)) {
+            if (ptr_in) {
+                heaptrack_free_impl(ptr_in);
+            }
+            return;
+        }
+
         RecursionGuard guard;
+        HeapTrack::addRecordedPointer(guard, ptr_out);
+        const auto usableSize = HeapTrack::usableSize(ptr_out, size, usableSizeFunction);
 
         debugLog<VeryVerboseOutput>("heaptrack_realloc(%p, %zu, %p)", ptr_in, size, ptr_out);
 
         Trace trace;
         trace.fill(2 + HEAPTRACK_DEBUG_BUILD * 3);
 
+        if (HeapTrack::useEventBuffers()) {
+            if (ptr_in) {
+                HeapTrack::bufferFree(guard, ptr_in);
+            }
+            HeapTrack::bufferMalloc(guard, ptr_out, size, usableSize, trace);
+            return;
+        }
+
         HeapTrack::op(guard, [&](HeapTrack& heaptrack) {
             if (ptr_in) {
                 heaptrack.handleFree(ptr_in);
             }
-            heaptrack.handleMalloc(ptr_out, size, trace);
+            heaptrack.handleMalloc(ptr_out, size, usableSize, trace);
         });
     }
 }
 
+static void heaptrack_malloc_impl(void* ptr, size_t size, heaptrack_usable_size_t usableSizeFunction)
+{
+    if (!HeapTrack::isPaused() && ptr && !RecursionGuard::isActive && HeapTrack::sampleAllocation(size)) {
+        RecursionGuard guard;
+        HeapTrack::addRecordedPointer(guard, ptr);
+        const auto usableSize = HeapTrack::usableSize(ptr, size, usableSizeFunction);
+
+        debugLog<VeryVerboseOutput>("heaptrack_malloc(%p, %zu)", ptr, size);
+
+        Trace trace;
+        trace.fill(2 + HEAPTRACK_DEBUG_BUILD * 3);
+
+        if (HeapTrack::useEventBuffers()) {
+            HeapTrack::bufferMalloc(guard, ptr, size, usableSize, trace);
+            return;
+        }
+
+        HeapTrack::op(guard, [&](HeapTrack& heaptrack) { heaptrack.handleMalloc(ptr, size, usableSize, trace); });
+    }
+}
+
 extern "C" {
 
 void heaptrack_init(const char* outputFileName, heaptrack_callback_t initBeforeCallback,
@@ -869,37 +2413,46 @@ void heaptrack_resume()
 
 void heaptrack_malloc(void* ptr, size_t size)
 {
-    if (!HeapTrack::isPaused() && ptr && !RecursionGuard::isActive) {
-        RecursionGuard guard;
-
-        debugLog<VeryVerboseOutput>("heaptrack_malloc(%p, %zu)", ptr, size);
-
-        Trace trace;
-        trace.fill(2 + HEAPTRACK_DEBUG_BUILD * 2);
+    heaptrack_malloc_impl(ptr, size, nullptr);
+}
 
-        HeapTrack::op(guard, [&](HeapTrack& heaptrack) { heaptrack.handleMalloc(ptr, size, trace); });
-    }
+void heaptrack_malloc_usable(void* ptr, size_t size, heaptrack_usable_size_t usableSize)
+{
+    heaptrack_malloc_impl(ptr, size, usableSize);
 }
 
 void heaptrack_free(void* ptr)
 {
-    if (!HeapTrack::isPaused() && ptr && !RecursionGuard::isActive) {
-        RecursionGuard guard;
-
-        debugLog<VeryVerboseOutput>("heaptrack_free(%p)", ptr);
-
-        HeapTrack::op(guard, [&](HeapTrack& heaptrack) { heaptrack.handleFree(ptr); });
+    if (!HeapTrack::isPaused() && ptr && !RecursionGuard::isActive && HeapTrack::recordDeallocation(ptr)) {
+        heaptrack_free_impl(ptr);
     }
 }
 
 void heaptrack_realloc(void* ptr_in, size_t size, void* ptr_out)
 {
-    heaptrack_realloc_impl(ptr_in, size, ptr_out);
+    heaptrack_realloc_impl(ptr_in, size, ptr_out, nullptr);
 }
 
 void heaptrack_realloc2(uintptr_t ptr_in, size_t size, uintptr_t ptr_out)
 {
-    heaptrack_realloc_impl(reinterpret_cast<void*>(ptr_in), size, reinterpret_cast<void*>(ptr_out));
+    heaptrack_realloc_impl(reinterpret_cast<void*>(ptr_in), size, reinterpret_cast<void*>(ptr_out), nullptr);
+}
+
+void heaptrack_realloc_usable(void* ptr_in, size_t size, void* ptr_out, heaptrack_usable_size_t usableSize)
+{
+    heaptrack_realloc_impl(ptr_in, size, ptr_out, usableSize);
+}
+
+void heaptrack_realloc2_usable(uintptr_t ptr_in, size_t size, uintptr_t ptr_out, heaptrack_usable_size_t usableSize)
+{
+    heaptrack_realloc_impl(reinterpret_cast<void*>(ptr_in), size, reinterpret_cast<void*>(ptr_out), usableSize);
+}
+
+int heaptrack_ignore_thread(int ignore)
+{
+    const bool wasIgnored = RecursionGuard::isActive;
+    RecursionGuard::isActive = ignore;
+    return wasIgnored;
 }
 
 void heaptrack_invalidate_module_cache(heaptrack_invalidate_module_cache_callback callback)
@@ -915,6 +2468,15 @@ void heaptrack_invalidate_module_cache(heaptrack_invalidate_module_cache_callbac
     });
 }
 
+void heaptrack_dump()
+{
+    RecursionGuard guard;
+
+    debugLog<VerboseOutput>("%s", "heaptrack_dump()");
+
+    HeapTrack::op(guard, [&](HeapTrack& heaptrack) { heaptrack.dumpFlightRecorder(); });
+}
+
 void heaptrack_warning(heaptrack_warning_callback_t callback)
 {
     RecursionGuard guard;
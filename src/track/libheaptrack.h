@@ -34,9 +34,23 @@ void heaptrack_free(void* ptr);
 void heaptrack_realloc(void* ptr_in, size_t size, void* ptr_out);
 void heaptrack_realloc2(uintptr_t ptr_in, size_t size, uintptr_t ptr_out);
 
+/// like heaptrack_malloc and heaptrack_realloc, but additionally record the size that is usable
+/// according to the allocator, e.g. malloc_usable_size. it only gets queried when HEAPTRACK_USABLE_SIZE is set
+typedef size_t (*heaptrack_usable_size_t)(void*);
+void heaptrack_malloc_usable(void* ptr, size_t size, heaptrack_usable_size_t usableSize);
+void heaptrack_realloc_usable(void* ptr_in, size_t size, void* ptr_out, heaptrack_usable_size_t usableSize);
+void heaptrack_realloc2_usable(uintptr_t ptr_in, size_t size, uintptr_t ptr_out, heaptrack_usable_size_t usableSize);
+
+/// ignore the (de)allocations of the calling thread while @p ignore is set, e.g. the calls to malloc
+/// and free within operator new and delete, which get recorded by their own hooks
+/// @return the previous value
+int heaptrack_ignore_thread(int ignore);
+
 typedef void (*heaptrack_invalidate_module_cache_callback)();
 void heaptrack_invalidate_module_cache(heaptrack_invalidate_module_cache_callback callback);
 
+void heaptrack_dump();
+
 typedef void (*heaptrack_warning_callback_t)(FILE*);
 void heaptrack_warning(heaptrack_warning_callback_t callback);
 
@@ -0,0 +1,109 @@
+/*
+    SPDX-FileCopyrightText: 2026 heaptrack contributors
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef LIVEPOINTERFILTER_H
+#define LIVEPOINTERFILTER_H
+
+/**
+ * @file livepointerfilter.h
+ * @brief Lock-free filter of the pointers whose allocation got recorded.
+ */
+
+#include <atomic>
+#include <cstdint>
+
+#include <sys/mman.h>
+
+/**
+ * A blocked bloom filter: every pointer maps to three bits within a single 64 bit word.
+ *
+ * Deallocations of pointers that are definitely not in the filter never got recorded
+ * as an allocation, e.g. because they were allocated before heaptrack got attached
+ * to the process. Writing them out is pointless, heaptrack_interpret ignores them.
+ *
+ * Pointers cannot be removed from the filter again, as that could also remove other
+ * pointers that share some bits with it. That is fine in practice: allocators reuse
+ * the same addresses over and over again, so the number of distinct pointers stays
+ * close to the peak number of allocations. False positives only mean that we record
+ * a deallocation which we could have skipped.
+ */
+class LivePointerFilter
+{
+public:
+    /**
+     * Allocate the filter, if needed. Only the pages that get used are backed by memory.
+     *
+     * The memory is never unmapped, as other threads may still free memory while the
+     * process exits. This must not be called concurrently to the other functions.
+     *
+     * @return false when the filter could not be allocated
+     */
+    bool initialize()
+    {
+        if (!m_words) {
+            auto* words =
+                mmap(nullptr, SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (words == MAP_FAILED) {
+                return false;
+            }
+            m_words = static_cast<std::atomic<uint64_t>*>(words);
+        }
+        return true;
+    }
+
+    /**
+     * Forget all pointers, e.g. when we start to write a new data file.
+     *
+     * This must not be called concurrently to the other functions.
+     */
+    void clear()
+    {
+        if (m_words) {
+            // give the pages back, they are zero again when touched the next time
+            madvise(m_words, SIZE, MADV_DONTNEED);
+        }
+    }
+
+    void insert(void* ptr)
+    {
+        uint64_t mask = 0;
+        auto& word = wordFor(ptr, &mask);
+        // don't dirty the cache line when the bits are set already, which is the common case
+        if ((word.load(std::memory_order_relaxed) & mask) != mask) {
+            word.fetch_or(mask, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @return false when @p ptr was definitely never inserted
+     */
+    bool mayContain(void* ptr) const
+    {
+        uint64_t mask = 0;
+        const auto& word = wordFor(ptr, &mask);
+        return (word.load(std::memory_order_relaxed) & mask) == mask;
+    }
+
+private:
+    enum : uint64_t
+    {
+        NUM_WORDS = 1 << 20,
+        SIZE = NUM_WORDS * sizeof(uint64_t)
+    };
+
+    std::atomic<uint64_t>& wordFor(void* ptr, uint64_t* mask) const
+    {
+        // skip the low bits which are zero due to the alignment of allocations
+        const auto hash = (reinterpret_cast<uintptr_t>(ptr) >> 4) * 0x9E3779B97F4A7C15ull;
+        // the highest bits select the word, the next three groups of six bits the bits within it
+        *mask = (1ull << ((hash >> 38) & 63)) | (1ull << ((hash >> 32) & 63)) | (1ull << ((hash >> 26) & 63));
+        return m_words[hash >> 44];
+    }
+
+    std::atomic<uint64_t>* m_words = nullptr;
+};
+
+#endif // LIVEPOINTERFILTER_H
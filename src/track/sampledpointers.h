@@ -0,0 +1,104 @@
+/*
+    SPDX-FileCopyrightText: 2026 heaptrack contributors
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef SAMPLEDPOINTERS_H
+#define SAMPLEDPOINTERS_H
+
+/**
+ * @file sampledpointers.h
+ * @brief Thread-safe set of the live pointers that got sampled.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#include <tsl/robin_set.h>
+
+#include "util/internalarena.h"
+
+/**
+ * When sampling, only a small fraction of all allocations gets recorded, but we
+ * have to find out for every deallocation whether its pointer was recorded. This
+ * set is split into independently locked stripes to keep contention low, and
+ * empty stripes are skipped without taking their lock.
+ *
+ * The set must be constant-initialized: when preloaded, we record allocations
+ * before the static constructors of libheaptrack run. The sets of the stripes
+ * are thus only created on the first insertion.
+ */
+class SampledPointers
+{
+public:
+    constexpr SampledPointers() = default;
+
+    void insert(void* ptr)
+    {
+        auto& stripe = stripeFor(ptr);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        if (!stripe.pointers) {
+            stripe.pointers = new (InternalAllocator<Pointers>().allocate(1)) Pointers;
+        }
+        if (stripe.pointers->insert(reinterpret_cast<uintptr_t>(ptr)).second) {
+            stripe.size.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @return true when @p ptr was sampled, it is removed from the set then
+     */
+    bool erase(void* ptr)
+    {
+        auto& stripe = stripeFor(ptr);
+        if (!stripe.size.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        if (!stripe.pointers || !stripe.pointers->erase(reinterpret_cast<uintptr_t>(ptr))) {
+            return false;
+        }
+        stripe.size.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void clear()
+    {
+        for (auto& stripe : m_stripes) {
+            std::lock_guard<std::mutex> lock(stripe.mutex);
+            if (stripe.pointers) {
+                stripe.pointers->clear();
+            }
+            stripe.size.store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    enum
+    {
+        NUM_STRIPES = 64
+    };
+
+    using Pointers =
+        tsl::robin_set<uintptr_t, std::hash<uintptr_t>, std::equal_to<uintptr_t>, InternalAllocator<uintptr_t>>;
+
+    struct alignas(64) Stripe
+    {
+        std::mutex mutex;
+        std::atomic<size_t> size {0};
+        Pointers* pointers = nullptr;
+    };
+
+    Stripe& stripeFor(void* ptr)
+    {
+        // skip the low bits which are zero due to the alignment of allocations
+        const auto hash = (reinterpret_cast<uintptr_t>(ptr) >> 4) * 0x9E3779B97F4A7C15ull;
+        return m_stripes[hash >> 58];
+    }
+
+    Stripe m_stripes[NUM_STRIPES];
+};
+
+#endif // SAMPLEDPOINTERS_H
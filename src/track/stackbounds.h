@@ -0,0 +1,62 @@
+/*
+    SPDX-FileCopyrightText: 2026 heaptrack contributors
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef STACKBOUNDS_H
+#define STACKBOUNDS_H
+
+/**
+ * @file stackbounds.h
+ * @brief The address range of the stack of the calling thread.
+ */
+
+#include <cstdint>
+
+#include <pthread.h>
+
+struct StackBounds
+{
+    uintptr_t low = 0;
+    uintptr_t high = 0;
+
+    /**
+     * @return true when the @p size bytes at @p address lie completely within the stack
+     */
+    bool contains(uintptr_t address, uintptr_t size) const
+    {
+        return address >= low && address + size <= high;
+    }
+};
+
+/**
+ * @return the bounds of the stack of the calling thread, which get queried only once per thread
+ *
+ * Code running on a different stack, e.g. on an alternate signal stack or in a fiber,
+ * is outside of these bounds.
+ */
+inline StackBounds threadStackBounds()
+{
+    static thread_local StackBounds t_bounds;
+    if (!t_bounds.high) {
+        pthread_attr_t attr;
+        if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+            void* address = nullptr;
+            size_t size = 0;
+            if (pthread_attr_getstack(&attr, &address, &size) == 0) {
+                t_bounds.low = reinterpret_cast<uintptr_t>(address);
+                t_bounds.high = t_bounds.low + size;
+            }
+            pthread_attr_destroy(&attr);
+        }
+        if (!t_bounds.high) {
+            // don't try again, everything will be out of bounds
+            t_bounds.low = 1;
+            t_bounds.high = 1;
+        }
+    }
+    return t_bounds;
+}
+
+#endif // STACKBOUNDS_H
@@ -7,6 +7,7 @@
 #ifndef TRACE_H
 #define TRACE_H
 
+#include <atomic>
 #include <cassert>
 #include <cstdint>
 
@@ -44,7 +45,7 @@ struct Trace
 
     bool fill(int skip)
     {
-        int size = unwind(m_data);
+        int size = s_useFramePointers.load(std::memory_order_relaxed) ? unwindFramePointers(m_data) : unwind(m_data);
         // filter bogus frames at the end, which sometimes get returned by tracer backend
         // cf.: https://bugs.kde.org/show_bug.cgi?id=379082
         while (size > 0 && !m_data[size - 1]) {
@@ -67,12 +68,55 @@ struct Trace
         m_skip = 0;
     }
 
+    void fillTestData(const uintptr_t* ips, int size)
+    {
+        assert(size <= MAX_SIZE);
+        for (int i = 0; i < size; ++i) {
+            m_data[i] = reinterpret_cast<ip_t>(ips[i]);
+        }
+
+        m_size = size;
+        m_skip = 0;
+    }
+
     static void setup();
 
     static void print();
 
+    /**
+     * Select whether we walk the frame pointer chain instead of using the unwinder
+     * backend that got selected at build time. The default is controlled by the
+     * HEAPTRACK_USE_FRAMEPOINTER build option.
+     */
+    static void setFramePointerUnwinding(bool enabled)
+    {
+        s_useFramePointers = enabled;
+    }
+
+    static bool framePointerUnwinding()
+    {
+        return s_useFramePointers;
+    }
+
+    /**
+     * Select whether the DWARF based unwinders stop as soon as they reach a frame
+     * that is still alive since the last backtrace of the same thread, and take
+     * the remaining frames from that backtrace. This is a no-op on architectures
+     * where we cannot verify that the cached frames are still alive.
+     */
+    static void setUnwindCaching(bool enabled);
+
+    static bool unwindCaching()
+    {
+        return s_useUnwindCache;
+    }
+
 private:
     static int unwind(void** data);
+    static int unwindFramePointers(void** data);
+
+    static std::atomic<bool> s_useFramePointers;
+    static std::atomic<bool> s_useUnwindCache;
 
 private:
     int m_size = 0;
@@ -0,0 +1,79 @@
+/*
+    SPDX-FileCopyrightText: 2026 heaptrack contributors
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+/**
+ * @brief A frame-pointer based backtrace.
+ *
+ * This only works reliably when all code on the stack got compiled with
+ * -fno-omit-frame-pointer, but it is much faster than parsing the DWARF
+ * call frame information, which the other backends do on every call.
+ */
+
+#include "stackbounds.h"
+#include "trace.h"
+
+#include "util/config.h"
+
+#include <cstdint>
+
+std::atomic<bool> Trace::s_useFramePointers {HEAPTRACK_USE_FRAMEPOINTER};
+
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+
+namespace {
+
+/**
+ * Follow the chain of frame records, which on all supported architectures consist
+ * of the frame pointer of the caller, followed by the return address.
+ */
+__attribute__((noinline)) int walkFramePointers(void** data, int maxSize)
+{
+    const auto bounds = threadStackBounds();
+
+    auto frame = reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+    int size = 0;
+    while (size < maxSize) {
+        // the frame record must be properly aligned and lie completely within the thread stack,
+        // otherwise we e.g. run on an alternate signal stack or hit code without frame pointers
+        if (!bounds.contains(frame, 2 * sizeof(void*)) || frame % sizeof(void*)) {
+            break;
+        }
+
+        const auto* record = reinterpret_cast<void* const*>(frame);
+        const auto ip = record[1];
+        if (!ip) {
+            break;
+        }
+        data[size++] = ip;
+
+        // the stack grows downwards, so the callers must be at higher addresses
+        const auto next = reinterpret_cast<uintptr_t>(record[0]);
+        if (next <= frame) {
+            break;
+        }
+        frame = next;
+    }
+    return size;
+}
+}
+
+int Trace::unwindFramePointers(void** data)
+{
+    const auto size = walkFramePointers(data, MAX_SIZE);
+    // prevent a tail call, the first frame must be within this function like for the other backends
+    asm volatile("" : : : "memory");
+    return size;
+}
+
+#else
+
+int Trace::unwindFramePointers(void** data)
+{
+    // unsupported architecture
+    return unwind(data);
+}
+
+#endif
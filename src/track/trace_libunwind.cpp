@@ -9,6 +9,7 @@
  */
 
 #include "trace.h"
+#include "unwindcache.h"
 
 #include "util/libunwind_config.h"
 
@@ -64,5 +65,33 @@ void Trace::setup()
 
 int Trace::unwind(void** data)
 {
+#if LIBUNWIND_HAS_UNW_GETCONTEXT && LIBUNWIND_HAS_UNW_INIT_LOCAL
+    if (s_useUnwindCache.load(std::memory_order_relaxed)) {
+        unw_context_t context;
+        unw_getcontext(&context);
+
+        unw_cursor_t cursor;
+        unw_init_local(&cursor, &context);
+
+        auto* cache = UnwindCache::threadCache();
+        cache->begin(data, MAX_SIZE);
+        while (true) {
+            unw_word_t ip = 0;
+            unw_get_reg(&cursor, UNW_REG_IP, &ip);
+            if (!ip) {
+                break;
+            }
+
+            unw_word_t sp = 0;
+            unw_get_reg(&cursor, UNW_REG_SP, &sp);
+
+            if (!cache->add(reinterpret_cast<void*>(ip), sp) || unw_step(&cursor) <= 0) {
+                break;
+            }
+        }
+        return cache->end();
+    }
+#endif
+
     return unw_backtrace(data, MAX_SIZE);
 }
@@ -9,6 +9,7 @@
  */
 
 #include "trace.h"
+#include "unwindcache.h"
 
 #include <cstdint>
 #include <cstdio>
@@ -35,6 +36,19 @@ _Unwind_Reason_Code unwind_backtrace_callback(struct _Unwind_Context* context, v
     return _URC_NO_REASON;
 }
 
+_Unwind_Reason_Code unwind_cached_backtrace_callback(struct _Unwind_Context* context, void* arg)
+{
+    auto* cache = static_cast<UnwindCache*>(arg);
+
+    // the CFA of the callee is the stack pointer after returning to pc
+    uintptr_t pc = _Unwind_GetIP(context);
+    if (pc && !cache->add(reinterpret_cast<void*>(pc), _Unwind_GetCFA(context))) {
+        return _URC_END_OF_STACK;
+    }
+
+    return _URC_NO_REASON;
+}
+
 }
 
 void Trace::setup()
@@ -52,6 +66,13 @@ void Trace::print()
 
 int Trace::unwind(void** data)
 {
+    if (s_useUnwindCache.load(std::memory_order_relaxed)) {
+        auto* cache = UnwindCache::threadCache();
+        cache->begin(data, MAX_SIZE - 1);
+        _Unwind_Backtrace(unwind_cached_backtrace_callback, cache);
+        return cache->end();
+    }
+
     backtrace trace;
     trace.data = data;
     trace.max_size = MAX_SIZE;
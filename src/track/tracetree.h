@@ -13,33 +13,45 @@
  */
 
 #include <algorithm>
+#include <atomic>
 #include <vector>
 
-#include "trace.h"
+#include <tsl/robin_map.h>
 
-struct TraceEdge
-{
-    Trace::ip_t instructionPointer;
-    // index associated to the backtrace up to this instruction pointer
-    // the evaluation process can then reverse-map the index to the parent ip
-    // to rebuild the backtrace from the bottom-up
-    uint32_t index;
-    // sorted list of children, assumed to be small
-    std::vector<TraceEdge> children;
-};
+#include "trace.h"
+#include "util/internalarena.h"
 
 /**
  * Top-down tree of backtrace instruction pointers.
  *
  * This is supposed to be a memory efficient storage of all instruction pointers
  * ever encountered in any backtrace.
+ *
+ * All nodes live in an arena of contiguous blocks. The first block doubles in size until it
+ * is as large as the others, such that a small tree stays small, e.g. in the cache of every
+ * thread. Only the first block gets moved while growing, thus references to nodes must not
+ * be kept while adding a child.
+ *
+ * Each node stores the instruction pointers of its first few children inline, such that
+ * the common case of a low fan-out only touches a single cache line per frame.
+ * Additional children of high fan-out nodes are found via a hash map.
  */
 class TraceTree
 {
 public:
+    TraceTree()
+    {
+        clear();
+    }
+
     void clear()
     {
-        m_root.children.clear();
+        // keep the first block around, it will be overwritten when we add new nodes
+        m_blocks.resize(1);
+        m_blocks.front().resize(FIRST_BLOCK_SIZE);
+        m_blocks.front()[0] = {};
+        m_numNodes = 1;
+        m_overflowChildren.clear();
         m_index = 1;
     }
 
@@ -52,32 +64,365 @@ public:
     template <typename Fun>
     uint32_t index(const Trace& trace, Fun callback)
     {
-        uint32_t index = 0;
-        TraceEdge* parent = &m_root;
+        return indexWith(trace, [this, &callback](uintptr_t ip, uint32_t parentIndex) -> uint32_t {
+            const auto index = m_index++;
+            return callback(ip, parentIndex) ? index : 0;
+        });
+    }
+
+    /**
+     * Index the data in @p trace like index(), but let the @p assignIndex callback
+     * decide about the index of unknown instruction pointers.
+     *
+     * This allows to use the tree as a cache in front of a ConcurrentTraceIndex.
+     * The callback returns zero on failure.
+     */
+    template <typename Fun>
+    uint32_t indexWith(const Trace& trace, Fun assignIndex)
+    {
+        uint32_t node = 0;
         for (int i = trace.size() - 1; i >= 0; --i) {
             const auto ip = trace[i];
             if (!ip) {
                 continue;
             }
-            auto it =
-                std::lower_bound(parent->children.begin(), parent->children.end(), ip,
-                                 [](const TraceEdge& l, const Trace::ip_t ip) { return l.instructionPointer < ip; });
-            if (it == parent->children.end() || it->instructionPointer != ip) {
-                index = m_index++;
-                it = parent->children.insert(it, {ip, index, {}});
-                if (!callback(reinterpret_cast<uintptr_t>(ip), parent->index)) {
+            auto child = findChild(node, ip);
+            if (child == NO_NODE) {
+                const auto index = assignIndex(reinterpret_cast<uintptr_t>(ip), nodeAt(node).index);
+                if (!index) {
                     return 0;
                 }
+                child = addChild(node, ip, index);
             }
-            index = it->index;
-            parent = &(*it);
+            node = child;
+        }
+        return nodeAt(node).index;
+    }
+
+    /**
+     * Call @p callback with the instruction pointer and the parent index of every
+     * indexed node, in the order of their indices. This allows to write out the
+     * tree again, e.g. into the output of a forked child process.
+     *
+     * @return false without calling @p callback when the indices are not contiguous,
+     *         which happens when the callback of index() failed before
+     */
+    template <typename Fun>
+    bool forEachNode(Fun callback) const
+    {
+        struct Entry
+        {
+            uint32_t index;
+            uint32_t parentIndex;
+            Trace::ip_t ip;
+        };
+        std::vector<Entry, InternalAllocator<Entry>> entries;
+        entries.reserve(m_numNodes);
+        for (uint32_t parent = 0; parent < m_numNodes; ++parent) {
+            const auto& node = nodeAt(parent);
+            const auto numInline = std::min(node.numChildren, INLINE_CHILDREN);
+            for (uint32_t i = 0; i < numInline; ++i) {
+                entries.push_back({nodeAt(node.children[i]).index, node.index, node.childIps[i]});
+            }
+        }
+        for (const auto& child : m_overflowChildren) {
+            entries.push_back({nodeAt(child.second).index, nodeAt(child.first.parent).index, child.first.ip});
+        }
+
+        std::sort(entries.begin(), entries.end(),
+                  [](const Entry& lhs, const Entry& rhs) { return lhs.index < rhs.index; });
+        for (uint32_t i = 0; i < entries.size(); ++i) {
+            if (entries[i].index != i + 1) {
+                return false;
+            }
+        }
+        if (entries.size() + 1 != m_index) {
+            return false;
+        }
+
+        for (const auto& entry : entries) {
+            callback(reinterpret_cast<uintptr_t>(entry.ip), entry.parentIndex);
         }
-        return index;
+        return true;
     }
 
 private:
-    TraceEdge m_root = {0, 0, {}};
+    static constexpr uint32_t NO_NODE = 0;
+    static constexpr uint32_t INLINE_CHILDREN = 4;
+    static constexpr uint32_t FIRST_BLOCK_SIZE = 64;
+    static constexpr uint32_t BLOCK_SHIFT = 12;
+    static constexpr uint32_t BLOCK_SIZE = 1 << BLOCK_SHIFT;
+
+    // the InternalArena aligns the blocks of nodes to a cache line
+    struct alignas(64) Node
+    {
+        // index associated to the backtrace up to this instruction pointer
+        // the evaluation process can then reverse-map the index to the parent ip
+        // to rebuild the backtrace from the bottom-up
+        uint32_t index = 0;
+        uint32_t numChildren = 0;
+        Trace::ip_t childIps[INLINE_CHILDREN] = {};
+        uint32_t children[INLINE_CHILDREN] = {};
+    };
+    static_assert(sizeof(Node) == 64, "a node should fill exactly one cache line");
+
+    struct OverflowKey
+    {
+        uint32_t parent;
+        Trace::ip_t ip;
+
+        bool operator==(const OverflowKey& rhs) const
+        {
+            return parent == rhs.parent && ip == rhs.ip;
+        }
+    };
+
+    struct OverflowKeyHash
+    {
+        size_t operator()(const OverflowKey& key) const
+        {
+            auto hash = reinterpret_cast<uintptr_t>(key.ip) ^ (uint64_t(key.parent) << 32);
+            hash = (hash ^ (hash >> 33)) * 0xff51afd7ed558ccdull;
+            return static_cast<size_t>(hash ^ (hash >> 33));
+        }
+    };
+
+    Node& nodeAt(uint32_t node)
+    {
+        return m_blocks[node >> BLOCK_SHIFT][node & (BLOCK_SIZE - 1)];
+    }
+
+    const Node& nodeAt(uint32_t node) const
+    {
+        return m_blocks[node >> BLOCK_SHIFT][node & (BLOCK_SIZE - 1)];
+    }
+
+    uint32_t findChild(uint32_t parent, Trace::ip_t ip)
+    {
+        const auto& node = nodeAt(parent);
+        const auto numInline = std::min(node.numChildren, INLINE_CHILDREN);
+        for (uint32_t i = 0; i < numInline; ++i) {
+            if (node.childIps[i] == ip) {
+                return node.children[i];
+            }
+        }
+        if (node.numChildren > INLINE_CHILDREN) {
+            auto it = m_overflowChildren.find({parent, ip});
+            if (it != m_overflowChildren.end()) {
+                return it->second;
+            }
+        }
+        return NO_NODE;
+    }
+
+    uint32_t addChild(uint32_t parent, Trace::ip_t ip, uint32_t index)
+    {
+        const auto child = m_numNodes++;
+        if ((child >> BLOCK_SHIFT) == m_blocks.size()) {
+            m_blocks.emplace_back(BLOCK_SIZE);
+        } else if (child < BLOCK_SIZE && child == m_blocks.front().size()) {
+            m_blocks.front().resize(std::min(2 * child, BLOCK_SIZE));
+        }
+        auto& childNode = nodeAt(child);
+        childNode = {};
+        childNode.index = index;
+
+        auto& node = nodeAt(parent);
+        if (node.numChildren < INLINE_CHILDREN) {
+            node.childIps[node.numChildren] = ip;
+            node.children[node.numChildren] = child;
+        } else {
+            m_overflowChildren.insert({{parent, ip}, child});
+        }
+        ++node.numChildren;
+        return child;
+    }
+
+    using NodeBlock = std::vector<Node, InternalAllocator<Node>>;
+
+    // the root node is at position 0
+    std::vector<NodeBlock, InternalAllocator<NodeBlock>> m_blocks;
+    uint32_t m_numNodes = 0;
+    tsl::robin_map<OverflowKey, uint32_t, OverflowKeyHash, std::equal_to<OverflowKey>,
+                   InternalAllocator<std::pair<OverflowKey, uint32_t>>>
+        m_overflowChildren;
     uint32_t m_index = 1;
 };
 
+/**
+ * Assigns indices to (instruction pointer, parent index) pairs, concurrently
+ * from multiple threads and without taking a lock.
+ *
+ * This is a lock-free open addressing hash table. When it gets too full a
+ * larger table is prepended, older tables are still used for lookups.
+ * Concurrent insertions of the same pair can create duplicate indices,
+ * which is fine since each of them still forms a valid backtrace. The tables
+ * live in the InternalArena.
+ */
+class ConcurrentTraceIndex
+{
+public:
+    ConcurrentTraceIndex(size_t initialCapacity = 1024)
+        : m_table(newTable(initialCapacity, nullptr))
+    {
+    }
+
+    ~ConcurrentTraceIndex()
+    {
+        auto* table = m_table.load();
+        while (table) {
+            auto* previous = table->previous;
+            deleteTable(table);
+            table = previous;
+        }
+    }
+
+    ConcurrentTraceIndex(const ConcurrentTraceIndex&) = delete;
+    ConcurrentTraceIndex& operator=(const ConcurrentTraceIndex&) = delete;
+
+    /**
+     * @return the index for the @p ip with the given @p parentIndex
+     *
+     * Unknown pairs get a new index, which is passed to @p onNewIndex before
+     * it becomes visible to other threads.
+     */
+    template <typename Fun>
+    uint32_t index(uintptr_t ip, uint32_t parentIndex, Fun onNewIndex)
+    {
+        const auto hash = hashOf(ip, parentIndex);
+
+        auto* table = m_table.load(std::memory_order_acquire);
+        for (auto* t = table; t; t = t->previous) {
+            if (auto index = t->find(hash, ip, parentIndex)) {
+                return index;
+            }
+        }
+
+        while (true) {
+            if (table->size.load(std::memory_order_relaxed) < table->capacity() / 2) {
+                const auto result = table->insert(hash, ip, parentIndex, m_nextIndex, onNewIndex);
+                if (result.inserted || result.index) {
+                    return result.index;
+                }
+            }
+            table = grow(table);
+        }
+    }
+
+    /**
+     * @return the number of indices that got assigned so far
+     */
+    uint32_t size() const
+    {
+        return m_nextIndex.load() - 1;
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<uintptr_t> ip;
+        // parent index in the upper half, the index in the lower half
+        // zero while the slot is getting filled
+        std::atomic<uint64_t> parentAndIndex;
+    };
+
+    struct InsertResult
+    {
+        uint32_t index;
+        bool inserted;
+    };
+
+    struct Table
+    {
+        Table(size_t capacity, Table* previous)
+            : mask(capacity - 1)
+            , previous(previous)
+            , slots(capacity)
+        {
+        }
+
+        size_t capacity() const
+        {
+            return mask + 1;
+        }
+
+        uint32_t find(size_t hash, uintptr_t ip, uint32_t parentIndex) const
+        {
+            for (size_t i = 0; i <= mask; ++i) {
+                const auto& slot = slots[(hash + i) & mask];
+                const auto slotIp = slot.ip.load(std::memory_order_acquire);
+                if (!slotIp) {
+                    break;
+                } else if (slotIp == ip) {
+                    const auto parentAndIndex = slot.parentAndIndex.load(std::memory_order_acquire);
+                    if (parentAndIndex && (parentAndIndex >> 32) == parentIndex) {
+                        return static_cast<uint32_t>(parentAndIndex);
+                    }
+                }
+            }
+            return 0;
+        }
+
+        template <typename Fun>
+        InsertResult insert(size_t hash, uintptr_t ip, uint32_t parentIndex, std::atomic<uint32_t>& nextIndex,
+                            Fun onNewIndex)
+        {
+            for (size_t i = 0; i <= mask; ++i) {
+                auto& slot = slots[(hash + i) & mask];
+                uintptr_t slotIp = 0;
+                if (slot.ip.compare_exchange_strong(slotIp, ip)) {
+                    const auto index = nextIndex.fetch_add(1);
+                    onNewIndex(index);
+                    slot.parentAndIndex.store((uint64_t(parentIndex) << 32) | index, std::memory_order_release);
+                    size.fetch_add(1, std::memory_order_relaxed);
+                    return {index, true};
+                } else if (slotIp == ip) {
+                    // slots that are still getting filled are skipped, potentially creating a duplicate
+                    const auto parentAndIndex = slot.parentAndIndex.load(std::memory_order_acquire);
+                    if (parentAndIndex && (parentAndIndex >> 32) == parentIndex) {
+                        return {static_cast<uint32_t>(parentAndIndex), false};
+                    }
+                }
+            }
+            return {0, false};
+        }
+
+        const size_t mask;
+        Table* const previous;
+        std::vector<Slot, InternalAllocator<Slot>> slots;
+        std::atomic<size_t> size {0};
+    };
+
+    static size_t hashOf(uintptr_t ip, uint32_t parentIndex)
+    {
+        const auto hash = (uint64_t(ip) ^ (uint64_t(parentIndex) << 40) ^ parentIndex) * 0x9E3779B97F4A7C15ull;
+        return static_cast<size_t>(hash ^ (hash >> 29));
+    }
+
+    Table* grow(Table* table)
+    {
+        auto* larger = newTable(table->capacity() * 4, table);
+        if (m_table.compare_exchange_strong(table, larger, std::memory_order_acq_rel)) {
+            return larger;
+        }
+        // another thread grew the table in the meantime
+        deleteTable(larger);
+        return table;
+    }
+
+    static Table* newTable(size_t capacity, Table* previous)
+    {
+        return new (InternalAllocator<Table>().allocate(1)) Table(capacity, previous);
+    }
+
+    static void deleteTable(Table* table)
+    {
+        table->~Table();
+        InternalAllocator<Table>().deallocate(table, 1);
+    }
+
+    std::atomic<Table*> m_table;
+    std::atomic<uint32_t> m_nextIndex {1};
+};
+
 #endif // TRACETREE_H
@@ -0,0 +1,116 @@
+/*
+    SPDX-FileCopyrightText: 2026 heaptrack contributors
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef TRIGGERRULES_H
+#define TRIGGERRULES_H
+
+/**
+ * @file triggerrules.h
+ * @brief Thresholds on the memory consumption that trigger recording or dumping.
+ */
+
+#include <chrono>
+#include <cstdint>
+
+/**
+ * The rules get checked by the timer thread. Each rule fires once when its metric
+ * crosses the threshold, and again only after the metric went below it before.
+ */
+class TriggerRules
+{
+public:
+    enum class Metric
+    {
+        None,
+        Rss,
+        Heap,
+        RssGrowth,
+    };
+
+    /// thresholds in bytes, or bytes per second for the growth, zero disables a rule
+    uint64_t rssThreshold = 0;
+    uint64_t heapThreshold = 0;
+    uint64_t rssGrowthThreshold = 0;
+
+    bool isEnabled() const
+    {
+        return rssThreshold || heapThreshold || rssGrowthThreshold;
+    }
+
+    /**
+     * Check the rules for the current @p rss and @p heap size in bytes.
+     *
+     * @return the metric that crossed its threshold, or Metric::None
+     */
+    Metric update(uint64_t rss, uint64_t heap, std::chrono::steady_clock::time_point now)
+    {
+        auto fired = Metric::None;
+        if (crossed(rssThreshold && rss >= rssThreshold, &m_rssExceeded)) {
+            fired = Metric::Rss;
+        }
+        if (crossed(heapThreshold && heap >= heapThreshold, &m_heapExceeded)) {
+            fired = Metric::Heap;
+        }
+        if (rssGrowthThreshold && updateGrowth(rss, now)) {
+            fired = Metric::RssGrowth;
+        }
+        return fired;
+    }
+
+    static const char* name(Metric metric)
+    {
+        switch (metric) {
+        case Metric::Rss:
+            return "RSS";
+        case Metric::Heap:
+            return "heap";
+        case Metric::RssGrowth:
+            return "RSS growth";
+        case Metric::None:
+            break;
+        }
+        return "none";
+    }
+
+private:
+    static bool crossed(bool exceeded, bool* wasExceeded)
+    {
+        const bool fire = exceeded && !*wasExceeded;
+        *wasExceeded = exceeded;
+        return fire;
+    }
+
+    /// the growth is measured over intervals of at least one second, to smooth out short spikes
+    bool updateGrowth(uint64_t rss, std::chrono::steady_clock::time_point now)
+    {
+        if (!m_hasGrowthSample) {
+            m_hasGrowthSample = true;
+            m_growthSampleRss = rss;
+            m_growthSampleTime = now;
+            return false;
+        }
+
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_growthSampleTime).count();
+        if (elapsed < 1000) {
+            return false;
+        }
+
+        const auto growth = rss > m_growthSampleRss ? (rss - m_growthSampleRss) * 1000 / elapsed : 0;
+        m_growthSampleRss = rss;
+        m_growthSampleTime = now;
+        return crossed(growth >= rssGrowthThreshold, &m_growthExceeded);
+    }
+
+    bool m_rssExceeded = false;
+    bool m_heapExceeded = false;
+    bool m_growthExceeded = false;
+
+    bool m_hasGrowthSample = false;
+    uint64_t m_growthSampleRss = 0;
+    std::chrono::steady_clock::time_point m_growthSampleTime;
+};
+
+#endif // TRIGGERRULES_H
@@ -0,0 +1,95 @@
+/*
+    SPDX-FileCopyrightText: 2026 heaptrack contributors
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include "unwindcache.h"
+
+#include "stackbounds.h"
+
+#include <algorithm>
+
+std::atomic<bool> Trace::s_useUnwindCache {false};
+
+void Trace::setUnwindCaching(bool enabled)
+{
+    s_useUnwindCache = enabled && UnwindCache::supported();
+}
+
+UnwindCache* UnwindCache::threadCache()
+{
+    // trivially constructible, so this doesn't require any allocation or TLS destructor
+    static thread_local UnwindCache t_cache;
+    return &t_cache;
+}
+
+// we read return addresses of frames that may have returned already
+__attribute__((no_sanitize_address)) void UnwindCache::begin(void** data, int maxSize)
+{
+    m_data = data;
+    m_maxSize = std::min(maxSize, static_cast<int>(Trace::MAX_SIZE));
+    m_size = 0;
+    m_cursor = 0;
+
+    next().truncated = false;
+
+    // find the longest suffix of the previous trace whose return addresses are
+    // still found on the stack, i.e. whose frames may still be alive. Frames outside
+    // of the thread stack, e.g. of a fiber or on an alternate signal stack, invalidate
+    // the cache from there on, as their memory may have been unmapped in the meantime
+    const auto bounds = threadStackBounds();
+    const auto& frames = previous();
+    m_validFrom = frames.size;
+    for (int i = frames.size - 1; i >= 0; --i) {
+        const auto sp = frames.sps[i];
+        if (!sp || !bounds.contains(sp - sizeof(void*), sizeof(void*))
+            || *reinterpret_cast<void* const*>(sp - sizeof(void*)) != frames.ips[i]) {
+            break;
+        }
+        m_validFrom = i;
+    }
+}
+
+bool UnwindCache::add(void* ip, uintptr_t sp)
+{
+    auto& frames = previous();
+    auto& trace = next();
+
+    // the stack grows downwards, so the stack pointers of the outer frames are increasing
+    while (m_cursor < frames.size && frames.sps[m_cursor] < sp) {
+        ++m_cursor;
+    }
+
+    // when the previous trace was truncated, we can only reuse its frames when that
+    // yields a full trace again, otherwise we would be missing some outer frames
+    if (sp && m_cursor >= m_validFrom && m_cursor < frames.size && frames.sps[m_cursor] == sp
+        && frames.ips[m_cursor] == ip && (!frames.truncated || m_size >= m_cursor)) {
+        const auto remaining = frames.size - m_cursor;
+        const auto count = std::min(remaining, m_maxSize - m_size);
+        std::copy_n(frames.ips + m_cursor, count, trace.ips + m_size);
+        std::copy_n(frames.sps + m_cursor, count, trace.sps + m_size);
+        std::copy_n(frames.ips + m_cursor, count, m_data + m_size);
+        m_size += count;
+        trace.truncated = frames.truncated || count < remaining;
+        return false;
+    }
+
+    if (m_size == m_maxSize) {
+        trace.truncated = true;
+        return false;
+    }
+
+    trace.ips[m_size] = ip;
+    trace.sps[m_size] = sp;
+    m_data[m_size] = ip;
+    ++m_size;
+    return true;
+}
+
+int UnwindCache::end()
+{
+    next().size = m_size;
+    m_current = 1 - m_current;
+    return m_size;
+}
@@ -0,0 +1,103 @@
+/*
+    SPDX-FileCopyrightText: 2026 heaptrack contributors
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef UNWINDCACHE_H
+#define UNWINDCACHE_H
+
+/**
+ * @file unwindcache.h
+ * @brief Per-thread cache of the last backtrace, to stop unwinding early.
+ */
+
+#include <cstdint>
+
+#include "trace.h"
+
+/**
+ * Remembers the stack pointer of every frame in the last backtrace of a thread,
+ * i.e. the value it has after returning to the instruction pointer of the frame.
+ * When we reach a frame with the same instruction pointer and stack pointer while
+ * unwinding, the remaining outer frames are taken from the cached trace instead
+ * of unwinding them again.
+ *
+ * The outer frames could have returned and been replaced by different calls
+ * in the meantime. That is why we first compare the return addresses that are
+ * stored on the stack against the cached trace. This only works where the call
+ * instruction pushes the return address onto the stack, i.e. on x86. On all
+ * other architectures, the cache is never used.
+ */
+class UnwindCache
+{
+public:
+    static bool supported()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /**
+     * @return the cache of the calling thread
+     */
+    static UnwindCache* threadCache();
+
+    /**
+     * Start a new backtrace, which will be written into @p data.
+     */
+    void begin(void** data, int maxSize);
+
+    /**
+     * Add the frame with the instruction pointer @p ip. The stack pointer @p sp
+     * is the value after returning to @p ip, i.e. the return address is stored
+     * right below it. It may be zero when it is unknown.
+     *
+     * @return false when unwinding should stop, either because the outer frames
+     *         got taken from the cache or because the trace is full
+     */
+    bool add(void* ip, uintptr_t sp);
+
+    /**
+     * Finish the backtrace and remember it for the next one.
+     *
+     * @return the size of the backtrace
+     */
+    int end();
+
+private:
+    struct Frames
+    {
+        void* ips[Trace::MAX_SIZE];
+        uintptr_t sps[Trace::MAX_SIZE];
+        int size;
+        // true when the outermost frames did not fit into the trace
+        bool truncated;
+    };
+
+    Frames& previous()
+    {
+        return m_frames[m_current];
+    }
+
+    Frames& next()
+    {
+        return m_frames[1 - m_current];
+    }
+
+    Frames m_frames[2];
+    int m_current;
+
+    void** m_data;
+    int m_maxSize;
+    int m_size;
+    // position in the previous trace of the next frame we may match against
+    int m_cursor;
+    // the previous trace matches the stack from this position onwards
+    int m_validFrom;
+};
+
+#endif // UNWINDCACHE_H
@@ -0,0 +1,164 @@
+/*
+    SPDX-FileCopyrightText: 2026 heaptrack contributors
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef BINARYRECORDS_H
+#define BINARYRECORDS_H
+
+#include <cstdint>
+
+/**
+ * Compact binary encoding for the most frequent lines of the raw data files,
+ * i.e. '+', '-', 'T', 't' and 'C'. Since file format version 4, such records can be
+ * mixed freely with the textual lines.
+ *
+ * A binary record starts with its mode char with the high bit set, which can
+ * never occur at the start of a textual line. It is followed by its arguments
+ * encoded as unsigned LEB128 numbers, without any separators.
+ *
+ * Pointers are encoded relative to the pointer of the previous allocation,
+ * and instruction pointers relative to the previous trace point. These deltas
+ * are zigzag encoded, so that small negative values stay short too.
+ *
+ * With usable sizes, '+' and 'T' carry the usable size of the allocation as an
+ * additional argument, which is encoded relative to the requested size.
+ */
+class BinaryRecordCodec
+{
+public:
+    enum : unsigned char
+    {
+        TAG_BIT = 0x80
+    };
+
+    enum
+    {
+        MAX_ARGS = 4,
+        MAX_VARINT_SIZE = 10 // ceil(64 / 7)
+    };
+
+    /**
+     * @return the number of arguments of a binary record for @p mode, or zero
+     *         when this mode cannot be encoded as a binary record
+     */
+    static int numArgs(char mode, bool usableSizes = false)
+    {
+        switch (mode) {
+        case '+':
+            return usableSizes ? 4 : 3;
+        case '-':
+        case 'C':
+            return 1;
+        case 'T':
+            return usableSizes ? 3 : 2;
+        case 't':
+            return 2;
+        default:
+            return 0;
+        }
+    }
+
+    /**
+     * Whether '+' and 'T' records carry the usable size, see HEAPTRACK_USABLE_SIZE.
+     */
+    void setUsableSizes(bool usableSizes)
+    {
+        m_usableSizes = usableSizes;
+    }
+
+    bool usableSizes() const
+    {
+        return m_usableSizes;
+    }
+
+    /**
+     * Transform the arguments of a record for @p mode into the values to encode.
+     */
+    void encode(char mode, uint64_t* args)
+    {
+        switch (mode) {
+        case '+': {
+            const auto ptr = args[2];
+            args[2] = zigzag(ptr - m_lastAllocation);
+            m_lastAllocation = ptr;
+            if (m_usableSizes) {
+                args[3] = zigzag(args[3] - args[0]);
+            }
+            break;
+        }
+        case 'T':
+            if (m_usableSizes) {
+                args[2] = zigzag(args[2] - args[0]);
+            }
+            break;
+        case '-':
+            args[0] = zigzag(args[0] - m_lastAllocation);
+            break;
+        case 't': {
+            const auto ip = args[0];
+            args[0] = zigzag(ip - m_lastInstructionPointer);
+            m_lastInstructionPointer = ip;
+            break;
+        }
+        }
+    }
+
+    /**
+     * Transform the decoded values of a record for @p mode back into its arguments.
+     */
+    void decode(char mode, uint64_t* args)
+    {
+        switch (mode) {
+        case '+':
+            args[2] = m_lastAllocation + unzigzag(args[2]);
+            m_lastAllocation = args[2];
+            if (m_usableSizes) {
+                args[3] = args[0] + unzigzag(args[3]);
+            }
+            break;
+        case 'T':
+            if (m_usableSizes) {
+                args[2] = args[0] + unzigzag(args[2]);
+            }
+            break;
+        case '-':
+            args[0] = m_lastAllocation + unzigzag(args[0]);
+            break;
+        case 't':
+            args[0] = m_lastInstructionPointer + unzigzag(args[0]);
+            m_lastInstructionPointer = args[0];
+            break;
+        }
+    }
+
+    static char* writeVarint(char* buffer, uint64_t value)
+    {
+        while (value >= 0x80) {
+            *buffer = static_cast<char>(value | 0x80);
+            ++buffer;
+            value >>= 7;
+        }
+        *buffer = static_cast<char>(value);
+        return buffer + 1;
+    }
+
+private:
+    // the differences are computed modulo 2^64, which is fine as the decoder does the same
+    static uint64_t zigzag(uint64_t delta)
+    {
+        return (delta << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(delta) >> 63);
+    }
+
+    static uint64_t unzigzag(uint64_t value)
+    {
+        return (value >> 1) ^ (~(value & 1) + 1);
+    }
+
+    uint64_t m_lastAllocation = 0;
+    uint64_t m_lastInstructionPointer = 0;
+    bool m_usableSizes = false;
+};
+
+#endif // BINARYRECORDS_H
@@ -17,9 +17,14 @@
 
 #define HEAPTRACK_DEBUG_BUILD @HEAPTRACK_DEBUG_BUILD@
 
+#cmakedefine01 HEAPTRACK_USE_FRAMEPOINTER
+
+#cmakedefine01 ZSTD_FOUND
+
 // cfree() does not exist in glibc 2.26+.
 // See: https://bugs.kde.org/show_bug.cgi?id=383889
 #cmakedefine01 HAVE_CFREE
 #cmakedefine01 HAVE_VALLOC
+#cmakedefine01 HAVE_MALLOC_USABLE_SIZE
 
 #endif // HEAPTRACK_CONFIG_H
@@ -0,0 +1,259 @@
+/*
+    SPDX-FileCopyrightText: 2026 heaptrack contributors
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef INTERNALARENA_H
+#define INTERNALARENA_H
+
+/**
+ * @file internalarena.h
+ * @brief Private memory for heaptrack's own data structures, bypassing malloc.
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <utility>
+
+#include <sys/mman.h>
+
+/**
+ * A pool allocator on top of memory that is mapped directly, such that the
+ * data structures of heaptrack do not share the heap with the debuggee.
+ * This way, we know how much of the RSS is caused by heaptrack itself.
+ *
+ * Small sizes get rounded up to a power of two and are carved out of large
+ * chunks. Freed blocks are kept in a free list per size class for reuse.
+ * Large sizes get mapped and unmapped individually. All blocks are aligned
+ * to their size, up to a cache line, such that e.g. alignas(64) is honored.
+ */
+class InternalArena
+{
+public:
+    /**
+     * The arena is never destroyed, as heaptrack's data is used until the very end.
+     */
+    static InternalArena& instance()
+    {
+        static auto* arena = new (s_storage) InternalArena;
+        return *arena;
+    }
+
+    void* allocate(size_t size)
+    {
+        if (size > MAX_SMALL_SIZE) {
+            const auto mappedSize = pageAligned(size);
+            auto* ptr = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (ptr == MAP_FAILED) {
+                return nullptr;
+            }
+            m_usedBytes += mappedSize;
+            return ptr;
+        }
+
+        const auto sizeClass = sizeClassFor(size);
+        std::lock_guard<std::mutex> guard(m_lock);
+        if (auto* block = m_freeLists[sizeClass]) {
+            m_freeLists[sizeClass] = block->next;
+            return block;
+        }
+
+        const auto blockSize = size_t(MIN_SIZE) << sizeClass;
+        const auto alignment = std::min(blockSize, size_t(CACHE_LINE_SIZE));
+        auto offset = (m_chunkUsed + alignment - 1) & ~(alignment - 1);
+        if (m_chunkSize < offset + blockSize) {
+            auto* chunk = mmap(nullptr, CHUNK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (chunk == MAP_FAILED) {
+                return nullptr;
+            }
+            // the remainder of the previous chunk is lost, which is at most one block of the largest size class
+            m_chunk = static_cast<char*>(chunk);
+            m_chunkSize = CHUNK_SIZE;
+            offset = 0;
+        }
+        auto* ptr = m_chunk + offset;
+        m_chunkUsed = offset + blockSize;
+        m_usedBytes += blockSize;
+        return ptr;
+    }
+
+    void deallocate(void* ptr, size_t size)
+    {
+        if (!ptr) {
+            return;
+        } else if (size > MAX_SMALL_SIZE) {
+            const auto mappedSize = pageAligned(size);
+            munmap(ptr, mappedSize);
+            m_usedBytes -= mappedSize;
+            return;
+        }
+
+        const auto sizeClass = sizeClassFor(size);
+        std::lock_guard<std::mutex> guard(m_lock);
+        auto* block = static_cast<FreeBlock*>(ptr);
+        block->next = m_freeLists[sizeClass];
+        m_freeLists[sizeClass] = block;
+    }
+
+    /**
+     * @return the number of bytes that got touched by heaptrack's data, including the free blocks
+     */
+    uint64_t usedBytes() const
+    {
+        return m_usedBytes.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Hold the lock across fork, such that the child inherits consistent free lists.
+     */
+    void lockForFork()
+    {
+        m_lock.lock();
+    }
+
+    void unlockAfterFork()
+    {
+        m_lock.unlock();
+    }
+
+private:
+    InternalArena() = default;
+
+    enum : size_t
+    {
+        MIN_SIZE = 16,
+        NUM_SIZE_CLASSES = 13,
+        MAX_SMALL_SIZE = MIN_SIZE << (NUM_SIZE_CLASSES - 1), // 64KiB
+        CHUNK_SIZE = 16 * MAX_SMALL_SIZE,
+        PAGE_SIZE = 4096,
+        CACHE_LINE_SIZE = 64,
+    };
+
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    static size_t sizeClassFor(size_t size)
+    {
+        size_t sizeClass = 0;
+        while ((size_t(MIN_SIZE) << sizeClass) < size) {
+            ++sizeClass;
+        }
+        return sizeClass;
+    }
+
+    static size_t pageAligned(size_t size)
+    {
+        return (size + PAGE_SIZE - 1) & ~size_t(PAGE_SIZE - 1);
+    }
+
+    std::mutex m_lock;
+    FreeBlock* m_freeLists[NUM_SIZE_CLASSES] = {};
+    char* m_chunk = nullptr;
+    size_t m_chunkSize = 0;
+    size_t m_chunkUsed = 0;
+    std::atomic<uint64_t> m_usedBytes {0};
+
+    alignas(std::max_align_t) static char s_storage[];
+};
+
+alignas(std::max_align_t) inline char InternalArena::s_storage[sizeof(InternalArena)];
+
+/**
+ * Allocator for standard containers which puts their data into the InternalArena.
+ */
+template <typename T>
+struct InternalAllocator
+{
+    using value_type = T;
+
+    InternalAllocator() noexcept = default;
+    template <typename U>
+    InternalAllocator(const InternalAllocator<U>& /*other*/) noexcept
+    {
+    }
+
+    T* allocate(size_t count)
+    {
+        static_assert(alignof(T) <= 64, "the InternalArena aligns to a cache line at most");
+        auto* ptr = InternalArena::instance().allocate(count * sizeof(T));
+        if (!ptr) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(ptr);
+    }
+
+    void deallocate(T* ptr, size_t count) noexcept
+    {
+        InternalArena::instance().deallocate(ptr, count * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const InternalAllocator<U>& /*other*/) const noexcept
+    {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const InternalAllocator<U>& /*other*/) const noexcept
+    {
+        return false;
+    }
+};
+
+/**
+ * A string whose characters live in the InternalArena.
+ */
+using InternalString = std::basic_string<char, std::char_traits<char>, InternalAllocator<char>>;
+
+/**
+ * Destroys an object that got created by makeInternal(). It remembers the size
+ * of the object, such that a pointer to the base class can release the object
+ * of a derived class, as long as the base class comes first.
+ */
+template <typename T>
+struct InternalDeleter
+{
+    InternalDeleter() noexcept = default;
+    template <typename U>
+    InternalDeleter(const InternalDeleter<U>& other) noexcept
+        : size(other.size)
+    {
+    }
+
+    void operator()(T* ptr) const noexcept
+    {
+        ptr->~T();
+        InternalArena::instance().deallocate(ptr, size);
+    }
+
+    size_t size = sizeof(T);
+};
+
+template <typename T>
+using InternalPtr = std::unique_ptr<T, InternalDeleter<T>>;
+
+/**
+ * Like std::make_unique, but puts the object into the InternalArena.
+ */
+template <typename T, typename... Args>
+InternalPtr<T> makeInternal(Args&&... args)
+{
+    InternalAllocator<T> allocator;
+    auto* ptr = allocator.allocate(1);
+    try {
+        return InternalPtr<T>(new (ptr) T(std::forward<Args>(args)...));
+    } catch (...) {
+        allocator.deallocate(ptr, 1);
+        throw;
+    }
+}
+
+#endif // INTERNALARENA_H
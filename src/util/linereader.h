@@ -11,6 +11,8 @@
 #include <istream>
 #include <string>
 
+#include "binaryrecords.h"
+
 /**
  * Optimized class to speed up reading of the potentially big data files.
  *
@@ -31,6 +33,14 @@ public:
         if (!in.good()) {
             return false;
         }
+        m_binaryArg = m_numBinaryArgs = 0;
+        if (m_binaryRecords) {
+            // look at the next byte directly, istream::peek would construct a sentry for every line
+            const auto next = in.rdbuf()->sgetc();
+            if (next != std::istream::traits_type::eof() && (next & BinaryRecordCodec::TAG_BIT)) {
+                return readBinaryRecord(in);
+            }
+        }
         std::getline(in, m_line);
         m_it = m_line.cbegin();
         if (m_line.length() > 2) {
@@ -54,6 +64,11 @@ public:
     template <typename T>
     bool readHex(T& in)
     {
+        if (m_binaryArg < m_numBinaryArgs) {
+            in = static_cast<T>(m_binaryArgs[m_binaryArg++]);
+            return true;
+        }
+
         auto it = m_it;
         const auto end = m_line.cend();
         if (it == end) {
@@ -109,6 +124,30 @@ public:
         m_expectSizedStrings = expectSizedStrings;
     }
 
+    /**
+     * Expect binary records mixed in with the textual lines, which is possible since file format version 4.
+     */
+    void setBinaryRecords(bool binaryRecords)
+    {
+        m_binaryRecords = binaryRecords;
+    }
+
+    /**
+     * Start over with the binary records, e.g. when another data file follows after the current one.
+     */
+    void resetBinaryRecords()
+    {
+        m_binaryCodec = {};
+    }
+
+    /**
+     * Expect the usable size in the binary records of allocations, see BinaryRecordCodec.
+     */
+    void setUsableSizes(bool usableSizes)
+    {
+        m_binaryCodec.setUsableSizes(usableSizes);
+    }
+
     bool operator>>(std::string& str)
     {
         if (m_expectSizedStrings) {
@@ -158,9 +197,50 @@ public:
     }
 
 private:
+    bool readBinaryRecord(std::istream& in)
+    {
+        auto* buffer = in.rdbuf();
+        const char mode = static_cast<char>(buffer->sbumpc() & ~BinaryRecordCodec::TAG_BIT);
+        const auto numArgs = BinaryRecordCodec::numArgs(mode, m_binaryCodec.usableSizes());
+        if (!numArgs) {
+            fprintf(stderr, "unexpected binary record: %d\n", mode);
+            in.setstate(std::ios::failbit);
+            return false;
+        }
+
+        for (int i = 0; i < numArgs; ++i) {
+            uint64_t value = 0;
+            for (int shift = 0;; shift += 7) {
+                const auto byte = buffer->sbumpc();
+                if (byte == std::istream::traits_type::eof() || shift >= 64) {
+                    fprintf(stderr, "truncated binary record: %d\n", mode);
+                    in.setstate(std::ios::eofbit | std::ios::failbit);
+                    return false;
+                }
+                value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) {
+                    break;
+                }
+            }
+            m_binaryArgs[i] = value;
+        }
+        m_binaryCodec.decode(mode, m_binaryArgs);
+        m_numBinaryArgs = numArgs;
+
+        // the arguments can only be read via readHex
+        m_line.assign(1, mode);
+        m_it = m_line.cend();
+        return true;
+    }
+
     bool m_expectSizedStrings = false;
+    bool m_binaryRecords = false;
     std::string m_line;
     std::string::const_iterator m_it;
+    BinaryRecordCodec m_binaryCodec;
+    uint64_t m_binaryArgs[BinaryRecordCodec::MAX_ARGS];
+    int m_binaryArg = 0;
+    int m_numBinaryArgs = 0;
 };
 
 #endif // LINEREADER_H
@@ -8,9 +8,14 @@
 #define LINEWRITER_H
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <iterator>
 #include <memory>
+#include <mutex>
 #include <type_traits>
+#include <vector>
 
 #include <cassert>
 #include <climits>
@@ -21,9 +26,15 @@
 #include <errno.h>
 #include <unistd.h>
 
+#include "binaryrecords.h"
+#include "internalarena.h"
+
 /**
  * Custom buffered I/O writer for high performance and signal safety
  * See e.g.: https://bugs.kde.org/show_bug.cgi?id=393387
+ *
+ * In the optional asynchronous mode, full buffers are handed over to a
+ * dedicated writer thread, see enableAsync().
  */
 class LineWriter
 {
@@ -33,11 +44,49 @@ public:
         BUFFER_CAPACITY = PIPE_BUF
     };
 
+    /**
+     * What to do in asynchronous mode when the buffer is full while the
+     * writer thread is still busy writing out the previous one.
+     */
+    enum class OverflowPolicy
+    {
+        /// wait for the writer thread
+        Block,
+        /// drop allocation lines, i.e. '+' and 'T', and wait for all others. Deallocations are never
+        /// dropped, as they would turn into leaks. Those of dropped allocations get ignored when interpreting.
+        Drop
+    };
+
+    /**
+     * Transforms the data before it gets written, e.g. to compress it.
+     */
+    class OutputFilter
+    {
+    public:
+        virtual ~OutputFilter() = default;
+
+        /// write the transformed @p data of @p size bytes to @p fd
+        virtual bool write(int fd, const char* data, size_t size) = 0;
+
+        /// write any remaining data to @p fd, which gets closed afterwards
+        virtual bool finish(int fd) = 0;
+    };
+
+    struct AsyncStats
+    {
+        /// number of buffers handed over to the writer thread
+        uint64_t buffers = 0;
+        /// number of times we had to wait for the writer thread
+        uint64_t stalls = 0;
+        uint64_t stallNanoseconds = 0;
+        /// number of lines dropped due to OverflowPolicy::Drop
+        uint64_t dropped = 0;
+    };
+
     LineWriter(int fd)
         : fd(fd)
-        , buffer(new char[BUFFER_CAPACITY])
+        , buffer(BUFFER_CAPACITY)
     {
-        memset(buffer.get(), 0, BUFFER_CAPACITY);
     }
 
     ~LineWriter()
@@ -45,6 +94,88 @@ public:
         close();
     }
 
+    /**
+     * Switch to the asynchronous mode, where flush() only hands over the buffer
+     * of @p capacity bytes to a writer thread which runs runAsyncWriter(). We
+     * continue to write into a second buffer of the same size in the meantime.
+     *
+     * Must be called before anything got written.
+     */
+    void enableAsync(size_t capacity, OverflowPolicy policy)
+    {
+        assert(!bufferSize && !async);
+        capacity = std::max(capacity, static_cast<size_t>(BUFFER_CAPACITY));
+        async = makeInternal<AsyncState>();
+        async->policy = policy;
+        async->otherBuffer.resize(capacity);
+        buffer.resize(capacity);
+        bufferCapacity = capacity;
+    }
+
+    bool isAsync() const
+    {
+        return async != nullptr;
+    }
+
+    /**
+     * Pass all data through @p filter before writing it out.
+     *
+     * Must be called before anything got written.
+     */
+    void setOutputFilter(InternalPtr<OutputFilter> filter)
+    {
+        assert(!bufferSize);
+        outputFilter = std::move(filter);
+    }
+
+    /**
+     * Write the usable size in the binary records of allocations, see BinaryRecordCodec.
+     */
+    void setUsableSizes(bool usableSizes)
+    {
+        binaryCodec.setUsableSizes(usableSizes);
+    }
+
+    /**
+     * The loop of the writer thread in asynchronous mode, returns after close().
+     */
+    void runAsyncWriter()
+    {
+        assert(async);
+        std::unique_lock<std::mutex> lock(async->mutex);
+        while (true) {
+            async->wakeWriter.wait(lock, [this]() { return async->pendingSize || async->stop; });
+            const size_t size = async->pendingSize;
+            if (!size) {
+                break;
+            }
+
+            lock.unlock();
+            const bool success = writeOut(async->otherBuffer.data(), size);
+            lock.lock();
+
+            async->failed = async->failed || !success;
+            async->pendingSize = 0;
+            async->writerDone.notify_all();
+        }
+    }
+
+    /**
+     * Hand over the buffer to the writer thread in asynchronous mode, but only
+     * when that doesn't require us to wait for it.
+     */
+    void flushIfIdle()
+    {
+        if (async && !async->pendingSize) {
+            flush();
+        }
+    }
+
+    AsyncStats asyncStats() const
+    {
+        return async ? async->stats : AsyncStats();
+    }
+
     /**
      * write an arbitrarily formatted string to the buffer
      */
@@ -122,11 +253,8 @@ public:
                 return false;
             }
             if (availableSpace() < length) {
-                ssize_t ret = 0;
-                do {
-                    ret = ::write(fd, line.data(), length);
-                } while (ret < 0 && errno == EINTR);
-                return ret >= 0;
+                // the writer thread must be done before we can write directly
+                return waitForAsyncWriter() && writeOut(line.data(), length);
             }
         }
         memcpy(out(), line.data(), length);
@@ -153,8 +281,12 @@ public:
         constexpr const int totalMaxChars = otherChars + maxCharsForArgs + spaceCharsForArgs + otherChars;
         static_assert(totalMaxChars < BUFFER_CAPACITY, "cannot write line larger than buffer capacity");
 
-        if (totalMaxChars > availableSpace() && !flush()) {
-            return false;
+        if (totalMaxChars > availableSpace()) {
+            if (dropLine(type)) {
+                return true;
+            } else if (!flush()) {
+                return false;
+            }
         }
 
         auto* buffer = out();
@@ -176,6 +308,47 @@ public:
         return true;
     }
 
+    /**
+     * write one of the frequent heaptrack output lines as a binary record
+     *
+     * @arg type char that identifies the type of the line, see BinaryRecordCodec::numArgs
+     * @arg args are the same as for writeHexLine
+     */
+    template <typename... T>
+    bool writeBinaryLine(const char type, T... args)
+    {
+        constexpr const int numArgs = sizeof...(T);
+        static_assert(numArgs <= BinaryRecordCodec::MAX_ARGS, "too many arguments for a binary record");
+        constexpr const int totalMaxChars = 1 + numArgs * BinaryRecordCodec::MAX_VARINT_SIZE;
+        assert(BinaryRecordCodec::numArgs(type, binaryCodec.usableSizes()) == numArgs);
+
+        if (totalMaxChars > availableSpace()) {
+            if (dropLine(type)) {
+                return true;
+            } else if (!flush()) {
+                return false;
+            }
+        }
+
+        // the codec may access all arguments of a record, see BinaryRecordCodec::numArgs
+        uint64_t values[BinaryRecordCodec::MAX_ARGS] = {static_cast<uint64_t>(args)...};
+        binaryCodec.encode(type, values);
+
+        auto* buffer = out();
+        const auto* start = buffer;
+
+        *buffer = static_cast<char>(type | BinaryRecordCodec::TAG_BIT);
+        ++buffer;
+
+        for (int i = 0; i < numArgs; ++i) {
+            buffer = BinaryRecordCodec::writeVarint(buffer, values[i]);
+        }
+
+        bufferSize += buffer - start;
+
+        return true;
+    }
+
     inline static unsigned clz(unsigned V)
     {
         return __builtin_clz(V);
@@ -252,12 +425,23 @@ public:
             return true;
         }
 
-        ssize_t ret = 0;
-        do {
-            ret = ::write(fd, buffer.get(), bufferSize);
-        } while (ret < 0 && errno == EINTR);
+        written += bufferSize;
+        if (async) {
+            if (!waitForAsyncWriter()) {
+                return false;
+            }
+            {
+                std::lock_guard<std::mutex> lock(async->mutex);
+                std::swap(buffer, async->otherBuffer);
+                async->pendingSize = bufferSize;
+                ++async->stats.buffers;
+            }
+            async->wakeWriter.notify_one();
+            bufferSize = 0;
+            return true;
+        }
 
-        if (ret < 0) {
+        if (!writeOut(buffer.data(), bufferSize)) {
             return false;
         }
 
@@ -271,8 +455,30 @@ public:
         return fd != -1;
     }
 
+    /**
+     * @return the number of bytes flushed so far, before compression or any output filter
+     */
+    uint64_t bytesWritten() const
+    {
+        return written;
+    }
+
     void close()
     {
+        if (async && fd != -1) {
+            // write out everything, then let the writer thread finish
+            flush();
+            waitForAsyncWriter();
+            {
+                std::lock_guard<std::mutex> lock(async->mutex);
+                async->stop = true;
+            }
+            async->wakeWriter.notify_one();
+        }
+        if (outputFilter && fd != -1) {
+            flush();
+            outputFilter->finish(fd);
+        }
         if (fd != -1) {
             ::close(fd);
             fd = -1;
@@ -280,19 +486,102 @@ public:
     }
 
 private:
+    /// our buffers live in the InternalArena, such that they don't count towards the heap of the debuggee
+    using Buffer = std::vector<char, InternalAllocator<char>>;
+
+    struct AsyncState
+    {
+        std::mutex mutex;
+        std::condition_variable wakeWriter;
+        std::condition_variable writerDone;
+        /// the buffer we are not writing into, owned by the writer thread while pendingSize is set
+        Buffer otherBuffer;
+        std::atomic<size_t> pendingSize {0};
+        bool stop = false;
+        bool failed = false;
+        OverflowPolicy policy = OverflowPolicy::Block;
+        AsyncStats stats;
+    };
+
+    /**
+     * @return true when the line of @p type should be dropped instead of waiting for the writer thread
+     */
+    bool dropLine(char type)
+    {
+        if (!async || async->policy != OverflowPolicy::Drop || (type != '+' && type != 'T')
+            || !async->pendingSize.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        ++async->stats.dropped;
+        return true;
+    }
+
+    /**
+     * Wait until the writer thread is idle, if there is one.
+     *
+     * @return false when the writer thread failed to write
+     */
+    bool waitForAsyncWriter()
+    {
+        if (!async) {
+            return true;
+        }
+        std::unique_lock<std::mutex> lock(async->mutex);
+        if (async->pendingSize) {
+            const auto start = std::chrono::steady_clock::now();
+            async->writerDone.wait(lock, [this]() { return !async->pendingSize; });
+            ++async->stats.stalls;
+            async->stats.stallNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                 std::chrono::steady_clock::now() - start)
+                                                 .count();
+        }
+        return !async->failed;
+    }
+
+public:
+    /**
+     * write all of @p data to @p fd, retrying after partial writes
+     */
+    static bool writeAll(int fd, const char* data, size_t size)
+    {
+        while (size) {
+            const auto ret = ::write(fd, data, size);
+            if (ret < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            data += ret;
+            size -= ret;
+        }
+        return true;
+    }
+
+private:
+    bool writeOut(const char* data, size_t size)
+    {
+        return outputFilter ? outputFilter->write(fd, data, size) : writeAll(fd, data, size);
+    }
+
     size_t availableSpace() const
     {
-        return BUFFER_CAPACITY - bufferSize;
+        return bufferCapacity - bufferSize;
     }
 
     char* out()
     {
-        return buffer.get() + bufferSize;
+        return buffer.data() + bufferSize;
     }
 
     int fd = -1;
     size_t bufferSize = 0;
-    std::unique_ptr<char[]> buffer;
+    uint64_t written = 0;
+    size_t bufferCapacity = BUFFER_CAPACITY;
+    Buffer buffer;
+    InternalPtr<AsyncState> async;
+    InternalPtr<OutputFilter> outputFilter;
+    BinaryRecordCodec binaryCodec;
 };
 
 #endif
@@ -27,11 +27,12 @@
 struct IndexedAllocationInfo
 {
     uint64_t size;
+    uint64_t usableSize;
     TraceIndex traceIndex;
     AllocationInfoIndex allocationIndex;
     bool operator==(const IndexedAllocationInfo& rhs) const
     {
-        return rhs.traceIndex == traceIndex && rhs.size == size;
+        return rhs.traceIndex == traceIndex && rhs.size == size && rhs.usableSize == usableSize;
         // allocationInfoIndex not compared to allow to look it up
     }
 };
@@ -44,6 +45,7 @@ struct hash<IndexedAllocationInfo>
     {
         std::size_t seed = 0;
         boost::hash_combine(seed, info.size);
+        boost::hash_combine(seed, info.usableSize);
         boost::hash_combine(seed, info.traceIndex.index);
         // allocationInfoIndex not hashed to allow to look it up
         return seed;
@@ -58,10 +60,10 @@ struct AllocationInfoSet
         set.reserve(625000);
     }
 
-    bool add(uint64_t size, TraceIndex traceIndex, AllocationInfoIndex* allocationIndex)
+    bool add(uint64_t size, uint64_t usableSize, TraceIndex traceIndex, AllocationInfoIndex* allocationIndex)
     {
         allocationIndex->index = static_cast<uint>(set.size());
-        IndexedAllocationInfo info = {size, traceIndex, *allocationIndex};
+        IndexedAllocationInfo info = {size, usableSize, traceIndex, *allocationIndex};
         auto it = set.find(info);
         if (it != set.end()) {
             *allocationIndex = it->allocationIndex;
@@ -0,0 +1,175 @@
+/*
+    SPDX-FileCopyrightText: 2026 heaptrack contributors
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef ZSTDSTREAM_H
+#define ZSTDSTREAM_H
+
+/**
+ * @file zstdstream.h
+ * @brief Streaming zstd (de)compression of the raw data, without boost::iostreams.
+ */
+
+#include <cstring>
+#include <memory>
+#include <streambuf>
+#include <vector>
+
+// for ZSTD_createCCtx_advanced
+#define ZSTD_STATIC_LINKING_ONLY
+#include <zstd.h>
+
+#include "internalarena.h"
+#include "linewriter.h"
+
+/**
+ * Compresses everything written through a LineWriter. Every chunk gets flushed
+ * to a complete zstd block, such that a reader on the other end of a pipe never
+ * waits for data that was written already.
+ *
+ * The compression context and buffer live in the InternalArena, like the buffers of the LineWriter.
+ */
+class ZstdOutputFilter final : public LineWriter::OutputFilter
+{
+public:
+    explicit ZstdOutputFilter(int level)
+        : m_context(ZSTD_createCCtx_advanced({&allocate, &deallocate, nullptr}))
+        , m_bufferSize(ZSTD_CStreamOutSize())
+        , m_buffer(m_bufferSize)
+    {
+        ZSTD_CCtx_setParameter(m_context, ZSTD_c_compressionLevel, level);
+    }
+
+    ~ZstdOutputFilter() override
+    {
+        ZSTD_freeCCtx(m_context);
+    }
+
+    bool write(int fd, const char* data, size_t size) override
+    {
+        ZSTD_inBuffer input = {data, size, 0};
+        return compress(fd, &input, ZSTD_e_flush);
+    }
+
+    bool finish(int fd) override
+    {
+        ZSTD_inBuffer input = {nullptr, 0, 0};
+        return compress(fd, &input, ZSTD_e_end);
+    }
+
+private:
+    enum : size_t
+    {
+        HEADER_SIZE = alignof(std::max_align_t),
+    };
+
+    // zstd doesn't pass the size when freeing, so we keep it in front of the memory we hand out
+    static void* allocate(void* /*opaque*/, size_t size)
+    {
+        auto* ptr = static_cast<char*>(InternalArena::instance().allocate(size + HEADER_SIZE));
+        if (!ptr) {
+            return nullptr;
+        }
+        *reinterpret_cast<size_t*>(ptr) = size + HEADER_SIZE;
+        return ptr + HEADER_SIZE;
+    }
+
+    static void deallocate(void* /*opaque*/, void* address)
+    {
+        if (!address) {
+            return;
+        }
+        auto* ptr = static_cast<char*>(address) - HEADER_SIZE;
+        InternalArena::instance().deallocate(ptr, *reinterpret_cast<size_t*>(ptr));
+    }
+
+    bool compress(int fd, ZSTD_inBuffer* input, ZSTD_EndDirective directive)
+    {
+        size_t remaining = 0;
+        do {
+            ZSTD_outBuffer output = {m_buffer.data(), m_bufferSize, 0};
+            remaining = ZSTD_compressStream2(m_context, &output, input, directive);
+            if (ZSTD_isError(remaining) || !LineWriter::writeAll(fd, m_buffer.data(), output.pos)) {
+                return false;
+            }
+        } while (remaining || input->pos < input->size);
+        return true;
+    }
+
+    ZSTD_CCtx* m_context;
+    const size_t m_bufferSize;
+    std::vector<char, InternalAllocator<char>> m_buffer;
+};
+
+/**
+ * Decompresses the data read from another stream buffer.
+ */
+class ZstdInputBuffer final : public std::streambuf
+{
+public:
+    /**
+     * The zstd frame magic number 0xFD2FB528 starts with this byte in little endian,
+     * which never occurs at the start of an uncompressed raw data file.
+     */
+    enum : unsigned char
+    {
+        MAGIC_FIRST_BYTE = 0x28
+    };
+
+    explicit ZstdInputBuffer(std::streambuf* source)
+        : m_source(source)
+        , m_context(ZSTD_createDCtx())
+        , m_inputSize(ZSTD_DStreamInSize())
+        , m_outputSize(ZSTD_DStreamOutSize())
+        , m_input(new char[m_inputSize])
+        , m_output(new char[m_outputSize])
+    {
+        setg(m_output.get(), m_output.get(), m_output.get());
+    }
+
+    ~ZstdInputBuffer() override
+    {
+        ZSTD_freeDCtx(m_context);
+    }
+
+    ZstdInputBuffer(const ZstdInputBuffer&) = delete;
+    ZstdInputBuffer& operator=(const ZstdInputBuffer&) = delete;
+
+protected:
+    int_type underflow() override
+    {
+        if (gptr() < egptr()) {
+            return traits_type::to_int_type(*gptr());
+        }
+
+        ZSTD_outBuffer output = {m_output.get(), m_outputSize, 0};
+        while (!output.pos) {
+            if (m_inputBuffer.pos == m_inputBuffer.size) {
+                const auto size = m_source->sgetn(m_input.get(), m_inputSize);
+                if (size <= 0) {
+                    return traits_type::eof();
+                }
+                m_inputBuffer = {m_input.get(), static_cast<size_t>(size), 0};
+            }
+            if (ZSTD_isError(ZSTD_decompressStream(m_context, &output, &m_inputBuffer))) {
+                return traits_type::eof();
+            }
+        }
+
+        setg(m_output.get(), m_output.get(), m_output.get() + output.pos);
+        return traits_type::to_int_type(*gptr());
+    }
+
+private:
+    std::streambuf* m_source;
+    ZSTD_DCtx* m_context;
+    const size_t m_inputSize;
+    const size_t m_outputSize;
+    std::unique_ptr<char[]> m_input;
+    std::unique_ptr<char[]> m_output;
+    ZSTD_inBuffer m_inputBuffer = {nullptr, 0, 0};
+};
+
+#endif // ZSTDSTREAM_H
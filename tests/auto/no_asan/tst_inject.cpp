@@ -61,6 +61,10 @@ void runInjectTest(Load load, Unload unload)
     escape(p);
     free(p);
 
+    auto* q = new char[42];
+    escape(q);
+    delete[] q;
+
     heaptrack_stop();
 
     unload(handle);
@@ -73,6 +77,13 @@ void runInjectTest(Load load, Unload unload)
     REQUIRE(contents.find("\nA\n") != std::string::npos);
     REQUIRE(contents.find("\n+") != std::string::npos);
     REQUIRE(contents.find("\n-") != std::string::npos);
+
+    // operator new[] gets recorded by its own hook, not a second time via malloc
+    size_t newAllocations = 0;
+    for (auto pos = contents.find("\n+ 2a "); pos != std::string::npos; pos = contents.find("\n+ 2a ", pos + 1)) {
+        ++newAllocations;
+    }
+    REQUIRE(newAllocations == 1);
 }
 }
 
@@ -0,0 +1,81 @@
+/*
+    SPDX-FileCopyrightText: 2026 heaptrack contributors
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "3rdparty/doctest.h"
+
+#include "tempfile.h"
+#include "tst_config.h"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <string>
+
+namespace {
+/**
+ * Run the debuggee with heaptrack preloaded and the given sample interval.
+ *
+ * @return the exit status of the debuggee
+ */
+int runPreloaded(const TempFile& output, const char* sampleInterval)
+{
+    const auto pid = fork();
+    REQUIRE(pid != -1);
+    if (pid == 0) {
+        setenv("LD_PRELOAD", HEAPTRACK_LIB_PRELOAD_SO, 1);
+        setenv("DUMP_HEAPTRACK_OUTPUT", output.fileName.c_str(), 1);
+        setenv("HEAPTRACK_SAMPLE_INTERVAL", sampleInterval, 1);
+        execl(TST_PRELOAD_CHILD, TST_PRELOAD_CHILD, nullptr);
+        _exit(127);
+    }
+
+    int status = 0;
+    REQUIRE(waitpid(pid, &status, 0) == pid);
+    REQUIRE(WIFEXITED(status));
+    return WEXITSTATUS(status);
+}
+
+size_t countLines(const std::string& contents, const char* prefix)
+{
+    size_t lines = 0;
+    for (auto pos = contents.find(prefix); pos != std::string::npos; pos = contents.find(prefix, pos + 1)) {
+        ++lines;
+    }
+    return lines;
+}
+}
+
+TEST_CASE ("preload without sampling") {
+    TempFile output;
+    REQUIRE(runPreloaded(output, "0") == 0);
+
+    const auto contents = output.readContents();
+    REQUIRE(contents.find("\nP ") == std::string::npos);
+    REQUIRE(countLines(contents, "\n+ ") >= 10000);
+    REQUIRE(countLines(contents, "\n- ") >= 5000);
+}
+
+TEST_CASE ("preload with sampling") {
+    // the sampled pointers are used by the very first allocations, before any static constructor ran
+    struct Sampling
+    {
+        const char* interval;
+        const char* header;
+    };
+    const Sampling samplings[] = {{"1", "\nP 1\n"}, {"64", "\nP 40\n"}, {"4096", "\nP 1000\n"}};
+    for (const auto& sampling : samplings) {
+        INFO("sample interval: " << sampling.interval);
+        TempFile output;
+        REQUIRE(runPreloaded(output, sampling.interval) == 0);
+
+        const auto contents = output.readContents();
+        REQUIRE(contents.find(sampling.header) != std::string::npos);
+        // the debuggee allocates about 800KB, we expect to sample some of that
+        REQUIRE(countLines(contents, "\n+ ") > 0);
+        REQUIRE(countLines(contents, "\n- ") <= countLines(contents, "\n+ "));
+    }
+}
@@ -0,0 +1,24 @@
+/*
+    SPDX-FileCopyrightText: 2026 heaptrack contributors
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <stdlib.h>
+
+// the debuggee of tst_preload, its allocations are recorded by the preloaded heaptrack
+int main(void)
+{
+    enum
+    {
+        NUM_ALLOCATIONS = 10000
+    };
+    static void* ptrs[NUM_ALLOCATIONS];
+    for (int i = 0; i < NUM_ALLOCATIONS; ++i) {
+        ptrs[i] = malloc(16 + i % 128);
+    }
+    for (int i = 0; i < NUM_ALLOCATIONS; i += 2) {
+        free(ptrs[i]);
+    }
+    return 0;
+}
@@ -7,12 +7,19 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "3rdparty/doctest.h"
 
+#include "util/config.h"
 #include "util/linereader.h"
 #include "util/linewriter.h"
+#if ZSTD_FOUND
+#include "util/zstdstream.h"
+#endif
 
 #include "tempfile.h"
 
+#include <future>
 #include <limits>
+#include <sstream>
+#include <thread>
 
 using namespace std;
 
@@ -116,6 +123,125 @@ TEST_CASE ("write flush") {
     REQUIRE(file.readContents() == data1 + data2);
 }
 
+TEST_CASE ("async write") {
+    TempFile file;
+    REQUIRE(file.open());
+
+    LineWriter writer(file.fd);
+    writer.enableAsync(LineWriter::BUFFER_CAPACITY * 4, LineWriter::OverflowPolicy::Block);
+    REQUIRE(writer.isAsync());
+    thread writerThread([&writer]() { writer.runAsyncWriter(); });
+
+    string expectedContents;
+    for (unsigned i = 0; i < 100000; ++i) {
+        REQUIRE(writer.writeHexLine('t', 0x123u, i));
+        expectedContents += "t 123 ";
+        char hex[16];
+        expectedContents.append(hex, LineWriter::writeHexNumber(hex, i));
+        expectedContents += '\n';
+        if (i % 10000 == 0) {
+            const string longString(LineWriter::BUFFER_CAPACITY * 8, '*');
+            REQUIRE(writer.write(longString));
+            expectedContents.append(hex, LineWriter::writeHexNumber(hex, longString.size()));
+            expectedContents += ' ' + longString;
+        }
+    }
+    writer.close();
+    writerThread.join();
+
+    REQUIRE(file.readContents() == expectedContents);
+    const auto stats = writer.asyncStats();
+    REQUIRE(stats.buffers > 10);
+    REQUIRE(stats.dropped == 0);
+}
+
+TEST_CASE ("async write with dropping") {
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+
+    LineWriter writer(fds[1]);
+    writer.enableAsync(LineWriter::BUFFER_CAPACITY, LineWriter::OverflowPolicy::Drop);
+    thread writerThread([&writer]() { writer.runAsyncWriter(); });
+
+    // nobody reads from the pipe yet, so the writer thread gets stuck eventually and we have to drop lines
+    const unsigned numLines = 100000;
+    for (unsigned i = 0; i < numLines; ++i) {
+        REQUIRE(writer.writeHexLine('+', 0x10u, 0x1u, 0x1234u));
+    }
+    const auto dropped = writer.asyncStats().dropped;
+    REQUIRE(dropped > 0);
+
+    auto reader = async(launch::async, [&fds]() {
+        string contents;
+        char buffer[LineWriter::BUFFER_CAPACITY];
+        ssize_t size = 0;
+        while ((size = read(fds[0], buffer, sizeof(buffer))) > 0) {
+            contents.append(buffer, size);
+        }
+        close(fds[0]);
+        return contents;
+    });
+
+    // other lines are never dropped, in particular not deallocations
+    REQUIRE(writer.writeHexLine('-', 0x1234u));
+    REQUIRE(writer.writeHexLine('c', 0x1u));
+    writer.close();
+    writerThread.join();
+
+    const auto contents = reader.get();
+    REQUIRE(count(contents.begin(), contents.end(), '+') + dropped == numLines);
+    REQUIRE(contents.substr(contents.size() - 11) == "- 1234\nc 1\n");
+}
+
+#if ZSTD_FOUND
+TEST_CASE ("zstd compressed write") {
+    TempFile file;
+    REQUIRE(file.open());
+
+    LineWriter writer(file.fd);
+    writer.setOutputFilter(makeInternal<ZstdOutputFilter>(3));
+    for (auto async : {false, true}) {
+        SUBCASE(async ? "async" : "sync")
+        {
+            thread writerThread;
+            if (async) {
+                writer.enableAsync(LineWriter::BUFFER_CAPACITY, LineWriter::OverflowPolicy::Block);
+                writerThread = thread([&writer]() { writer.runAsyncWriter(); });
+            }
+
+            string expectedContents;
+            for (unsigned i = 0; i < 100000; ++i) {
+                REQUIRE(writer.writeHexLine('t', 0x123u, i));
+                expectedContents += "t 123 ";
+                char hex[16];
+                expectedContents.append(hex, LineWriter::writeHexNumber(hex, i));
+                expectedContents += '\n';
+                if (i % 10000 == 0) {
+                    const string longString(LineWriter::BUFFER_CAPACITY * 8, '*');
+                    REQUIRE(writer.write(longString));
+                    expectedContents.append(hex, LineWriter::writeHexNumber(hex, longString.size()));
+                    expectedContents += ' ' + longString;
+                }
+            }
+            writer.close();
+            if (writerThread.joinable()) {
+                writerThread.join();
+            }
+
+            const auto contents = file.readContents();
+            REQUIRE(contents.size() < expectedContents.size() / 10);
+            REQUIRE(static_cast<unsigned char>(contents[0]) == ZstdInputBuffer::MAGIC_FIRST_BYTE);
+
+            stringstream compressed(contents);
+            ZstdInputBuffer buffer(compressed.rdbuf());
+            istream in(&buffer);
+            const string decompressed((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+            REQUIRE(decompressed == expectedContents);
+        }
+    }
+}
+#endif
+
 TEST_CASE ("read line 64bit") {
     const string contents =
         "m /tmp/KDevelop-5.2.1-x86_64/usr/lib/libKF5Completion.so.5 7f48beedc00 0 36854 236858 2700\n";
@@ -176,3 +302,141 @@ TEST_CASE ("read line 32bit") {
     REQUIRE(idx == 0x0);
     REQUIRE(!(reader >> idx));
 }
+
+TEST_CASE ("binary records") {
+    TempFile file;
+    REQUIRE(file.open());
+
+    struct Record
+    {
+        char mode;
+        uint64_t args[3];
+    };
+    const Record records[] = {
+        {'t', {0x7f48beedc00, 0}},
+        {'t', {0x7f48beedbf0, 1}},
+        {'+', {16, 2, 0x55d0b3a1f2a0}},
+        {'+', {0, 0, 0x55d0b3a1f2c0}},
+        {'-', {0x55d0b3a1f2a0}},
+        {'T', {32, 1}},
+        {'C', {1234}},
+        {'+', {std::numeric_limits<uint64_t>::max(), std::numeric_limits<uint32_t>::max(), 0x10}},
+        {'-', {std::numeric_limits<uint64_t>::max()}},
+        {'t', {0x400000, 0x12345678}},
+    };
+
+    LineWriter writer(file.fd);
+    REQUIRE(writer.canWrite());
+    REQUIRE(writer.write("v 10000 4\n"));
+    for (const auto& record : records) {
+        switch (record.mode) {
+        case 't':
+        case 'T':
+            REQUIRE(writer.writeBinaryLine(record.mode, record.args[0], record.args[1]));
+            break;
+        case '+':
+            REQUIRE(writer.writeBinaryLine('+', record.args[0], record.args[1], record.args[2]));
+            break;
+        case '-':
+        case 'C':
+            REQUIRE(writer.writeBinaryLine(record.mode, record.args[0]));
+            break;
+        }
+        // textual lines can be mixed in
+        REQUIRE(writer.writeHexLine('c', 0xau));
+    }
+    REQUIRE(writer.flush());
+
+    const auto contents = file.readContents();
+    stringstream stream(contents);
+
+    LineReader reader;
+    REQUIRE(reader.getLine(stream));
+    REQUIRE(reader.line() == "v 10000 4");
+    reader.setBinaryRecords(true);
+
+    for (const auto& record : records) {
+        REQUIRE(reader.getLine(stream));
+        REQUIRE(reader.mode() == record.mode);
+        for (int i = 0; i < BinaryRecordCodec::numArgs(record.mode); ++i) {
+            uint64_t arg = 0;
+            REQUIRE((reader >> arg));
+            REQUIRE(arg == record.args[i]);
+        }
+        uint64_t x = 0;
+        REQUIRE(!(reader >> x));
+
+        REQUIRE(reader.getLine(stream));
+        REQUIRE(reader.line() == "c a");
+    }
+
+    SUBCASE("compact encoding")
+    {
+        // tag byte, size and trace index of zero, followed by the zigzag encoded pointer delta of 0x20
+        REQUIRE(contents.find(string("\xab\x00\x00\x40\x63", 5)) != string::npos);
+    }
+}
+
+TEST_CASE ("binary records with usable sizes") {
+    TempFile file;
+    REQUIRE(file.open());
+
+    LineWriter writer(file.fd);
+    writer.setUsableSizes(true);
+    REQUIRE(writer.canWrite());
+    REQUIRE(writer.write("U\n"));
+    REQUIRE(writer.writeBinaryLine('+', 100_u64, 1_u64, 0x55d0b3a1f2a0_u64, 104_u64));
+    REQUIRE(writer.writeBinaryLine('T', 24_u64, 2_u64, 24_u64));
+    REQUIRE(writer.writeBinaryLine('-', 0x55d0b3a1f2a0_u64));
+    REQUIRE(writer.flush());
+
+    const auto contents = file.readContents();
+    // tag byte, size, trace index, zigzag encoded pointer delta and zigzag encoded slack of 4
+    REQUIRE(contents.find(string("\xab\x64\x01", 3)) != string::npos);
+    REQUIRE(contents.find(string("\xd4\x18\x02\x00", 4)) != string::npos);
+
+    stringstream stream(contents);
+    LineReader reader;
+    reader.setBinaryRecords(true);
+    REQUIRE(reader.getLine(stream));
+    REQUIRE(reader.mode() == 'U');
+    reader.setUsableSizes(true);
+
+    uint64_t size = 0;
+    uint64_t traceIndex = 0;
+    uint64_t ptr = 0;
+    uint64_t usableSize = 0;
+    REQUIRE(reader.getLine(stream));
+    REQUIRE(reader.mode() == '+');
+    REQUIRE((reader >> size));
+    REQUIRE((reader >> traceIndex));
+    REQUIRE((reader >> ptr));
+    REQUIRE((reader >> usableSize));
+    REQUIRE(size == 100);
+    REQUIRE(traceIndex == 1);
+    REQUIRE(ptr == 0x55d0b3a1f2a0);
+    REQUIRE(usableSize == 104);
+
+    REQUIRE(reader.getLine(stream));
+    REQUIRE(reader.mode() == 'T');
+    REQUIRE((reader >> size));
+    REQUIRE((reader >> traceIndex));
+    REQUIRE((reader >> usableSize));
+    REQUIRE(size == 24);
+    REQUIRE(traceIndex == 2);
+    REQUIRE(usableSize == 24);
+
+    REQUIRE(reader.getLine(stream));
+    REQUIRE(reader.mode() == '-');
+    REQUIRE((reader >> ptr));
+    REQUIRE(ptr == 0x55d0b3a1f2a0);
+    REQUIRE(!(reader >> ptr));
+}
+
+TEST_CASE ("truncated binary record") {
+    stringstream stream(string("\xab\x10\x02", 3));
+    LineReader reader;
+    reader.setBinaryRecords(true);
+    REQUIRE(!reader.getLine(stream));
+    REQUIRE(!reader.getLine(stream));
+}
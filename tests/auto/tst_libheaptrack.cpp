@@ -8,13 +8,26 @@
 #include "3rdparty/doctest.h"
 
 #include "track/libheaptrack.h"
+#include "util/config.h"
+#include "util/linereader.h"
 #include "util/linewriter.h"
+#if ZSTD_FOUND
+#include "util/zstdstream.h"
+#endif
 
 #include <cmath>
 #include <cstdio>
+#include <cstring>
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
+#include <algorithm>
+#include <fstream>
 #include <future>
 #include <iostream>
+#include <set>
+#include <sstream>
 #include <thread>
 #include <vector>
 
@@ -26,6 +39,113 @@ bool stopCalled = false;
 
 using namespace std;
 
+/**
+ * A line of the output. The hex numbers of the lines that describe events are parsed already.
+ */
+struct Event
+{
+    char mode = 0;
+    string line;
+    vector<uint64_t> args;
+};
+
+/**
+ * The output of heaptrack, as text or with binary records, and possibly compressed.
+ */
+struct Recording
+{
+    explicit Recording(string data)
+        : contents(move(data))
+    {
+        istringstream stream(contents);
+#if ZSTD_FOUND
+        // the output may have been compressed in-process, see HEAPTRACK_ZSTD_LEVEL
+        if (stream.peek() == ZstdInputBuffer::MAGIC_FIRST_BYTE) {
+            ZstdInputBuffer buffer(stream.rdbuf());
+            istream decompressed(&buffer);
+            parse(decompressed);
+            return;
+        }
+#endif
+        parse(stream);
+    }
+
+    uint64_t count(char mode) const
+    {
+        return count_if(events.begin(), events.end(), [mode](const Event& event) { return event.mode == mode; });
+    }
+
+    /**
+     * @return the first line that starts with @p prefix, or an empty string
+     */
+    string find(const string& prefix) const
+    {
+        auto it = find_if(events.begin(), events.end(),
+                          [&prefix](const Event& event) { return event.line.compare(0, prefix.size(), prefix) == 0; });
+        return it == events.end() ? string() : it->line;
+    }
+
+    string contents;
+    vector<Event> events;
+
+private:
+    void parse(istream& stream)
+    {
+        LineReader reader;
+        reader.setBinaryRecords(true);
+        while (reader.getLine(stream)) {
+            if (reader.line().empty()) {
+                continue;
+            }
+            Event event;
+            event.mode = reader.mode();
+            event.line = reader.line();
+            if (strchr("+-tTcCROPNn", event.mode)) {
+                uint64_t arg = 0;
+                while (reader >> arg) {
+                    event.args.push_back(arg);
+                }
+            }
+            events.push_back(move(event));
+        }
+    }
+};
+
+using Environment = vector<pair<const char*, string>>;
+
+/**
+ * Start to record to @p fileName. The @p environment only applies to the initialization.
+ */
+void startRecording(const string& fileName, const Environment& environment = {})
+{
+    for (const auto& variable : environment) {
+        setenv(variable.first, variable.second.c_str(), 1);
+    }
+    heaptrack_init(fileName.c_str(), nullptr, nullptr, nullptr);
+    for (const auto& variable : environment) {
+        unsetenv(variable.first);
+    }
+}
+
+/**
+ * Record the calls to heaptrack in @p run, see startRecording.
+ */
+template <typename Run>
+Recording record(const Environment& environment, Run run)
+{
+    TempFile tmp; // opened/closed by heaptrack_init
+    startRecording(tmp.fileName, environment);
+    run();
+    heaptrack_stop();
+    return Recording(tmp.readContents());
+}
+
+string readFile(const string& fileName)
+{
+    ifstream file(fileName, ios::binary);
+    return {istreambuf_iterator<char>(file), istreambuf_iterator<char>()};
+}
+
 TEST_CASE ("api") {
     TempFile tmp; // opened/closed by heaptrack_init
 
@@ -124,3 +244,765 @@ TEST_CASE ("api") {
         }
     }
 }
+
+
+TEST_CASE ("thread buffers") {
+    const auto numThreads = max(4u, thread::hardware_concurrency());
+    const uintptr_t numAllocations = 20000;
+    const auto recording = record({{"HEAPTRACK_THREAD_BUFFERS", "1"}}, [&]() {
+        vector<future<void>> futures;
+        for (uintptr_t t = 0; t < numThreads; ++t) {
+            futures.emplace_back(async(launch::async, [t, numAllocations]() {
+                for (uintptr_t i = 1; i <= numAllocations; ++i) {
+                    // fake but unique pointers per thread
+                    auto* ptr = reinterpret_cast<void*>((t << 32) | (i << 4));
+                    heaptrack_malloc(ptr, i);
+                    heaptrack_free(ptr);
+                }
+            }));
+        }
+    });
+
+    // the merged output must be consistent, i.e. every trace index and pointer is known when used
+    uint64_t traces = 0;
+    set<uint64_t> live;
+    for (const auto& event : recording.events) {
+        if (event.mode == 't') {
+            ++traces;
+        } else if (event.mode == '+') {
+            REQUIRE(event.args[1] <= traces);
+            REQUIRE(live.insert(event.args[2]).second);
+        } else if (event.mode == '-') {
+            REQUIRE(live.erase(event.args[0]) == 1);
+        }
+    }
+    REQUIRE(live.empty());
+    REQUIRE(recording.count('+') == numThreads * numAllocations);
+}
+
+TEST_CASE ("sampling") {
+    const uintptr_t numAllocations = 100000;
+    const auto recording = record({{"HEAPTRACK_SAMPLE_INTERVAL", "4096"}}, [&]() {
+        for (uintptr_t i = 1; i <= numAllocations; ++i) {
+            heaptrack_malloc(reinterpret_cast<void*>(i << 4), 64);
+        }
+        for (uintptr_t i = 1; i <= numAllocations; ++i) {
+            heaptrack_free(reinterpret_cast<void*>(i << 4));
+        }
+    });
+
+    uint64_t sampleInterval = 0;
+    set<uint64_t> live;
+    for (const auto& event : recording.events) {
+        if (event.mode == 'P') {
+            sampleInterval = event.args[0];
+        } else if (event.mode == '+') {
+            REQUIRE(live.insert(event.args[2]).second);
+        } else if (event.mode == '-') {
+            // only the deallocations of sampled allocations get recorded
+            REQUIRE(live.erase(event.args[0]) == 1);
+        }
+    }
+    REQUIRE(sampleInterval == 4096);
+    // each allocation gets sampled with a probability of 1 - exp(-64 / 4096), i.e. ~1550 in total
+    const auto allocations = recording.count('+');
+    REQUIRE(allocations > 1000);
+    REQUIRE(allocations < 2200);
+    REQUIRE(recording.count('-') == allocations);
+}
+
+TEST_CASE ("binary records") {
+    // record the same allocations once as text and once with binary records
+    auto allocate = []() {
+        for (uintptr_t i = 1; i <= 1000; ++i) {
+            heaptrack_malloc(reinterpret_cast<void*>(i << 4), i);
+            if (i % 3) {
+                heaptrack_free(reinterpret_cast<void*>(i << 4));
+            }
+        }
+    };
+    // use the same call site, to get the same backtraces
+    vector<Recording> recordings;
+    for (auto useBinary : {false, true}) {
+        recordings.push_back(record(useBinary ? Environment {{"HEAPTRACK_BINARY_RECORDS", "1"}} : Environment {},
+                                    allocate));
+    }
+    const auto& text = recordings[0];
+    const auto& binary = recordings[1];
+    REQUIRE(binary.contents.size() < text.contents.size());
+
+    // both must decode to the same sequence of events
+    auto events = [](const Recording& recording) {
+        vector<uint64_t> events;
+        for (const auto& event : recording.events) {
+            if (event.mode == '+' || event.mode == '-' || event.mode == 't') {
+                events.push_back(event.mode);
+                events.insert(events.end(), event.args.begin(), event.args.end());
+            }
+        }
+        return events;
+    };
+    const auto textEvents = events(text);
+    REQUIRE(textEvents.size() > 1000);
+    REQUIRE(events(binary) == textEvents);
+}
+
+TEST_CASE ("async writer") {
+    const uintptr_t numAllocations = 100000;
+    const auto recording = record({{"HEAPTRACK_ASYNC_BUFFER_SIZE", "65536"}}, [&]() {
+        for (uintptr_t i = 1; i <= numAllocations; ++i) {
+            heaptrack_malloc(reinterpret_cast<void*>(i << 4), i);
+            heaptrack_free(reinterpret_cast<void*>(i << 4));
+        }
+    });
+
+    REQUIRE(recording.count('+') == numAllocations);
+    REQUIRE(recording.count('-') == numAllocations);
+    REQUIRE(!recording.find("# async writer: ").empty());
+    // the last line must not be cut off
+    REQUIRE(recording.contents.back() == '\n');
+}
+
+TEST_CASE ("async writer dropping events") {
+    TempFile pipe; // opened/closed by heaptrack_init
+    REQUIRE(mkfifo(pipe.fileName.c_str(), 0600) == 0);
+    // nobody reads at first, so the writer thread gets stuck once the pipe is full
+    const int readFd = open(pipe.fileName.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    REQUIRE(readFd != -1);
+    auto reader = async(launch::async, [readFd]() {
+        this_thread::sleep_for(chrono::milliseconds(100));
+        fcntl(readFd, F_SETFL, 0);
+        string contents;
+        char buffer[4096];
+        ssize_t size = 0;
+        while ((size = read(readFd, buffer, sizeof(buffer))) > 0) {
+            contents.append(buffer, size);
+        }
+        close(readFd);
+        return contents;
+    });
+
+    startRecording(pipe.fileName, {{"HEAPTRACK_ASYNC_BUFFER_SIZE", "4096"}, {"HEAPTRACK_ASYNC_DROP", "1"}});
+    const uintptr_t numAllocations = 100000;
+    for (uintptr_t i = 1; i <= numAllocations; ++i) {
+        heaptrack_malloc(reinterpret_cast<void*>(i << 4), i);
+        heaptrack_free(reinterpret_cast<void*>(i << 4));
+    }
+    heaptrack_stop();
+
+    const Recording recording(reader.get());
+    const auto stats = recording.find("# async writer: ");
+    uint64_t dropped = 0;
+    istringstream(stats.substr(stats.rfind("ms, ") + 4)) >> dropped;
+    REQUIRE(dropped > 0);
+    REQUIRE(recording.count('+') + dropped == numAllocations);
+    // otherwise the allocations would be reported as leaked
+    REQUIRE(recording.count('-') == numAllocations);
+}
+
+TEST_CASE ("temporary coalescing") {
+    const uintptr_t numAllocations = 1000;
+    const auto recording = record({{"HEAPTRACK_COALESCE_TEMPORARIES", "1"}}, [&]() {
+        for (uintptr_t i = 1; i <= numAllocations; ++i) {
+            // temporary
+            heaptrack_malloc(reinterpret_cast<void*>(i << 4), i);
+            heaptrack_free(reinterpret_cast<void*>(i << 4));
+            // not temporary
+            heaptrack_malloc(reinterpret_cast<void*>(0x10000 + (i << 4)), i);
+            heaptrack_malloc(reinterpret_cast<void*>(0x20000 + (i << 4)), i);
+            heaptrack_free(reinterpret_cast<void*>(0x10000 + (i << 4)));
+        }
+        // leaked
+        heaptrack_malloc(reinterpret_cast<void*>(0x30000), 42);
+    });
+
+    REQUIRE(recording.count('T') == numAllocations);
+    REQUIRE(recording.count('+') == 2 * numAllocations + 1);
+    REQUIRE(recording.count('-') == numAllocations);
+}
+
+TEST_CASE ("precise timestamps") {
+    const auto recording = record({{"HEAPTRACK_PRECISE_TIMESTAMPS", "1"}}, []() {
+        heaptrack_malloc(reinterpret_cast<void*>(0x10), 10);
+        this_thread::sleep_for(chrono::milliseconds(2));
+        heaptrack_free(reinterpret_cast<void*>(0x10));
+    });
+
+    uint64_t time = 0;
+    uint64_t allocationTime = 0;
+    uint64_t deallocationTime = 0;
+    char lastMode = 0;
+    for (const auto& event : recording.events) {
+        if (event.mode == 'C') {
+            REQUIRE(lastMode != 'C');
+            REQUIRE(event.args[0] > 0);
+            time += event.args[0];
+        } else if (event.mode == '+') {
+            REQUIRE(lastMode == 'C');
+            allocationTime = time;
+        } else if (event.mode == '-') {
+            REQUIRE(lastMode == 'C');
+            deallocationTime = time;
+        }
+        lastMode = event.mode;
+    }
+    REQUIRE(allocationTime > 0);
+    REQUIRE(deallocationTime >= allocationTime + 2000);
+}
+
+TEST_CASE ("aggregation") {
+    const uintptr_t numAllocations = 1000;
+    const auto recording = record({{"HEAPTRACK_AGGREGATE", "3600"}}, [&]() {
+        // not recorded, allocated before we started
+        heaptrack_free(reinterpret_cast<void*>(0x100000));
+
+        for (uintptr_t i = 1; i <= numAllocations; ++i) {
+            // temporary
+            heaptrack_malloc(reinterpret_cast<void*>(i << 4), i);
+            heaptrack_free(reinterpret_cast<void*>(i << 4));
+            // leaked
+            heaptrack_malloc(reinterpret_cast<void*>(0x10000 + (i << 4)), 10);
+        }
+    });
+
+    REQUIRE(recording.count('+') == 0);
+    REQUIRE(recording.count('-') == 0);
+    uint64_t allocations = 0;
+    uint64_t temporary = 0;
+    uint64_t leaked = 0;
+    for (const auto& event : recording.events) {
+        if (event.mode == 'N') {
+            // trace index, allocations, temporary, leaked
+            REQUIRE(event.args[0] > 0);
+            allocations += event.args[1];
+            temporary += event.args[2];
+            leaked += event.args[3];
+        }
+    }
+    REQUIRE(allocations == 2 * numAllocations);
+    REQUIRE(temporary == numAllocations);
+    REQUIRE(leaked == 10 * numAllocations);
+}
+
+TEST_CASE ("flight recorder") {
+    TempFile dumpPrefix;
+    const uintptr_t numEvents = 100;
+    const uintptr_t numLeaked = 10;
+
+    // a dump must be a valid data file on its own
+    auto checkDump = [&](const Recording& dump) {
+        REQUIRE(!dump.events.empty());
+        REQUIRE(dump.events[0].mode == 'v');
+        set<uint64_t> live;
+        for (const auto& event : dump.events) {
+            if (event.mode == '+') {
+                live.insert(event.args[2]);
+            } else if (event.mode == '-') {
+                REQUIRE(live.erase(event.args[0]) == 1);
+            }
+        }
+        REQUIRE(dump.count('+') <= numEvents + numLeaked);
+        REQUIRE(live.size() == numLeaked - 1);
+    };
+
+    const Environment environment = {{"HEAPTRACK_FLIGHT_RECORDER", to_string(numEvents * 64)},
+                                     {"HEAPTRACK_FLIGHT_RECORDER_OUTPUT", dumpPrefix.fileName}};
+    const auto recording = record(environment, [&]() {
+        // leaked, these events drop out of the ring
+        for (uintptr_t i = 1; i <= numLeaked; ++i) {
+            heaptrack_malloc(reinterpret_cast<void*>(0x100000 + (i << 4)), 10);
+        }
+        for (uintptr_t i = 1; i <= 1000; ++i) {
+            heaptrack_malloc(reinterpret_cast<void*>(i << 4), i);
+            heaptrack_free(reinterpret_cast<void*>(i << 4));
+        }
+        // the allocation of this one is only known from the checkpoint
+        heaptrack_free(reinterpret_cast<void*>(0x100010));
+
+        heaptrack_dump();
+        const auto dumpFileName = dumpPrefix.fileName + ".1";
+        REQUIRE(boost::filesystem::exists(dumpFileName));
+        checkDump(Recording(readFile(dumpFileName)));
+        remove(dumpFileName.c_str());
+    });
+
+    // the final dump gets written to the output
+    checkDump(recording);
+}
+
+TEST_CASE ("flight recorder dump on abort") {
+    TempFile tmp; // opened/closed by heaptrack_init
+    TempFile dumpPrefix;
+
+    const auto pid = fork();
+    REQUIRE(pid != -1);
+    if (pid == 0) {
+        startRecording(tmp.fileName, {{"HEAPTRACK_FLIGHT_RECORDER", "65536"},
+                                      {"HEAPTRACK_FLIGHT_RECORDER_OUTPUT", dumpPrefix.fileName}});
+
+        // the other threads hold the lock most of the time
+        for (uintptr_t thread = 1; thread <= 4; ++thread) {
+            std::thread([thread]() {
+                for (;;) {
+                    heaptrack_malloc(reinterpret_cast<void*>(thread << 32), 1);
+                    heaptrack_free(reinterpret_cast<void*>(thread << 32));
+                }
+            }).detach();
+        }
+        this_thread::sleep_for(chrono::milliseconds(50));
+        abort();
+    }
+
+    int status = 0;
+    REQUIRE(waitpid(pid, &status, 0) == pid);
+    REQUIRE(WIFSIGNALED(status));
+    REQUIRE(WTERMSIG(status) == SIGABRT);
+
+    const auto dumpFileName = dumpPrefix.fileName + ".1";
+    const Recording dump(readFile(dumpFileName));
+    remove(dumpFileName.c_str());
+    REQUIRE(!dump.events.empty());
+    REQUIRE(dump.events[0].mode == 'v');
+    REQUIRE(dump.count('+') > 0);
+}
+
+TEST_CASE ("triggers") {
+    SUBCASE("paused below the threshold")
+    {
+        const auto recording = record({{"HEAPTRACK_TRIGGER_RSS", "1000000000000000"}}, []() {
+            heaptrack_malloc(reinterpret_cast<void*>(0x10), 10);
+            heaptrack_free(reinterpret_cast<void*>(0x10));
+        });
+
+        REQUIRE(recording.count('+') == 0);
+    }
+
+    SUBCASE("recording above the threshold")
+    {
+        const auto recording = record({{"HEAPTRACK_TRIGGER_RSS", "1"}}, []() {
+            // wait for the timer thread to check the triggers
+            this_thread::sleep_for(chrono::milliseconds(200));
+            heaptrack_malloc(reinterpret_cast<void*>(0x10), 10);
+            heaptrack_free(reinterpret_cast<void*>(0x10));
+        });
+
+        REQUIRE(recording.count('+') == 1);
+        REQUIRE(!recording.find("# RSS threshold exceeded").empty());
+    }
+
+    SUBCASE("flight recorder dump")
+    {
+        TempFile dumpPrefix;
+        const Environment environment = {{"HEAPTRACK_FLIGHT_RECORDER", "65536"},
+                                         {"HEAPTRACK_FLIGHT_RECORDER_OUTPUT", dumpPrefix.fileName},
+                                         {"HEAPTRACK_TRIGGER_HEAP", "1000"}};
+        const auto recording = record(environment, []() {
+            for (uintptr_t i = 1; i <= 10; ++i) {
+                heaptrack_malloc(reinterpret_cast<void*>(i << 4), 200);
+            }
+            this_thread::sleep_for(chrono::milliseconds(200));
+        });
+
+        const auto dumpFileName = dumpPrefix.fileName + ".1";
+        REQUIRE(boost::filesystem::exists(dumpFileName));
+        boost::filesystem::remove(dumpFileName);
+        // the heap only crossed the threshold once
+        REQUIRE(!boost::filesystem::exists(dumpPrefix.fileName + ".2"));
+        REQUIRE(recording.count('+') == 10);
+    }
+}
+
+TEST_CASE ("timer interval") {
+    SUBCASE("fixed")
+    {
+        const auto recording = record({{"HEAPTRACK_TIMER_INTERVAL", "100"}},
+                                      []() { this_thread::sleep_for(chrono::milliseconds(250)); });
+
+        // two ticks, plus the final time stamp
+        REQUIRE(recording.count('c') <= 3);
+    }
+
+    SUBCASE("adaptive")
+    {
+        const auto recording =
+            record({{"HEAPTRACK_TIMER_INTERVAL", "1"}, {"HEAPTRACK_TIMER_MAX_INTERVAL", "1000"}}, []() {
+                // idle: the interval doubles on every tick
+                this_thread::sleep_for(chrono::milliseconds(250));
+                // busy: we tick every millisecond again
+                for (uintptr_t i = 1; i <= 100; ++i) {
+                    heaptrack_malloc(reinterpret_cast<void*>(i << 4), i);
+                    this_thread::sleep_for(chrono::milliseconds(1));
+                }
+            });
+
+        const auto firstAllocation = find_if(recording.events.begin(), recording.events.end(),
+                                             [](const Event& event) { return event.mode == '+'; });
+        const auto idleTimestamps = count_if(recording.events.begin(), firstAllocation,
+                                             [](const Event& event) { return event.mode == 'c'; });
+        REQUIRE(idleTimestamps <= 10);
+        REQUIRE(recording.count('c') > static_cast<uint64_t>(idleTimestamps) + 10);
+    }
+}
+
+TEST_CASE ("module cache") {
+    auto allocate = [](uintptr_t ptr) {
+        heaptrack_invalidate_module_cache(nullptr);
+        heaptrack_malloc(reinterpret_cast<void*>(ptr), 1);
+    };
+
+    void* handle = nullptr;
+    const auto recording = record({}, [&]() {
+        allocate(0x10);
+        // nothing changed, so nothing gets written again
+        allocate(0x20);
+        handle = dlopen("libresolv.so.2", RTLD_NOW);
+        allocate(0x30);
+        if (handle) {
+            dlclose(handle);
+        }
+        allocate(0x40);
+    });
+
+    // the module lines that got written before each allocation
+    vector<vector<string>> modules(1);
+    for (const auto& event : recording.events) {
+        if (event.mode == 'm') {
+            // the modules are never written all over again
+            REQUIRE(event.line != "m 1 -");
+            modules.back().push_back(event.line);
+        } else if (event.mode == '+') {
+            modules.emplace_back();
+        }
+    }
+    REQUIRE(modules.size() == 5);
+    REQUIRE(!modules[0].empty());
+    REQUIRE(modules[1].empty());
+    if (handle) {
+        REQUIRE(modules[2].size() == 1);
+        REQUIRE(modules[2][0].find("libresolv") != string::npos);
+        // dlclose may keep the library loaded
+        REQUIRE(modules[3].size() <= 1);
+        if (!modules[3].empty()) {
+            REQUIRE(modules[3][0].compare(0, 6, "m 1 - ") == 0);
+        }
+    }
+}
+
+TEST_CASE ("module identity") {
+    const auto recording = record({}, []() { heaptrack_malloc(reinterpret_cast<void*>(0x10), 1); });
+
+    struct stat exeInfo;
+    REQUIRE(stat("/proc/self/exe", &exeInfo) == 0);
+
+    bool foundExe = false;
+    for (const auto& event : recording.events) {
+        if (event.line.compare(0, 5, "m 1 x") != 0) {
+            continue;
+        }
+        // m <name size> <name> <address> <build-id size> <build-id> <file size> <mtime> <segments>...
+        istringstream stream(event.line.substr(6));
+        uint64_t address = 0;
+        uint64_t buildIdSize = 0;
+        string buildId;
+        uint64_t fileSize = 0;
+        uint64_t mtime = 0;
+        stream >> hex >> address >> buildIdSize >> buildId >> fileSize >> mtime;
+        REQUIRE(buildId.size() == buildIdSize);
+        REQUIRE(fileSize == static_cast<uint64_t>(exeInfo.st_size));
+        REQUIRE(mtime == static_cast<uint64_t>(exeInfo.st_mtime));
+        foundExe = true;
+    }
+    REQUIRE(foundExe);
+}
+
+TEST_CASE ("heaptrack overhead") {
+    const auto recording = record({{"HEAPTRACK_TIMER_INTERVAL", "1"}}, []() {
+        for (uintptr_t i = 1; i <= 100; ++i) {
+            heaptrack_malloc(reinterpret_cast<void*>(i << 4), i);
+            this_thread::sleep_for(chrono::microseconds(200));
+        }
+    });
+
+    uint64_t overhead = 0;
+    for (const auto& event : recording.events) {
+        if (event.mode == 'O') {
+            // the pages used by heaptrack itself only get written when they change
+            REQUIRE(event.args[0] > 0);
+            REQUIRE(event.args[0] != overhead);
+            overhead = event.args[0];
+        } else if (event.mode == 'R') {
+            // but they are known before the first RSS value
+            REQUIRE(overhead > 0);
+        }
+    }
+    REQUIRE(recording.count('R') > 1);
+    REQUIRE(recording.count('O') < recording.count('R'));
+}
+
+TEST_CASE ("free filtering") {
+    const uintptr_t numAllocations = 1000;
+    const auto recording = record({{"HEAPTRACK_FILTER_FREES", "1"}}, [&]() {
+        for (uintptr_t i = 1; i <= numAllocations; ++i) {
+            // allocated before we got attached, or while paused
+            heaptrack_free(reinterpret_cast<void*>((i << 4) + 0x100000));
+            heaptrack_malloc(reinterpret_cast<void*>(i << 4), i);
+        }
+        for (uintptr_t i = 1; i <= numAllocations; ++i) {
+            heaptrack_free(reinterpret_cast<void*>(i << 4));
+        }
+        // allocated addresses may get reused
+        heaptrack_realloc(reinterpret_cast<void*>(0x10), 42, reinterpret_cast<void*>(0x20));
+        heaptrack_free(reinterpret_cast<void*>(0x20));
+    });
+
+    set<uint64_t> freed;
+    for (const auto& event : recording.events) {
+        if (event.mode == '-') {
+            freed.insert(event.args[0]);
+        }
+    }
+    REQUIRE(recording.count('-') == numAllocations + 2);
+    REQUIRE(freed.size() == numAllocations);
+    REQUIRE(freed.count(0x10));
+    REQUIRE(freed.count(0x3e80));
+}
+
+TEST_CASE ("follow fork") {
+    TempFile childTmp; // opened/closed by the forked child
+
+    const Environment environment = {{"HEAPTRACK_FOLLOW_FORK", "1"},
+                                     {"HEAPTRACK_FOLLOW_FORK_OUTPUT", childTmp.fileName}};
+    const auto parent = record(environment, []() {
+        heaptrack_malloc(reinterpret_cast<void*>(0x10), 1);
+        const auto pid = fork();
+        if (pid == 0) {
+            heaptrack_malloc(reinterpret_cast<void*>(0x20), 2);
+            heaptrack_stop();
+            _exit(0);
+        }
+        REQUIRE(pid > 0);
+        int status = 0;
+        REQUIRE(waitpid(pid, &status, 0) == pid);
+        REQUIRE(WIFEXITED(status));
+        REQUIRE(WEXITSTATUS(status) == 0);
+        heaptrack_malloc(reinterpret_cast<void*>(0x30), 3);
+    });
+
+    // the traces that the parent wrote before the fork
+    vector<string> parentTraces;
+    for (const auto& event : parent.events) {
+        if (event.mode == '+') {
+            break;
+        } else if (event.mode == 't') {
+            parentTraces.push_back(event.line);
+        }
+    }
+    REQUIRE(parent.count('+') == 2);
+    REQUIRE(!parentTraces.empty());
+
+    const Recording child(childTmp.readContents());
+    REQUIRE(!child.events.empty());
+    REQUIRE(child.events[0].mode == 'v');
+    vector<string> childTraces;
+    vector<Event> childAllocations;
+    for (const auto& event : child.events) {
+        if (event.mode == 't') {
+            childTraces.push_back(event.line);
+        } else if (event.mode == '+') {
+            childAllocations.push_back(event);
+        }
+    }
+    // the child only sees its own allocation, with the inherited traces written up front
+    REQUIRE(child.count('A') == 1);
+    REQUIRE(childAllocations.size() == 1);
+    REQUIRE(childAllocations[0].args[0] == 2);
+    REQUIRE(childTraces.size() >= parentTraces.size());
+    REQUIRE(equal(parentTraces.begin(), parentTraces.end(), childTraces.begin()));
+    const auto traceIndex = childAllocations[0].args[1];
+    REQUIRE(traceIndex > 0);
+    REQUIRE(traceIndex <= childTraces.size());
+}
+
+TEST_CASE ("control channel") {
+    TempFile tmp; // opened/closed by heaptrack_init
+    TempFile rotated; // the prefix of the rotated output
+
+    // we don't use record, as the stop command stops recording already
+    startRecording(tmp.fileName, {{"HEAPTRACK_CONTROL", "1"},
+                                  {"HEAPTRACK_ROTATE_OUTPUT", rotated.fileName},
+                                  {"HEAPTRACK_TIMER_INTERVAL", "1"}});
+
+    const auto controlPath = "/tmp/heaptrack-" + to_string(geteuid()) + "/control." + to_string(getpid());
+    struct stat info;
+    REQUIRE(stat(controlPath.c_str(), &info) == 0);
+    REQUIRE(S_ISFIFO(info.st_mode));
+    REQUIRE(info.st_uid == geteuid());
+
+    auto waitFor = [](auto condition) {
+        for (int i = 0; i < 500 && !condition(); ++i) {
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+        return condition();
+    };
+    auto sendCommand = [&controlPath](const char* command) {
+        ofstream(controlPath) << command << '\n';
+        // the timer thread handles the command on one of its next ticks
+        this_thread::sleep_for(chrono::milliseconds(100));
+    };
+
+    heaptrack_malloc(reinterpret_cast<void*>(0x10), 1);
+    {
+        // the command gets read in two parts
+        ofstream control(controlPath);
+        control << "pau" << flush;
+        this_thread::sleep_for(chrono::milliseconds(100));
+        control << "se\n" << flush;
+        this_thread::sleep_for(chrono::milliseconds(100));
+    }
+    heaptrack_malloc(reinterpret_cast<void*>(0x20), 2);
+    sendCommand("resume");
+    heaptrack_malloc(reinterpret_cast<void*>(0x30), 3);
+
+    const auto rotatedFileName = rotated.fileName + ".1";
+    sendCommand("rotate");
+    REQUIRE(waitFor([&rotatedFileName]() { return access(rotatedFileName.c_str(), F_OK) == 0; }));
+    heaptrack_malloc(reinterpret_cast<void*>(0x40), 4);
+    // allocated before the rotation
+    heaptrack_free(reinterpret_cast<void*>(0x10));
+
+    sendCommand("stop");
+    REQUIRE(waitFor([&controlPath]() { return access(controlPath.c_str(), F_OK) != 0; }));
+
+    REQUIRE(Recording(tmp.readContents()).count('+') == 2);
+
+    const Recording rotatedRecording(readFile(rotatedFileName));
+    unlink(rotatedFileName.c_str());
+    REQUIRE(rotatedRecording.count('v') == 1);
+    REQUIRE(rotatedRecording.count('A') == 1);
+    REQUIRE(rotatedRecording.count('+') == 1);
+    // deallocations of allocations from before the rotation get written, see below
+    REQUIRE(rotatedRecording.count('-') == 1);
+}
+
+TEST_CASE ("control channel of another user") {
+    // others could replace the FIFO when they can write to its directory
+    const auto directory = "/tmp/heaptrack-" + to_string(geteuid());
+    mkdir(directory.c_str(), 0700);
+    REQUIRE(chmod(directory.c_str(), 0777) == 0);
+
+    bool created = false;
+    record({{"HEAPTRACK_CONTROL", "1"}}, [&]() {
+        const auto controlPath = directory + "/control." + to_string(getpid());
+        created = access(controlPath.c_str(), F_OK) == 0;
+    });
+    REQUIRE(chmod(directory.c_str(), 0700) == 0);
+    REQUIRE(!created);
+}
+
+TEST_CASE ("output rotation") {
+    TempFile rotated; // the prefix of the rotated output
+
+    // the running number is shared with the rotations of the other test cases
+    auto findSegment = [&rotated]() {
+        for (int i = 1; i <= 10; ++i) {
+            const auto fileName = rotated.fileName + "." + to_string(i);
+            if (access(fileName.c_str(), F_OK) == 0) {
+                return fileName;
+            }
+        }
+        return string();
+    };
+
+    string segmentFileName;
+    const Environment environment = {{"HEAPTRACK_ROTATE_SECONDS", "1"},
+                                     {"HEAPTRACK_ROTATE_OUTPUT", rotated.fileName},
+                                     {"HEAPTRACK_TIMER_INTERVAL", "1"}};
+    const auto recording = record(environment, [&]() {
+        heaptrack_malloc(reinterpret_cast<void*>(0x10), 1);
+        for (int i = 0; i < 300 && segmentFileName.empty(); ++i) {
+            this_thread::sleep_for(chrono::milliseconds(10));
+            segmentFileName = findSegment();
+        }
+        heaptrack_free(reinterpret_cast<void*>(0x10));
+    });
+    REQUIRE(!segmentFileName.empty());
+    REQUIRE(recording.count('+') > 0);
+
+    const Recording segment(readFile(segmentFileName));
+    for (int i = 1; i <= 10; ++i) {
+        unlink((rotated.fileName + "." + to_string(i)).c_str());
+    }
+    // each segment is self-contained
+    REQUIRE(!segment.events.empty());
+    REQUIRE(segment.events[0].mode == 'v');
+    REQUIRE(segment.count('x') > 0);
+    REQUIRE(segment.count('A') > 0);
+    // allocated before the rotation
+    REQUIRE(segment.count('-') > 0);
+}
+
+TEST_CASE ("aggregation with output rotation") {
+    TempFile rotated; // the prefix of the rotated output
+
+    // the running number is shared with the rotations of the other test cases
+    auto readSegments = [&rotated]() {
+        string contents;
+        for (int i = 1; i <= 10; ++i) {
+            contents += readFile(rotated.fileName + "." + to_string(i));
+        }
+        return contents;
+    };
+
+    // the segments read it again
+    setenv("HEAPTRACK_AGGREGATE", "3600", 1);
+    const Environment environment = {{"HEAPTRACK_ROTATE_SECONDS", "1"},
+                                     {"HEAPTRACK_ROTATE_OUTPUT", rotated.fileName},
+                                     {"HEAPTRACK_TIMER_INTERVAL", "1"}};
+    const auto recording = record(environment, [&]() {
+        heaptrack_malloc(reinterpret_cast<void*>(0x10), 7);
+        for (int i = 0; i < 300 && readSegments().empty(); ++i) {
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+        heaptrack_free(reinterpret_cast<void*>(0x10));
+    });
+    unsetenv("HEAPTRACK_AGGREGATE");
+
+    const Recording segments(readSegments());
+    for (int i = 1; i <= 10; ++i) {
+        unlink((rotated.fileName + "." + to_string(i)).c_str());
+    }
+    // allocated in the first segment
+    REQUIRE(recording.count('N') > 0);
+
+    REQUIRE(segments.count('-') == 0);
+    uint64_t deallocated = 0;
+    for (const auto& event : segments.events) {
+        if (event.mode == 'n') {
+            // segments ago, trace index, bytes
+            REQUIRE(event.args[0] > 0);
+            REQUIRE(event.args[1] > 0);
+            deallocated += event.args[2];
+        }
+    }
+    REQUIRE(deallocated == 7);
+}
+
+#if ZSTD_FOUND
+TEST_CASE ("zstd compression") {
+    const uintptr_t numAllocations = 10000;
+    const auto recording = record({{"HEAPTRACK_ZSTD_LEVEL", "3"}, {"HEAPTRACK_ASYNC_BUFFER_SIZE", "65536"}}, [&]() {
+        for (uintptr_t i = 1; i <= numAllocations; ++i) {
+            heaptrack_malloc(reinterpret_cast<void*>(i << 4), i);
+            heaptrack_free(reinterpret_cast<void*>(i << 4));
+        }
+    });
+
+    REQUIRE(recording.contents[0] == ZstdInputBuffer::MAGIC_FIRST_BYTE);
+    REQUIRE(!recording.events.empty());
+    REQUIRE(recording.events[0].mode == 'v');
+    REQUIRE(recording.count('+') == numAllocations);
+    REQUIRE(recording.count('-') == numAllocations);
+    // everything written during shutdown must have been compressed too
+    REQUIRE(!recording.find("# async writer: ").empty());
+}
+#endif
@@ -9,6 +9,7 @@
 
 #include "track/trace.h"
 #include "track/tracetree.h"
+#include "track/unwindcache.h"
 
 #include "interpret/dwarfdiecache.h"
 
@@ -19,6 +20,8 @@
 #include <thread>
 
 #include <link.h>
+#include <sys/mman.h>
+#include <ucontext.h>
 
 using namespace std;
 
@@ -91,6 +94,108 @@ TEST_CASE ("getting backtrace traces") {
     }
 }
 
+TEST_CASE ("frame pointer unwinding") {
+    const auto useFramePointers = Trace::framePointerUnwinding();
+
+    // fill both traces from the same call site, so that all callers are equal
+    Trace reference;
+    Trace trace;
+    for (auto framePointers : {false, true}) {
+        Trace::setFramePointerUnwinding(framePointers);
+        REQUIRE(fill(framePointers ? trace : reference, 10, 0));
+    }
+    validateTrace(trace, trace.size());
+
+    Trace::setFramePointerUnwinding(useFramePointers);
+
+    // the first two frames lie within the unwinder and Trace::fill, but all
+    // callers must match as long as they got built with frame pointers
+    REQUIRE(trace.size() > 3);
+    auto it = find(reference.begin(), reference.end(), trace[2]);
+    REQUIRE(it != reference.end());
+    REQUIRE(distance(reference.begin(), it) < 4);
+    REQUIRE(distance(it, reference.end()) >= trace.size() - 2);
+    REQUIRE(equal(trace.begin() + 2, trace.end(), it));
+}
+
+bool __attribute__((noinline)) fillViaCallSiteA(Trace& trace, int depth)
+{
+    return fill(trace, depth, 0);
+}
+
+bool __attribute__((noinline)) fillViaCallSiteB(Trace& trace, int depth)
+{
+    // don't let the compiler fold this with the function above
+    return fill(trace, depth + 1, 0);
+}
+
+TEST_CASE ("unwind cache") {
+    if (!UnwindCache::supported()) {
+        return;
+    }
+
+    // alternate between call sites and depths, the cache must never return stale frames
+    const auto unwindCaching = Trace::unwindCaching();
+    for (int i = 0; i < 40; ++i) {
+        const auto depth = (i * 7) % 5 + (i > 20 ? Trace::MAX_SIZE : 0);
+        const auto callSite = (i % 3) ? fillViaCallSiteA : fillViaCallSiteB;
+
+        // fill both traces from the same call site, so that all callers are equal
+        Trace reference;
+        Trace trace;
+        for (auto caching : {false, true}) {
+            Trace::setUnwindCaching(caching);
+            REQUIRE(callSite(caching ? trace : reference, depth));
+        }
+        validateTrace(trace, trace.size());
+
+        // the first frames lie within the unwinder, but all callers must match
+        REQUIRE(trace.size() > 3);
+        auto it = find(reference.begin(), reference.end(), trace[1]);
+        REQUIRE(it != reference.end());
+        REQUIRE(distance(reference.begin(), it) < 4);
+        REQUIRE(distance(it, reference.end()) == trace.size() - 1);
+        REQUIRE(equal(trace.begin() + 1, trace.end(), it));
+    }
+    Trace::setUnwindCaching(unwindCaching);
+}
+
+namespace {
+ucontext_t s_mainContext;
+ucontext_t s_fiberContext;
+Trace s_fiberTrace;
+bool s_fiberFilled = false;
+}
+
+TEST_CASE ("unwind cache on a fiber stack") {
+    if (!UnwindCache::supported()) {
+        return;
+    }
+
+    const auto unwindCaching = Trace::unwindCaching();
+    Trace::setUnwindCaching(true);
+
+    // fill the cache with the frames of a fiber and unmap its stack afterwards
+    const size_t stackSize = 256 * 1024;
+    auto* stack = mmap(nullptr, stackSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    REQUIRE(stack != MAP_FAILED);
+    REQUIRE(getcontext(&s_fiberContext) == 0);
+    s_fiberContext.uc_stack.ss_sp = stack;
+    s_fiberContext.uc_stack.ss_size = stackSize;
+    s_fiberContext.uc_link = &s_mainContext;
+    makecontext(&s_fiberContext, []() { s_fiberFilled = fillViaCallSiteA(s_fiberTrace, 3); }, 0);
+    REQUIRE(swapcontext(&s_mainContext, &s_fiberContext) == 0);
+    REQUIRE(s_fiberFilled);
+    REQUIRE(munmap(stack, stackSize) == 0);
+
+    // the cached frames lie outside of the thread stack, they must not be read again
+    Trace trace;
+    REQUIRE(fillViaCallSiteA(trace, 3));
+    validateTrace(trace, trace.size());
+
+    Trace::setUnwindCaching(unwindCaching);
+}
+
 TEST_CASE ("tracetree indexing") {
     TraceTree tree;
 
@@ -175,6 +280,122 @@ TEST_CASE ("tracetree indexing") {
     }
 }
 
+TEST_CASE ("tracetree with many nodes") {
+    TraceTree tree;
+
+    // spread over several blocks of nodes, which grow in size
+    for (int pass = 0; pass < 2; ++pass) {
+        std::vector<std::pair<uintptr_t, uint32_t>> ipsToParent;
+        auto record = [&ipsToParent](uintptr_t ip, uint32_t parentIndex) {
+            ipsToParent.push_back({ip, parentIndex});
+            return true;
+        };
+
+        const uintptr_t numTraces = 10000;
+        std::vector<uint32_t> indices;
+        Trace trace;
+        for (uintptr_t i = 0; i < numTraces; ++i) {
+            const uintptr_t ips[] = {i + 1, 1000000 + i % 100};
+            trace.fillTestData(ips, 2);
+            indices.push_back(tree.index(trace, record));
+            REQUIRE(indices.back() == ipsToParent.size());
+        }
+        REQUIRE(ipsToParent.size() == numTraces + 100);
+
+        // all of them are known now
+        for (uintptr_t i = 0; i < numTraces; ++i) {
+            const uintptr_t ips[] = {i + 1, 1000000 + i % 100};
+            trace.fillTestData(ips, 2);
+            REQUIRE(tree.index(trace, [](uintptr_t, uint32_t) { return false; }) == indices[i]);
+        }
+
+        std::vector<std::pair<uintptr_t, uint32_t>> nodes;
+        REQUIRE(tree.forEachNode([&nodes](uintptr_t ip, uint32_t parentIndex) { nodes.push_back({ip, parentIndex}); }));
+        REQUIRE(nodes == ipsToParent);
+
+        // starts from scratch
+        tree.clear();
+    }
+}
+
+TEST_CASE ("concurrent tracetree indexing") {
+    ConcurrentTraceIndex sharedIndex(16);
+
+    std::mutex mutex;
+    const auto numTasks = std::max(4u, std::thread::hardware_concurrency());
+    std::vector<std::future<void>> tasks(numTasks);
+
+    struct IpToParent
+    {
+        uintptr_t ip;
+        uint32_t parentIndex;
+    };
+    std::vector<IpToParent> ipsToParent;
+
+    struct IndexedTrace
+    {
+        Trace trace;
+        uint32_t index;
+    };
+    std::vector<IndexedTrace> traces;
+
+    for (auto i = 0u; i < numTasks; ++i) {
+        tasks[i] = std::async(std::launch::async, [&, i]() {
+            // per-thread cache in front of the shared index
+            TraceTree cache;
+            Trace trace;
+
+            for (int k = 0; k < 100; ++k) {
+                for (uintptr_t j = 0; j < 32; ++j) {
+                    // half of the traces are shared between all threads
+                    const auto leaf = uintptr_t((j % 2 ? i + 1 : 0) * 100 + 1000);
+                    trace.fillTestData(j, leaf);
+
+                    auto index = cache.indexWith(trace, [&](uintptr_t ip, uint32_t parentIndex) {
+                        return sharedIndex.index(ip, parentIndex, [&](uint32_t index) {
+                            const std::lock_guard<std::mutex> guard(mutex);
+                            if (ipsToParent.size() < index) {
+                                ipsToParent.resize(index);
+                            }
+                            ipsToParent[index - 1] = {ip, parentIndex};
+                        });
+                    });
+                    REQUIRE(index > 0);
+
+                    if (k == 0) {
+                        const std::lock_guard<std::mutex> guard(mutex);
+                        traces.push_back({trace, index});
+                    }
+                }
+            }
+        });
+    }
+
+    for (auto& task : tasks) {
+        task.get();
+    }
+
+    REQUIRE(ipsToParent.size() == sharedIndex.size());
+
+    // verify that we can rebuild the traces
+    for (const auto& trace : traces) {
+        uint32_t index = trace.index;
+        int i = 0;
+        while (index) {
+            REQUIRE(i < trace.trace.size());
+            REQUIRE(index <= ipsToParent.size());
+
+            auto map = ipsToParent[index - 1];
+            REQUIRE(map.ip == reinterpret_cast<uintptr_t>(trace.trace[i]));
+            REQUIRE(map.parentIndex < index);
+
+            index = map.parentIndex;
+            ++i;
+        }
+        REQUIRE(i == trace.trace.size());
+    }
+}
+
 struct CallbackData
 {
     Dwfl* dwfl = nullptr;
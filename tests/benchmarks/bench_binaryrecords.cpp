@@ -0,0 +1,109 @@
+/*
+    SPDX-FileCopyrightText: 2026 heaptrack contributors
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <src/util/linereader.h>
+#include <src/util/linewriter.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+
+#include <stdlib.h>
+
+#include "../benchutil.h"
+
+constexpr int NUM_EVENTS = 3000000;
+
+template <typename Callback>
+double measure(Callback callback)
+{
+    const auto start = std::chrono::steady_clock::now();
+    callback();
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / NUM_EVENTS;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2) {
+        std::cerr << "usage: bench_binaryrecords [text|binary]\n";
+        return 1;
+    }
+
+    const auto tag = std::string(argv[1]);
+    if (tag != "text" && tag != "binary") {
+        std::cerr << "unhandled tag: " << tag << "\n";
+        return 1;
+    }
+    const bool binary = tag == "binary";
+
+    char fileName[] = "/tmp/bench_binaryrecords.XXXXXX";
+    const int fd = mkstemp(fileName);
+    if (fd == -1) {
+        std::cerr << "failed to create temporary file\n";
+        return 1;
+    }
+
+    // a mix of new trace points, allocations and frees of recently allocated memory,
+    // similar to what we see in real raw data files
+    const auto writeTime = measure([fd, binary]() {
+        LineWriter writer(fd);
+        std::mt19937_64 random(42);
+        const uint64_t heap = 0x55d0b3a1f000;
+        const uint64_t text = 0x7f48beedc000;
+        uint64_t ptr = heap;
+        uint32_t traces = 0;
+        for (int i = 0; i < NUM_EVENTS; ++i) {
+            const auto value = random();
+            switch (value % 8) {
+            case 0:
+                binary ? writer.writeBinaryLine('t', text + (value >> 40), traces / 2)
+                       : writer.writeHexLine('t', text + (value >> 40), traces / 2);
+                ++traces;
+                break;
+            case 1:
+            case 2:
+            case 3:
+            case 4:
+                ptr = heap + ((value >> 20) & 0xffff) * 16;
+                binary ? writer.writeBinaryLine('+', (value >> 8) & 0xfff, (value >> 32) % (traces + 1), ptr)
+                       : writer.writeHexLine('+', (value >> 8) & 0xfff, (value >> 32) % (traces + 1), ptr);
+                break;
+            default:
+                binary ? writer.writeBinaryLine('-', ptr - ((value >> 20) & 0xff) * 16)
+                       : writer.writeHexLine('-', ptr - ((value >> 20) & 0xff) * 16);
+                break;
+            }
+        }
+        writer.flush();
+    });
+
+    std::ifstream file(fileName, std::ios::binary);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    unlink(fileName);
+    const auto size = contents.str().size();
+
+    uint64_t sum = 0;
+    const auto readTime = measure([&contents, &sum, binary]() {
+        LineReader reader;
+        reader.setBinaryRecords(binary);
+        while (reader.getLine(contents)) {
+            uint64_t hex;
+            while (reader.readHex(hex)) {
+                sum += hex;
+            }
+        }
+    });
+    escape(&sum);
+
+    std::cout << tag << ": " << size << " bytes (" << static_cast<double>(size) / NUM_EVENTS
+              << " bytes/event), write: " << writeTime << "ns/event, read: " << readTime << "ns/event\n";
+    return 0;
+}
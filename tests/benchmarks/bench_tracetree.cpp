@@ -0,0 +1,151 @@
+/*
+    SPDX-FileCopyrightText: 2026 heaptrack contributors
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "src/track/tracetree.h"
+
+#include "../benchutil.h"
+
+constexpr int NUM_TRACES = 100000;
+constexpr int NO_BRANCH_DEPTH = 4;
+constexpr uintptr_t BRANCH_WIDTH = 16;
+
+namespace Legacy {
+// the previous TraceTree implementation, with nested vectors of sorted children
+struct TraceEdge
+{
+    Trace::ip_t instructionPointer;
+    uint32_t index;
+    std::vector<TraceEdge> children;
+};
+
+class TraceTree
+{
+public:
+    template <typename Fun>
+    uint32_t index(const Trace& trace, Fun callback)
+    {
+        uint32_t index = 0;
+        TraceEdge* parent = &m_root;
+        for (int i = trace.size() - 1; i >= 0; --i) {
+            const auto ip = trace[i];
+            if (!ip) {
+                continue;
+            }
+            auto it =
+                std::lower_bound(parent->children.begin(), parent->children.end(), ip,
+                                 [](const TraceEdge& l, const Trace::ip_t ip) { return l.instructionPointer < ip; });
+            if (it == parent->children.end() || it->instructionPointer != ip) {
+                index = m_index++;
+                it = parent->children.insert(it, {ip, index, {}});
+                if (!callback(reinterpret_cast<uintptr_t>(ip), parent->index)) {
+                    return 0;
+                }
+            }
+            index = it->index;
+            parent = &(*it);
+        }
+        return index;
+    }
+
+private:
+    TraceEdge m_root = {0, 0, {}};
+    uint32_t m_index = 1;
+};
+}
+
+std::vector<Trace> generateTraces(int depth)
+{
+    std::mt19937_64 engine(0);
+    std::uniform_int_distribution<uintptr_t> dist(0, BRANCH_WIDTH - 1);
+
+    // the outermost frame comes last, like for real backtraces
+    std::set<std::vector<uintptr_t>> uniqueTraces;
+    while (uniqueTraces.size() < NUM_TRACES) {
+        std::vector<uintptr_t> ips(depth);
+        for (int level = 0; level < depth; ++level) {
+            const auto branch = (level % NO_BRANCH_DEPTH) ? 0 : dist(engine);
+            ips[depth - level - 1] = 0x400000 + uintptr_t(level) * 0x1000 + branch * 0x10;
+        }
+        uniqueTraces.insert(std::move(ips));
+    }
+
+    std::vector<Trace> traces(NUM_TRACES);
+    std::transform(uniqueTraces.begin(), uniqueTraces.end(), traces.begin(), [](const std::vector<uintptr_t>& ips) {
+        Trace trace;
+        trace.fillTestData(ips.data(), static_cast<int>(ips.size()));
+        return trace;
+    });
+    std::shuffle(traces.begin(), traces.end(), engine);
+    return traces;
+}
+
+template <typename Tree>
+void bench(const std::vector<Trace>& traces)
+{
+    using clock = std::chrono::steady_clock;
+    auto nsPerTrace = [&traces](clock::time_point start) {
+        return std::chrono::duration<double, std::nano>(clock::now() - start).count() / traces.size();
+    };
+
+    Tree tree;
+    uint64_t numIndices = 0;
+    auto start = clock::now();
+    for (const auto& trace : traces) {
+        escape(&trace);
+        tree.index(trace, [&numIndices](uintptr_t, uint32_t) {
+            ++numIndices;
+            return true;
+        });
+    }
+    const auto insert = nsPerTrace(start);
+
+    // the common case: all backtraces are known already
+    uint64_t sum = 0;
+    start = clock::now();
+    for (const auto& trace : traces) {
+        escape(&trace);
+        sum += tree.index(trace, [](uintptr_t, uint32_t) { return true; });
+    }
+    const auto lookup = nsPerTrace(start);
+    clobber();
+
+    std::cout << "  " << numIndices << " indices, insert: " << insert << "ns/trace, lookup: " << lookup
+              << "ns/trace (" << sum << ")\n";
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2) {
+        std::cerr << "usage: bench_tracetree [legacy|flat]\n";
+        return 1;
+    }
+
+    const auto tag = std::string(argv[1]);
+    if (tag != "legacy" && tag != "flat") {
+        std::cerr << "unhandled tag: " << tag << "\n";
+        return 1;
+    }
+
+    for (int depth : {20, 40, 60}) {
+        std::cout << "depth " << depth << ":\n";
+        const auto traces = generateTraces(depth);
+        if (tag == "legacy") {
+            bench<Legacy::TraceTree>(traces);
+        } else {
+            bench<TraceTree>(traces);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,57 @@
+/*
+    SPDX-FileCopyrightText: 2026 heaptrack contributors
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "src/track/trace.h"
+
+#include "../benchutil.h"
+
+constexpr int NUM_TRACES = 100000;
+
+__attribute__((noinline)) void fill(Trace& trace, int depth)
+{
+    if (!depth) {
+        trace.fill(0);
+    } else {
+        fill(trace, depth - 1);
+    }
+    // prevent tail calls, every level must show up as a frame
+    clobber();
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2) {
+        std::cerr << "usage: bench_unwind [plain|cached|framepointers]\n";
+        return 1;
+    }
+
+    const auto tag = std::string(argv[1]);
+    if (tag == "cached") {
+        Trace::setUnwindCaching(true);
+    } else if (tag == "framepointers") {
+        Trace::setFramePointerUnwinding(true);
+    } else if (tag != "plain") {
+        std::cerr << "unhandled tag: " << tag << "\n";
+        return 1;
+    }
+
+    for (int depth : {5, 20, 50}) {
+        Trace trace;
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < NUM_TRACES; ++i) {
+            fill(trace, depth);
+            escape(&trace);
+        }
+        const auto end = std::chrono::steady_clock::now();
+        std::cout << "depth " << depth << ": " << trace.size() << " frames, "
+                  << std::chrono::duration<double, std::nano>(end - start).count() / NUM_TRACES << "ns/trace\n";
+    }
+    return 0;
+}
@@ -0,0 +1,36 @@
+/*
+    SPDX-FileCopyrightText: 2026 heaptrack contributors
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <cstdlib>
+
+#include <jemalloc/jemalloc.h>
+
+#include "../benchutil.h"
+
+int main()
+{
+    // a leak with the non-standard API
+    escape(mallocx(16, 0));
+
+    auto* p = mallocx(100, MALLOCX_ZERO);
+    escape(p);
+    p = rallocx(p, 200, 0);
+    escape(p);
+    // may or may not resize in place, either way the size stays at least 200
+    xallocx(p, 300, 0, 0);
+    escape(p);
+    dallocx(p, 0);
+
+    p = mallocx(64, MALLOCX_ALIGN(64));
+    escape(p);
+    sdallocx(p, 64, MALLOCX_ALIGN(64));
+
+    // the standard API goes through jemalloc too, when it is linked in
+    p = malloc(42);
+    escape(p);
+    free(p);
+    return 0;
+}
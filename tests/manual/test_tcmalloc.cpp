@@ -0,0 +1,49 @@
+/*
+    SPDX-FileCopyrightText: 2026 heaptrack contributors
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <new>
+
+#include <gperftools/tcmalloc.h>
+
+#include "../benchutil.h"
+
+int main()
+{
+    // a leak with the tcmalloc API
+    escape(tc_malloc(16));
+
+    auto* p = tc_malloc(100);
+    escape(p);
+    p = tc_realloc(p, 200);
+    escape(p);
+    tc_free(p);
+
+    p = tc_calloc(10, 10);
+    escape(p);
+    tc_free_sized(p, 100);
+
+    p = tc_memalign(64, 64);
+    escape(p);
+    tc_free(p);
+
+    if (!tc_posix_memalign(&p, 64, 128)) {
+        escape(p);
+        tc_free(p);
+    }
+
+    p = tc_new(42);
+    escape(p);
+    tc_delete(p);
+
+    p = tc_newarray(42);
+    escape(p);
+    tc_deletearray(p);
+
+    p = tc_new_nothrow(42, std::nothrow);
+    escape(p);
+    tc_delete_nothrow(p, std::nothrow);
+    return 0;
+}